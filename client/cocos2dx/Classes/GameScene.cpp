@@ -1,5 +1,6 @@
 #include "GameScene.h"
 #include "components.h"
+#include "terrain.h"
 
 using namespace cocos2d;
 using namespace Escape;
@@ -13,6 +14,20 @@ bool GameScene::init() {
         return false;
 
     logic = new Logic();
+    World *world = logic->world;
+    render_system = new RenderSystem();
+    logic->addSubSystem(render_system);
+
+    SpriteFrameCache::getInstance()->addSpriteFramesWithFile("atlas.plist");
+    tiles = SpriteBatchNode::create("tileset.png");
+    this->addChild(tiles, 0);
+    sprites = SpriteBatchNode::create("atlas.png");
+    this->addChild(sprites, 1);
+
+    world->on_destroy<AgentData>().connect<&GameScene::unbind>(*this);
+    world->on_destroy<BulletData>().connect<&GameScene::unbind>(*this);
+    world->on_destroy<TerrainData>().connect<&GameScene::unbind>(*this);
+
     this->scheduleUpdate();
     return true;
 }
@@ -27,56 +42,90 @@ GameScene::~GameScene() {
     delete logic;
 }
 
-void GameScene::update(float delta) {
-    auto visibleSize = Director::getInstance()->getVisibleSize();
-    Vec2 origin = Director::getInstance()->getVisibleOrigin();
-    World *world = logic->world;
-    this->removeAllChildren();
-
-    world->view<AgentData, Position, Health, Hitbox>().each(
-            [&](auto ent, auto &agt, auto &pos, auto &health, auto &hitbox) {
-                auto player = newPlayer(pos.x, pos.y, hitbox.radius);
-                if (world->has<Rotation>(ent)) {
-                    Rotation rotation = world->get<Rotation>(ent);
-                    player->setRotation(rotation.radian);
-                }
-            });
-    world->view<TerrainData, Position>().each([&](auto ent, auto &ter, auto &pos) {
-        auto wall = newBox(pos.x, pos.y, ter.argument_1, ter.argument_2);
-        if (world->has<Rotation>(ent)) {
-            Rotation rotation = world->get<Rotation>(ent);
-            wall->setRotation(rotation.radian);
-        }
-
-    });
-    world->view<BulletData, Position>().each([&](auto ent, auto &data, auto &pos) {
-        auto pair = newBullet(pos.x, pos.y, data.radius);
-        if (world->has<Rotation>(ent)) {
-            auto rotation = world->get<Rotation>(ent);
-        }
-    });
+Sprite *GameScene::acquire(entt::entity ent, const std::string &frame_name) {
+    Sprite *sprite;
+    if (pool.empty()) {
+        sprite = Sprite::createWithSpriteFrameName(frame_name);
+        sprites->addChild(sprite);
+    } else {
+        sprite = pool.back();
+        pool.pop_back();
+        sprite->setSpriteFrame(frame_name);
+        sprite->setVisible(true);
+    }
+    bound[ent] = Bound{sprite, frame};
+    return sprite;
 }
 
-cocos2d::Sprite *GameScene::newBullet(float x, float y, float r) {
-    auto sprite = Sprite::create("bullet.png");
-    sprite->setPosition(x, y);
-    sprite->setScale(r / 16 /*px*/);
-    this->addChild(sprite);
-    return sprite;
+void GameScene::unbind(entt::entity ent, World &) {
+    auto iter = bound.find(ent);
+    if (iter == bound.end())
+        return;
+    iter->second.sprite->setVisible(false);
+    iter->second.sprite->setRotation(0);
+    pool.push_back(iter->second.sprite);
+    bound.erase(iter);
 }
 
-cocos2d::Sprite *GameScene::newPlayer(float x, float y, float r) {
-    auto sprite = Sprite::create("player.png");
-    sprite->setPosition(x, y);
-    sprite->setScale(r / 16 /*px*/);
-    this->addChild(sprite);
-    return sprite;
+void GameScene::buildTiles(const TileMap &map) {
+    tiles->removeAllChildren();
+    int columns = map.tileset_columns;
+    for (int j = 0; j < map.height; ++j) {
+        for (int i = 0; i < map.width; ++i) {
+            int gid = map.tiles[map.index(i, j)];
+            if (gid <= 0)
+                continue;
+            Rect rect(((gid - 1) % columns) * TILE_PX, ((gid - 1) / columns) * TILE_PX, TILE_PX, TILE_PX);
+            auto tile = Sprite::createWithTexture(tiles->getTexture(), rect);
+            vec2 center = map.cellCenter(i, j);
+            tile->setPosition(center.x, center.y);
+            tile->setScale(map.tile_width / TILE_PX, map.tile_height / TILE_PX);
+            tiles->addChild(tile);
+        }
+    }
+    tiles_revision = map.revision;
 }
 
-cocos2d::Sprite *GameScene::newBox(float x, float y, float w, float h) {
-    auto sprite = Sprite::create("wall.png");
-    sprite->setPosition(x, y);
-    sprite->setScale(w / 32, h / 32);
-    this->addChild(sprite);
-    return sprite;
+void GameScene::update(float delta) {
+    World *world = logic->world;
+    auto visibleSize = Director::getInstance()->getVisibleSize();
+    Vec2 origin = Director::getInstance()->getVisibleOrigin();
+
+    TileMap *map = TerrainSystem::getTileMap(world);
+    if (map != nullptr && map->revision != tiles_revision)
+        buildTiles(*map);
+
+    // the scene does not tick the simulation, so the grids are refreshed here
+    render_system->rebuild();
+    CameraRect rect{origin.x, origin.y, origin.x + visibleSize.width, origin.y + visibleSize.height};
+    // walls are drawn one by one only when there is no tile layer
+    render_system->extract(rect, visible, map != nullptr ? RenderSystem::AGENTS | RenderSystem::BULLETS
+                                                         : RenderSystem::ALL);
+    ++frame;
+    for (auto &inst : visible) {
+        auto iter = bound.find(inst.ent);
+        Sprite *sprite;
+        if (iter != bound.end()) {
+            iter->second.frame = frame;
+            sprite = iter->second.sprite;
+        } else {
+            sprite = acquire(inst.ent, inst.kind == RenderKind::AGENT ? "player.png" :
+                                       inst.kind == RenderKind::BULLET ? "bullet.png" : "wall.png");
+        }
+        sprite->setPosition(inst.position.x, inst.position.y);
+        sprite->setRotation(inst.radian);
+        if (inst.kind == RenderKind::WALL)
+            sprite->setScale(inst.size.x / TILE_PX, inst.size.y / TILE_PX);
+        else
+            sprite->setScale(inst.size.x / 2 / 16 /*px*/);
+    }
+    // give back the sprites of whatever left the screen
+    for (entt::entity ent : shown) {
+        auto iter = bound.find(ent);
+        if (iter != bound.end() && iter->second.frame != frame)
+            unbind(ent, *world);
+    }
+    shown.clear();
+    for (auto &inst : visible)
+        shown.push_back(inst.ent);
 }
@@ -1,8 +1,11 @@
 #ifndef GAME_SCENE_H
 #define GAME_SCENE_H
 
+#include <unordered_map>
+#include <vector>
 #include "cocos2d.h"
 #include "logic.h"
+#include "render.h"
 class GameScene : public cocos2d::Scene {
 public:
     Escape::Logic *logic;
@@ -15,10 +18,34 @@ public:
     // implement the "static create()" method manually
     CREATE_FUNC(GameScene);
 private:
-    cocos2d::Sprite *newPlayer(float x, float y, float r);
-    cocos2d::Sprite *newBox(float x, float y, float w, float h);
+    // Size of a tile and of every frame in the atlas
+    static constexpr float TILE_PX = 32;
 
-    cocos2d::Sprite *newBullet(float x, float y, float r);
+    Escape::RenderSystem *render_system;
+    std::vector<Escape::RenderInstance> visible;
+    std::vector<entt::entity> shown;
+    unsigned frame = 0;
+
+    // Agents, bullets and loose walls, all drawn from atlas.png
+    cocos2d::SpriteBatchNode *sprites;
+    // The tile layer, drawn from tileset.png
+    cocos2d::SpriteBatchNode *tiles;
+    size_t tiles_revision = ~size_t(0);
+
+    struct Bound {
+        cocos2d::Sprite *sprite;
+        // last frame the entity was in view
+        unsigned frame;
+    };
+    std::unordered_map<entt::entity, Bound> bound;
+    // Hidden sprites that can be bound to the next entity in view
+    std::vector<cocos2d::Sprite *> pool;
+
+    cocos2d::Sprite *acquire(entt::entity ent, const std::string &frame_name);
+
+    void unbind(entt::entity ent, Escape::World &);
+
+    void buildTiles(const Escape::TileMap &map);
 };
 
 #endif // GAME_SCENE_H
@@ -0,0 +1,32 @@
+#version 120
+
+attribute vec4 vertex;
+attribute vec3 normal;
+// HWInstancingBasic: rows of the world matrix, then the custom parameters
+attribute vec4 uv1;
+attribute vec4 uv2;
+attribute vec4 uv3;
+attribute vec4 uv4;
+
+uniform mat4 viewProjMatrix;
+
+varying vec4 colour;
+
+void main()
+{
+    mat4 worldMatrix;
+    worldMatrix[0] = uv1;
+    worldMatrix[1] = uv2;
+    worldMatrix[2] = uv3;
+    worldMatrix[3] = vec4(0, 0, 0, 1);
+
+    vec4 worldPos = vertex * worldMatrix;
+    vec3 worldNormal = normalize((vec4(normal, 0) * worldMatrix).xyz);
+
+    // uv4.x is the health fraction, uv4.y how much of the health colour replaces white
+    vec3 health = vec3(1.0 - uv4.x, uv4.x, 0.0);
+    vec3 base = mix(vec3(1.0), health, uv4.y);
+    // the light shines straight down onto the map
+    colour = vec4(base * (0.6 + 0.4 * max(worldNormal.z, 0.0)), 1.0);
+    gl_Position = viewProjMatrix * worldPos;
+}
@@ -7,111 +7,122 @@
 #include <OgreQuaternion.h>
 #include "config.h"
 #include <fstream>
+#include <cmath>
+#include <algorithm>
 
 namespace Escape {
-    class DisplayOgre;
-
-    class ClientController : public Controller {
-        InputState *input;
-        ControlSystem *controlSystem;
-        int player_id;
-        DisplayOgre *display;
-    public:
-        ClientController(DisplayOgre *display_, InputState *input, int player_id_) : input(input),
-                                                                                     player_id(player_id_),
-                                                                                     display(display_) {
+    void DisplayOgre::setCenter(float x, float y) {
+        camNode->setPosition(x, y, camNode->getPosition().z);
+    }
 
+    Ogre::InstancedEntity *DisplayOgre::acquire(RenderKind kind, float radius) {
+        auto &pool = kind == RenderKind::AGENT ? agent_pool : bullet_pool;
+        Ogre::InstancedEntity *circle;
+        if (pool.empty()) {
+            auto *manager = kind == RenderKind::AGENT ? agent_instances : bullet_instances;
+            circle = manager->createInstancedEntity("Escape/Instanced");
+            // bullets are not tinted, agents get their health on the first sync
+            circle->setCustomParam(0, Ogre::Vector4(1, 0, 0, 0));
+        } else {
+            circle = pool.back();
+            pool.pop_back();
+            circle->setVisible(true);
         }
+        circle->setScale(Ogre::Vector3(radius / 50, radius / 50, 1.0 / 50));
+        return circle;
+    }
 
-        void init(ControlSystem *msg) override {
-            this->controlSystem = msg;
-        }
+    void DisplayOgre::release(RenderNode &node) {
+        node.instance->setVisible(false);
+        (node.kind == RenderKind::AGENT ? agent_pool : bullet_pool).push_back(node.instance);
+    }
 
-        void update(float delta) override {
-            entt::entity player = controlSystem->findPlayer(player_id);
-            if (player == entt::null)
-                return;
-            auto[pos, agt] = controlSystem->get<Position, AgentData>(player);
-            if (input->mouse[OgreBites::BUTTON_LEFT]) {
-                auto click = display->pickUp(input->mouse_x, input->mouse_y);
-                double x = click.x, y = click.y;
-                // std::cerr << "Cursor: " << x << " " << y << std::endl;
-                float angle = atan2(y - pos.y, x - pos.x);
-
-                controlSystem->dispatch(player, Shooting(angle));
+    void DisplayOgre::buildWalls(const std::vector<RenderInstance> &instances, const TileMap *map) {
+        walls->reset();
+        for (auto &inst : instances) {
+            if (map != nullptr) {
+                int i, j;
+                map->toCell(inst.position.x, inst.position.y, i, j);
+                // already drawn by its tile
+                if (map->inside(i, j) && map->walls[map->index(i, j)] &&
+                    std::abs(inst.size.x - map->tile_width) < 1e-3f && std::abs(inst.size.y - map->tile_height) < 1e-3f)
+                    continue;
             }
+            walls->addEntity(wall_template, Ogre::Vector3(inst.position.x, inst.position.y, 0),
+                             Ogre::Quaternion(Ogre::Radian(inst.radian), Ogre::Vector3(0, 0, 1)),
+                             Ogre::Vector3(inst.size.x / 100, inst.size.y / 100, 1.0 / 100));
+        }
+        walls->build();
+    }
 
-            Velocity vel(0, 0);
-            if (input->keys['w'])
-                vel.y += 1;
-            if (input->keys['s'])
-                vel.y += -1;
-            if (input->keys['a'])
-                vel.x += -1;
-            if (input->keys['d'])
-                vel.x += 1;
-            float spd = glm::length(as<glm::vec2>(vel));
-            if (spd > 0) {
-                if (spd > 1) {
-                    vel /= spd;
+    void DisplayOgre::buildChunk(const TileMap &map, int ci, int cj) {
+        Ogre::ManualObject *chunk = chunks[cj * chunks_x + ci];
+        chunk->clear();
+        int i0 = ci * CHUNK_TILES, j0 = cj * CHUNK_TILES;
+        int i1 = std::min(i0 + CHUNK_TILES, map.width), j1 = std::min(j0 + CHUNK_TILES, map.height);
+        bool begun = false;
+        Ogre::uint32 vertices = 0;
+        float hw = map.tile_width / 2, hh = map.tile_height / 2;
+        float du = 1.0f / map.tileset_columns, dv = 1.0f / map.tileset_rows;
+        for (int j = j0; j < j1; ++j) {
+            for (int i = i0; i < i1; ++i) {
+                int gid = map.tiles[map.index(i, j)];
+                if (gid <= 0)
+                    continue;
+                if (!begun) {
+                    chunk->begin("Escape/Tileset", Ogre::RenderOperation::OT_TRIANGLE_LIST);
+                    begun = true;
                 }
-                vel *= AGENT_IMPULSE;
-                controlSystem->dispatch<Impulse>(player, Impulse(vel.x, vel.y));
+                vec2 c = map.cellCenter(i, j);
+                float u = ((gid - 1) % map.tileset_columns) * du, v = ((gid - 1) / map.tileset_columns) * dv;
+                // texture rows go down like the map rows
+                chunk->position(c.x - hw, c.y + hh, -1);
+                chunk->textureCoord(u, v);
+                chunk->position(c.x - hw, c.y - hh, -1);
+                chunk->textureCoord(u, v + dv);
+                chunk->position(c.x + hw, c.y - hh, -1);
+                chunk->textureCoord(u + du, v + dv);
+                chunk->position(c.x + hw, c.y + hh, -1);
+                chunk->textureCoord(u + du, v);
+                chunk->quad(vertices, vertices + 1, vertices + 2, vertices + 3);
+                vertices += 4;
             }
-
-            if (input->keys['1'])
-                controlSystem->dispatch(player, ChangeWeapon(WeaponType::HANDGUN));
-
-            if (input->keys['2'])
-                controlSystem->dispatch(player, ChangeWeapon(WeaponType::SHOTGUN));
-
-            if (input->keys['3'])
-                controlSystem->dispatch(player, ChangeWeapon(WeaponType::SMG));
-
-            if (input->keys['4'])
-                controlSystem->dispatch(player, ChangeWeapon(WeaponType::RIFLE));
-            display->setCenter(pos.x, pos.y);
         }
-    };
-
-    void DisplayOgre::setCenter(float x, float y) {
-        camNode->setPosition(x, y, camNode->getPosition().z);
+        if (begun)
+            chunk->end();
     }
 
-    static void setColor(Ogre::Entity *ent, float r, float g, float b) {
-        char name[32];
-        sprintf(name, "Color(%d,%d,%d)", (int) (r * 255), (int) (g * 255), (int) (b * 255));
-        auto material = Ogre::MaterialManager::getSingleton().getByName(name);
-        if (!material) {
-            material = Ogre::MaterialManager::getSingleton().getByName("white")->clone(name);
-            material->setDiffuse(r, g, b, 1);
+    void DisplayOgre::buildTiles(const TileMap &map, const TileMap *previous) {
+        int cx = (map.width + CHUNK_TILES - 1) / CHUNK_TILES, cy = (map.height + CHUNK_TILES - 1) / CHUNK_TILES;
+        bool all = previous == nullptr || previous->width != map.width || previous->height != map.height ||
+                   previous->tileset_columns != map.tileset_columns || previous->origin_x != map.origin_x ||
+                   previous->origin_y != map.origin_y;
+        if (cx != chunks_x || cy != chunks_y) {
+            for (auto *chunk : chunks)
+                scnMgr->destroyManualObject(chunk);
+            chunks.clear();
+            chunks_x = cx;
+            chunks_y = cy;
+            for (int k = 0; k < cx * cy; ++k) {
+                auto *chunk = scnMgr->createManualObject();
+                chunk->setDynamic(false);
+                tile_root->attachObject(chunk);
+                chunks.push_back(chunk);
+            }
+            all = true;
+        }
+        for (int cj = 0; cj < cy; ++cj) {
+            for (int ci = 0; ci < cx; ++ci) {
+                bool changed = all;
+                for (int j = cj * CHUNK_TILES; !changed && j < std::min((cj + 1) * CHUNK_TILES, map.height); ++j) {
+                    int from = map.index(ci * CHUNK_TILES, j), to = map.index(std::min((ci + 1) * CHUNK_TILES, map.width), j);
+                    changed = !std::equal(map.tiles.begin() + from, map.tiles.begin() + to,
+                                          previous->tiles.begin() + from);
+                }
+                if (changed)
+                    buildChunk(map, ci, cj);
+            }
         }
-        ent->setMaterial(material);
-    }
-
-    std::pair<Ogre::SceneNode *, Ogre::Entity *>
-    DisplayOgre::newBox(float cx, float cy, float width, float height) {
-        Ogre::SceneNode *cubeNode = rects->createChildSceneNode();
-        cubeNode->setScale(width / 100, height / 100, 1.0 / 100);
-        cubeNode->setPosition(cx, cy, 0);
-
-        Ogre::Entity *cube = scnMgr->createEntity("Prefab_Cube");
-        cube->setMaterialName("white");
-
-        cubeNode->attachObject(cube);
-        return std::make_pair(cubeNode, cube);
-    }
-
-    std::pair<Ogre::SceneNode *, Ogre::Entity *> DisplayOgre::newCircle(float cx, float cy, float radius) {
-        Ogre::SceneNode *cubeNode = rects->createChildSceneNode();
-        cubeNode->setScale(radius / 50, radius / 50, 1.0 / 50);
-        cubeNode->setPosition(cx, cy, 0);
-
-        Ogre::Entity *cube = scnMgr->createEntity("Prefab_Sphere");
-        cube->setMaterialName("white");
-
-        cubeNode->attachObject(cube);
-        return std::make_pair(cubeNode, cube);
     }
 
     Ogre::Vector3 DisplayOgre::pickUp(unsigned int absoluteX, unsigned int absoluteY) {
@@ -126,91 +137,211 @@ namespace Escape {
 
     void DisplayOgre::initialize() {
         Window::initialize();
-        world = findSystem<SystemManager>()->getWorld();
-        timeserver = findSystem<TimeServer>();
-        findSystem<ControlSystem>()->addController(new ClientController(this, &input, 1));
-        rects = scnMgr->getRootSceneNode()->createChildSceneNode();
         Ogre::ResourceGroupManager::getSingleton().createResourceGroup("Popular");
         Ogre::ResourceGroupManager::getSingleton().addResourceLocation("assets", "FileSystem", "Popular");
+        // tileset.png lives next to the map
+        Ogre::ResourceGroupManager::getSingleton().addResourceLocation(match->getFolder(), "FileSystem", "Popular");
         Ogre::ResourceGroupManager::getSingleton().initialiseResourceGroup("Popular");
         Ogre::ResourceGroupManager::getSingleton().loadResourceGroup("Popular");
 
+        agent_instances = scnMgr->createInstanceManager("Agents", "Prefab_Sphere",
+                                                        Ogre::ResourceGroupManager::INTERNAL_RESOURCE_GROUP_NAME,
+                                                        Ogre::InstanceManager::HWInstancingBasic,
+                                                        INSTANCES_PER_BATCH);
+        bullet_instances = scnMgr->createInstanceManager("Bullets", "Prefab_Sphere",
+                                                         Ogre::ResourceGroupManager::INTERNAL_RESOURCE_GROUP_NAME,
+                                                         Ogre::InstanceManager::HWInstancingBasic,
+                                                         INSTANCES_PER_BATCH);
+        // health fraction and how much it tints, read by the vertex program after the world matrix
+        agent_instances->setNumCustomParams(1);
+        bullet_instances->setNumCustomParams(1);
+        walls = scnMgr->createStaticGeometry("Walls");
+        wall_template = scnMgr->createEntity("Prefab_Cube");
+        wall_template->setMaterialName("Escape/Wall");
+        tile_root = scnMgr->getRootSceneNode()->createChildSceneNode();
+
+        scnMgr->addRenderQueueListener(getOverlaySystem());
+        hud.initialize(scnMgr, getRenderWindow());
     }
 
     void DisplayOgre::processInput() {
         // ESC exit
         WindowOgre::processInput();
 
+        InputCommand cmd{.player_id = player_id,
+                .move_x = 0,
+                .move_y = 0,
+                .shooting = false,
+                .aim_x = 0,
+                .aim_y = 0,
+                .weapon = -1,
+        };
+        if (input.mouse[OgreBites::BUTTON_LEFT]) {
+            auto click = pickUp(input.mouse_x, input.mouse_y);
+            cmd.shooting = true;
+            cmd.aim_x = click.x;
+            cmd.aim_y = click.y;
+        }
+        if (input.keys['w'])
+            cmd.move_y += 1;
+        if (input.keys['s'])
+            cmd.move_y += -1;
+        if (input.keys['a'])
+            cmd.move_x += -1;
+        if (input.keys['d'])
+            cmd.move_x += 1;
+
+        if (input.keys['1'])
+            cmd.weapon = (int) WeaponType::HANDGUN;
+
+        if (input.keys['2'])
+            cmd.weapon = (int) WeaponType::SHOTGUN;
+
+        if (input.keys['3'])
+            cmd.weapon = (int) WeaponType::SMG;
+
+        if (input.keys['4'])
+            cmd.weapon = (int) WeaponType::RIFLE;
+        match->submit(cmd);
+
+        if (input.keys[HUD_KEY] && !hud_key)
+            hud.setVisible(!hud.isVisible());
+        hud_key = input.keys[HUD_KEY];
+
+        if (input.keys[REWIND_KEY] && !rewind_key && !match->rewind(REWIND_TICKS))
+            std::cerr << "Nothing to rewind, the match keeps no history" << std::endl;
+        rewind_key = input.keys[REWIND_KEY];
+
         if (input.keys['p']) {
             const Ogre::Vector3 &cam_pos = camNode->getPosition();
-            AgentSystem::createAgent(world, Position(cam_pos.x, cam_pos.y), 1, 1);
-
+            Position pos(cam_pos.x, cam_pos.y);
+            match->post([pos](World &world) {
+                AgentSystem::createAgent(&world, pos, 1, 1);
+            });
         }
 
         if (input.keys['o']) {
-
-            try {
-                std::cerr << "Writing map file" << std::endl;
-                SerializationHelper helper;
-                auto os = std::ofstream("map.json");
-                helper.serialize(*world, os);
-            }
-            catch (std::runtime_error &e) {
-                std::cerr << "error " << e.what() << std::endl;
-            }
-            catch (std::exception &e) {
-                std::cerr << "error " << e.what() << std::endl;
-            }
+            match->post([](World &world) {
+                try {
+                    std::cerr << "Writing map file" << std::endl;
+                    SerializationHelper helper;
+                    auto os = std::ofstream("map.json");
+                    helper.serialize(world, os);
+                }
+                catch (std::runtime_error &e) {
+                    std::cerr << "error " << e.what() << std::endl;
+                }
+                catch (std::exception &e) {
+                    std::cerr << "error " << e.what() << std::endl;
+                }
+            });
         }
         if (input.keys['i']) {
-            std::cerr << "Reading map file" << std::endl;
-            SerializationHelper helper;
-            auto is = std::ifstream("map.json");
-            helper.deserialize(*world, is);
+            match->post([](World &world) {
+                std::cerr << "Reading map file" << std::endl;
+                SerializationHelper helper;
+                auto is = std::ifstream("map.json");
+                helper.deserialize(world, is);
+            });
         }
     }
 
-
-    void DisplayOgre::postProcess() {
-        rects->removeAndDestroyAllChildren();
+    void DisplayOgre::syncNode(const RenderInstance &inst) {
+        auto iter = nodes.find(inst.ent);
+        if (iter != nodes.end() && iter->second.kind != inst.kind) {
+            // the id was recycled for something else
+            release(iter->second);
+            nodes.erase(iter);
+            iter = nodes.end();
+        }
+        if (iter == nodes.end()) {
+            auto *instance = acquire(inst.kind, inst.size.x / 2);
+            iter = nodes.emplace(inst.ent, RenderNode{instance, inst.kind, inst.position, inst.position, inst.radian,
+                                                      inst.radian, -1, frame}).first;
+        }
+        RenderNode &node = iter->second;
+        node.frame = frame;
+        node.from = node.to;
+        node.to = inst.position;
+        node.from_radian = node.to_radian;
+        node.to_radian = inst.radian;
+        if (inst.kind == RenderKind::AGENT && node.health != inst.health) {
+            node.health = inst.health;
+            node.instance->setCustomParam(0, Ogre::Vector4(inst.health, 1, 0, 0));
+        }
     }
 
+    void DisplayOgre::interpolate(float alpha) {
+        for (entt::entity ent : shown) {
+            RenderNode &node = nodes.find(ent)->second;
+            float x = node.from.x + (node.to.x - node.from.x) * alpha;
+            float y = node.from.y + (node.to.y - node.from.y) * alpha;
+            // the short way around
+            float turn = std::remainder(node.to_radian - node.from_radian, 2 * (float) M_PI);
+            node.instance->setPosition(Ogre::Vector3(x, y, 0));
+            node.instance->setOrientation(
+                    Ogre::Quaternion(Ogre::Radian(node.from_radian + turn * alpha), Ogre::Vector3(0, 0, 1)));
+        }
+        setCenter(camera_from.x + (camera_to.x - camera_from.x) * alpha,
+                  camera_from.y + (camera_to.y - camera_from.y) * alpha);
+    }
 
     void DisplayOgre::render() {
-        // std::cerr << "Render " << logic->timeserver->getTick() << std::endl;
-        world->view<AgentData, Position, Health, Hitbox>().each(
-                [&](auto ent, auto &agt, auto &pos, auto &health, auto &hitbox) {
-                    float percent = health.health / health.max_health;
-                    auto pair = newCircle(pos.x, pos.y, hitbox.radius);
-                    setColor(pair.second, 1 - percent, percent, 0);
-                    if (world->has<Rotation>(ent)) {
-                        auto rotation = world->get<Rotation>(ent);
-                        pair.first->setOrientation(
-                                Ogre::Quaternion(Ogre::Radian(rotation.radian), Ogre::Vector3(0, 0, 1)));
-                    }
-                });
-        world->view<TerrainData, Position>().each([&](auto ent, auto &ter, auto &pos) {
-            auto pair = newBox(pos.x, pos.y, ter.argument_1, ter.argument_2);
-            setColor(pair.second, .5, .5, .5);
-            if (world->has<Rotation>(ent)) {
-                auto rotation = world->get<Rotation>(ent);
-                pair.first->setOrientation(Ogre::Quaternion(Ogre::Radian(rotation.radian), Ogre::Vector3(0, 0, 1)));
+        const RenderSnapshot &snapshot = match->latest();
+        auto now = std::chrono::steady_clock::now();
+        if (snapshot.tick != drawn_tick) {
+            bool first = drawn_tick == ~size_t(0);
+            drawn_tick = snapshot.tick;
+            arrival = now;
+            if (snapshot.has_player) {
+                camera_from = first ? snapshot.player : camera_to;
+                camera_to = snapshot.player;
             }
 
-        });
-        world->view<BulletData, Position>().each([&](auto ent, auto &data, auto &pos) {
-            auto pair = newCircle(pos.x, pos.y, data.radius);
-            if (world->has<Rotation>(ent)) {
-                auto rotation = world->get<Rotation>(ent);
-                pair.first->setOrientation(Ogre::Quaternion(Ogre::Radian(rotation.radian), Ogre::Vector3(0, 0, 1)));
+            if (snapshot.tilemap != built_tiles) {
+                if (snapshot.tilemap)
+                    buildTiles(*snapshot.tilemap, built_tiles.get());
+                built_tiles = snapshot.tilemap;
+                // walls on wall tiles are left to the tiles
+                built_walls.reset();
             }
-        });
+            if (snapshot.walls != built_walls) {
+                built_walls = snapshot.walls;
+                if (built_walls)
+                    buildWalls(*built_walls, built_tiles.get());
+            }
+
+            ++frame;
+            for (auto &inst : snapshot.instances)
+                syncNode(inst);
+            // give back the instances of whatever left the screen or the world
+            for (entt::entity ent : shown) {
+                auto iter = nodes.find(ent);
+                if (iter != nodes.end() && iter->second.frame != frame) {
+                    release(iter->second);
+                    nodes.erase(iter);
+                }
+            }
+            shown.clear();
+            for (auto &inst : snapshot.instances)
+                shown.push_back(inst.ent);
+        }
+
+        // Draw between the previous tick and the latest one, a tick behind the simulation
+        float alpha = snapshot.delta > 0 ? std::chrono::duration<float>(now - arrival).count() / snapshot.delta : 1;
+        interpolate(std::min(alpha, 1.0f));
+
+        const Ogre::Vector3 &center = camNode->getPosition();
+        match->setCamera(CameraRect::around(center.x, center.y, cam->getOrthoWindowWidth(),
+                                            cam->getOrthoWindowHeight()));
+        hud.update(delta);
     }
 
     void DisplayOgre::windowResized(int width, int height) {
         std::cerr << "Resized " << width << " " << height << std::endl;
     }
 
-    DisplayOgre::DisplayOgre() : WindowOgre("Escape", 800, 600) {}
+    DisplayOgre::DisplayOgre(MatchView *match, int player_id) : WindowOgre("Escape", 800, 600), match(match),
+                                                                player_id(player_id), hud(match->getProfiler()) {}
 
 }
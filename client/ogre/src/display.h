@@ -7,26 +7,84 @@
 
 #include "window_ogre.h"
 #include <OgreRenderSystem.h>
+#include <chrono>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 #include "MyECS.h"
 #include "engine/utils.h"
 #include "control.h"
 #include "agent.h"
+#include "render.h"
+#include "match.h"
+#include "hud.h"
 
 namespace Escape {
 
     class DisplayOgre : public WindowOgre {
-        World *world;
-        TimeServer *timeserver;
-        Ogre::SceneNode *rects;
+        // Instance bound to an entity while it is in view, moving from the previous tick to the latest
+        struct RenderNode {
+            Ogre::InstancedEntity *instance;
+            RenderKind kind;
+            vec2 from, to;
+            float from_radian, to_radian;
+            float health;
+            // last frame it was in view
+            unsigned frame;
+        };
+
+        MatchView *match;
+        int player_id;
+        // Agents and bullets are drawn in batches of INSTANCES_PER_BATCH
+        Ogre::InstanceManager *agent_instances, *bullet_instances;
+        // Hidden instances, ready for the next entity that comes into view
+        std::vector<Ogre::InstancedEntity *> agent_pool, bullet_pool;
+        // Walls never move, they are baked together and rebuilt only when the snapshot has new ones
+        Ogre::StaticGeometry *walls;
+        Ogre::Entity *wall_template;
+        std::shared_ptr<const std::vector<RenderInstance>> built_walls;
+        // The tile layer, one mesh per CHUNK_TILES square of cells, each rebuilt only when its cells change
+        Ogre::SceneNode *tile_root;
+        std::vector<Ogre::ManualObject *> chunks;
+        int chunks_x = 0, chunks_y = 0;
+        std::shared_ptr<const TileMap> built_tiles;
+        std::unordered_map<entt::entity, RenderNode> nodes;
+        // what the camera showed last frame, reused to avoid allocations
+        std::vector<entt::entity> shown;
+        unsigned frame = 0;
+        // tick of the snapshot on screen and when it arrived
+        size_t drawn_tick = ~size_t(0);
+        std::chrono::steady_clock::time_point arrival;
+        vec2 camera_from, camera_to;
+        PerformanceHud hud;
+        // whether the HUD key was down last frame, it toggles on the press only
+        bool hud_key = false, rewind_key = false;
+
+        Ogre::InstancedEntity *acquire(RenderKind kind, float radius);
+
+        void release(RenderNode &node);
+
+        void buildWalls(const std::vector<RenderInstance> &instances, const TileMap *map);
+
+        void buildChunk(const TileMap &map, int ci, int cj);
+
+        void buildTiles(const TileMap &map, const TileMap *previous);
+
+        void syncNode(const RenderInstance &inst);
+
+        void interpolate(float alpha);
 
     public:
-        DisplayOgre();
+        DisplayOgre(MatchView *match, int player_id = 1);
 
         ~DisplayOgre() = default;
 
-        std::pair<Ogre::SceneNode *, Ogre::Entity *> newBox(float cx, float cy, float width, float height);
-
-        std::pair<Ogre::SceneNode *, Ogre::Entity *> newCircle(float cx, float cy, float radius);
+        static constexpr size_t INSTANCES_PER_BATCH = 4096;
+        static constexpr int CHUNK_TILES = 32;
+        static constexpr int HUD_KEY = '`';
+        // goes back REWIND_TICKS at every press, as far as the match keeps ticks
+        static constexpr int REWIND_KEY = 'r';
+        static constexpr uint32_t REWIND_TICKS = 60;
 
         Ogre::Vector3 pickUp(unsigned int absoluteX, unsigned int absoluteY);
 
@@ -37,8 +95,6 @@ namespace Escape {
         void render() override;
         void setCenter(float x, float y);
 
-        virtual void postProcess() override;
-
         void windowResized(int width, int height) override;
     };
 } // namespace Escape
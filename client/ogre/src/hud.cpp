@@ -0,0 +1,151 @@
+#include "hud.h"
+#include <algorithm>
+#include <iomanip>
+#include <numeric>
+#include <sstream>
+
+namespace Escape {
+    // lower left corner of the graph and its size, in normalized device coordinates
+    static const float GRAPH_LEFT = -0.95f, GRAPH_BOTTOM = -0.95f, GRAPH_WIDTH = 0.6f, GRAPH_HEIGHT = 0.4f;
+
+    PerformanceHud::PerformanceHud(Profiler &profiler) : profiler(profiler) {
+        clearSums();
+    }
+
+    PerformanceHud::~PerformanceHud() {
+        profiler.setEnabled(false);
+        delete trays;
+    }
+
+    void PerformanceHud::initialize(Ogre::SceneManager *scene, Ogre::RenderWindow *window) {
+        trays = new OgreBites::TrayManager("PerformanceHud", window);
+        trays->hideCursor();
+        text = trays->createTextBox(OgreBites::TL_TOPLEFT, "PerformanceText", "Performance", 300, 440);
+        text->hide();
+
+        graph = scene->createManualObject("PerformanceGraph");
+        graph->setUseIdentityProjection(true);
+        graph->setUseIdentityView(true);
+        graph->setDynamic(true);
+        graph->setRenderQueueGroup(Ogre::RENDER_QUEUE_OVERLAY);
+        drawGraph(false);
+        graph->setVisible(false);
+        scene->getRootSceneNode()->attachObject(graph);
+    }
+
+    void PerformanceHud::setVisible(bool visible_) {
+        visible = visible_;
+        profiler.setEnabled(visible);
+        if (text == nullptr)
+            return;
+        if (visible) {
+            text->show();
+            // drop what piled up while hidden
+            Profiler::Sample sample;
+            while (profiler.pop(sample));
+            clearSums();
+        } else {
+            text->hide();
+        }
+        graph->setVisible(visible);
+    }
+
+    void PerformanceHud::clearSums() {
+        std::fill(std::begin(sum.sections), std::end(sum.sections), 0.0f);
+        std::fill(std::begin(sum.counters), std::end(sum.counters), 0.0);
+        sum.total = 0;
+        samples = frames = 0;
+        frame_sum = since_text = 0;
+    }
+
+    void PerformanceHud::update(float frame_seconds) {
+        if (!visible || text == nullptr)
+            return;
+        float frame_ms = frame_seconds * 1000;
+        frame_history[frame_at] = frame_ms;
+        frame_at = (frame_at + 1) % HISTORY;
+        frame_sum += frame_ms;
+        ++frames;
+
+        Profiler::Sample sample;
+        while (profiler.pop(sample)) {
+            tick_history[tick_at] = sample.total;
+            tick_at = (tick_at + 1) % HISTORY;
+            sum.total += sample.total;
+            for (size_t i = 0; i < Profiler::MAX_SECTIONS; ++i)
+                sum.sections[i] += sample.sections[i];
+            // counters are levels, not durations; the newest is shown
+            std::copy(std::begin(sample.counters), std::end(sample.counters), std::begin(sum.counters));
+            last_tick = sample.tick;
+            ++samples;
+        }
+
+        drawGraph(true);
+        since_text += frame_seconds;
+        if (since_text >= TEXT_PERIOD) {
+            writeText();
+            clearSums();
+        }
+    }
+
+    void PerformanceHud::drawLine(size_t section, const float *history, size_t at, const Ogre::ColourValue &colour,
+                                  bool update) {
+        if (update)
+            graph->beginUpdate(section);
+        else
+            graph->begin("Escape/Graph", Ogre::RenderOperation::OT_LINE_STRIP);
+        // oldest first, at is the next one to be overwritten
+        for (size_t k = 0; k < HISTORY; ++k) {
+            float value = history == nullptr ? 1000 / 60.0f : history[(at + k) % HISTORY];
+            graph->position(GRAPH_LEFT + GRAPH_WIDTH * k / (HISTORY - 1),
+                            GRAPH_BOTTOM + GRAPH_HEIGHT * std::min(value / GRAPH_MS, 1.0f), 0);
+            graph->colour(colour);
+        }
+        graph->end();
+    }
+
+    void PerformanceHud::drawGraph(bool update) {
+        // the 60 fps budget never moves
+        if (!update)
+            drawLine(0, nullptr, 0, Ogre::ColourValue(0.5f, 0.5f, 0.5f), false);
+        drawLine(1, frame_history, frame_at, Ogre::ColourValue::Green, update);
+        drawLine(2, tick_history, tick_at, Ogre::ColourValue(1, 0.8f, 0), update);
+        // the strips live in screen space, they never leave the frustum
+        graph->setBoundingBox(Ogre::AxisAlignedBox::BOX_INFINITE);
+    }
+
+    void PerformanceHud::writeText() {
+        std::ostringstream out;
+        out << std::fixed << std::setprecision(2);
+        float frame_ms = frames > 0 ? frame_sum / frames : 0;
+        out << "frame  " << frame_ms << " ms  " << std::setprecision(0) << (frame_ms > 0 ? 1000 / frame_ms : 0)
+            << " fps\n" << std::setprecision(2);
+        if (samples == 0) {
+            out << "tick   no samples\n";
+            text->setText(out.str());
+            return;
+        }
+        out << "tick   " << sum.total / samples << " ms  #" << last_tick << "  " << samples / since_text
+            << " /s\n\nsystems (ms)\n";
+
+        const auto &sections = profiler.getSections();
+        std::vector<size_t> order(sections.size());
+        std::iota(order.begin(), order.end(), 0);
+        size_t shown = std::min(order.size(), TOP_SECTIONS);
+        std::partial_sort(order.begin(), order.begin() + shown, order.end(), [this](size_t a, size_t b) {
+            return sum.sections[a] > sum.sections[b];
+        });
+        out << std::setprecision(3);
+        for (size_t k = 0; k < shown; ++k)
+            out << "  " << sections[order[k]] << "  " << sum.sections[order[k]] / samples << "\n";
+
+        out << "\ncounters\n" << std::setprecision(0);
+        const auto &counters = profiler.getCounters();
+        for (size_t i = 0; i < counters.size(); ++i) {
+            // components nothing uses yet only take room
+            if (sum.counters[i] != 0)
+                out << "  " << counters[i] << "  " << sum.counters[i] << "\n";
+        }
+        text->setText(out.str());
+    }
+}
@@ -0,0 +1,65 @@
+#ifndef ESCAPE_HUD_H
+#define ESCAPE_HUD_H
+
+#include <Ogre.h>
+#include <OgreTrays.h>
+#include "engine/profiler.h"
+
+namespace Escape {
+    /**
+     * Frame time, tick time, system timings and the simulation's counters over the scene.
+     * Samples come from the Profiler ring of the simulation thread; the profiler only
+     * collects while the overlay is visible.
+     */
+    class PerformanceHud {
+    public:
+        static constexpr size_t HISTORY = 240;
+        // the top of the graph, two frames at 60 fps
+        static constexpr float GRAPH_MS = 33.3f;
+        static constexpr size_t TOP_SECTIONS = 8;
+        // seconds between refreshes of the text, averaging the samples in between
+        static constexpr float TEXT_PERIOD = 0.5f;
+
+    private:
+        Profiler &profiler;
+        OgreBites::TrayManager *trays = nullptr;
+        OgreBites::TextBox *text = nullptr;
+        Ogre::ManualObject *graph = nullptr;
+        bool visible = false;
+
+        float frame_history[HISTORY] = {0}, tick_history[HISTORY] = {0};
+        size_t frame_at = 0, tick_at = 0;
+
+        // sums since the text was last written
+        Profiler::Sample sum;
+        size_t samples = 0, frames = 0;
+        float frame_sum = 0, since_text = 0;
+        size_t last_tick = 0;
+
+        void clearSums();
+
+        void drawLine(size_t section, const float *history, size_t at, const Ogre::ColourValue &colour, bool update);
+
+        void drawGraph(bool update);
+
+        void writeText();
+
+    public:
+        PerformanceHud(Profiler &profiler);
+
+        ~PerformanceHud();
+
+        void initialize(Ogre::SceneManager *scene, Ogre::RenderWindow *window);
+
+        void setVisible(bool visible_);
+
+        bool isVisible() const {
+            return visible;
+        }
+
+        // Once per rendered frame, with its duration in seconds
+        void update(float frame_seconds);
+    };
+}
+
+#endif //ESCAPE_HUD_H
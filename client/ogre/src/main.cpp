@@ -1,50 +1,194 @@
-
-#include "ai_system.h"
-#include "lua_ai.h"
-#include "logic.h"
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <thread>
+#include "match.h"
+#include "net_client.h"
+#include "net_server.h"
+#include "lockstep.h"
+#include "shared_client.h"
+#include "replay.h"
+#include "rollback.h"
 #include "display.h"
-#include "map_converter.h"
 
 using namespace Escape;
 
-class MySystem : public ECSSystem {
-    std::string mapfile;
-public:
-    MySystem(std::string &&map) : mapfile(std::move(map)) {
-        MapConverter mapConverter;
-        auto *world = mapConverter.convert(mapfile);
-        auto *logic = new Logic(world);
-        addSubSystem(logic);
-        configure();
+// Draws until the window closes, the simulation runs wherever match lives
+static void loop(DisplayOgre *display) {
+    auto last = std::chrono::steady_clock::now();
+    while (display->isRunning()) {
+        auto now = std::chrono::steady_clock::now();
+        display->update(std::chrono::duration<float>(now - last).count());
+        last = now;
     }
+}
 
-    void update(float delta) override {
-        auto ai_system = findSystem<AISystem>();
-        for (entt::entity ent = ai_system->allocate(); ent != entt::null; ent = ai_system->allocate()) {
-            auto *world = getWorld();
-            auto data = world->get<AgentData>(ent);
-            auto ai_path = mapfile + "/" + data.ai + ".lua";
-            ai_system->insert(ent, new Agent_Lua(std::move(ai_path)));
-        }
-    }
-};
+static void usage() {
+    std::cerr << "You must specify a map folder, and optionally a tick rate" << std::endl;
+    std::cerr << "or --connect host:port [loss latency_ms] to play on a server" << std::endl;
+    std::cerr << "or --loopback port [loss latency_ms] to play on a server in this process" << std::endl;
+    std::cerr << "or --shared name to draw a match run by main_server --share in another process" << std::endl;
+    std::cerr << "or --lockstep player_id port host:port... to run the match on every peer" << std::endl;
+    std::cerr << "or --record file to play and record the session" << std::endl;
+    std::cerr << "or --replay file [tick] to watch a recording from a tick on" << std::endl;
+}
 
 int main(int argc, const char **argv) {
     if (argc < 2) {
-        std::cerr << "You must specify a map folder" << std::endl;
+        usage();
         exit(-1);
     }
 
-    auto display = new DisplayOgre();
+    // The same as a remote server, through localhost and both links degraded alike
+    if (argc >= 4 && std::string(argv[2]) == "--loopback") {
+        float loss = argc >= 6 ? std::stof(argv[4]) : 0, latency = argc >= 6 ? std::stof(argv[5]) / 1000 : 0;
+        Match match(argv[1]);
+        SnapshotServer server(match);
+        if (!server.listen((uint16_t) std::stoul(argv[3]))) {
+            std::cerr << "Cannot listen on port " << argv[3] << std::endl;
+            exit(-1);
+        }
+        server.getLink().configure(loss, latency);
+        std::atomic<bool> running{true};
+        std::thread thread([&] { server.run(running); });
 
-    MySystem system(argv[1]);
-    system.addSubSystem(display);
+        SnapshotClient client(argv[1]);
+        client.getLink().configure(loss, latency);
+        client.connect(NetAddress{0x7f000001, (uint16_t) std::stoul(argv[3])});
+        auto display = new DisplayOgre(&client);
+        display->initialize();
+        loop(display);
+        running = false;
+        thread.join();
+        server.report(std::cerr);
+        client.report(std::cerr);
+        delete display;
+        return 0;
+    }
 
-    system.foreach([](System *sys) {
-        sys->initialize();
-    });
-    while (display->isRunning()) {
-        system.updateAll(1 / 60.0f);
+    if (argc >= 4 && std::string(argv[2]) == "--connect") {
+        NetAddress server;
+        if (!NetAddress::parse(argv[3], server)) {
+            std::cerr << "Cannot parse the server address " << argv[3] << std::endl;
+            exit(-1);
+        }
+        SnapshotClient client(argv[1]);
+        if (argc >= 6)
+            client.getLink().configure(std::stof(argv[4]), std::stof(argv[5]) / 1000);
+        if (!client.connect(server)) {
+            std::cerr << "Cannot open a socket" << std::endl;
+            exit(-1);
+        }
+        auto display = new DisplayOgre(&client);
+        display->initialize();
+        loop(display);
+        client.report(std::cerr);
+        delete display;
+        return 0;
+    }
+
+    // The simulation keeps running when this process crashes or stalls, and the other way round
+    if (argc >= 4 && std::string(argv[2]) == "--shared") {
+        SharedMemoryClient client(argv[1]);
+        if (!client.connect(argv[3]))
+            std::cerr << "Waiting for a host to share " << argv[3] << std::endl;
+        auto display = new DisplayOgre(&client);
+        display->initialize();
+        loop(display);
+        client.report(std::cerr);
+        delete display;
+        return 0;
     }
+
+    // Every peer lists all the others, the same map and player ids 1, 2, ... on each
+    if (argc >= 6 && std::string(argv[2]) == "--lockstep") {
+        int player_id = std::stoi(argv[3]);
+        Match match(argv[1], player_id);
+        match.prepare();
+        LockstepSession session(match, player_id);
+        if (!session.listen((uint16_t) std::stoul(argv[4]))) {
+            std::cerr << "Cannot listen on port " << argv[4] << std::endl;
+            exit(-1);
+        }
+        for (int i = 5; i < argc; ++i) {
+            NetAddress peer;
+            if (!NetAddress::parse(argv[i], peer)) {
+                std::cerr << "Cannot parse the peer address " << argv[i] << std::endl;
+                exit(-1);
+            }
+            session.addPeer(peer);
+        }
+        auto display = new DisplayOgre(&session, player_id);
+        display->initialize();
+        loop(display);
+        session.report(std::cerr);
+        delete display;
+        return 0;
+    }
+
+    // The recording takes its tick rate from the match, the map folder must be the one it was made on
+    if (argc >= 4 && std::string(argv[2]) == "--replay") {
+        ReplayPlayer player(argv[1]);
+        if (!player.open(argv[3])) {
+            std::cerr << "Cannot play " << argv[3] << std::endl;
+            exit(-1);
+        }
+        if (argc >= 5)
+            player.seek((uint32_t) std::stoul(argv[4]));
+        auto display = new DisplayOgre(&player);
+        display->initialize();
+        loop(display);
+        player.report(std::cerr);
+        delete display;
+        return 0;
+    }
+
+    if (argc >= 4 && std::string(argv[2]) == "--record") {
+        Match match(argv[1]);
+        ReplayRecorder recorder(match);
+        if (!recorder.open(argv[3])) {
+            std::cerr << "Cannot write " << argv[3] << std::endl;
+            exit(-1);
+        }
+        match.setRecorder(&recorder);
+        auto display = new DisplayOgre(&match);
+        display->initialize();
+        match.start();
+        loop(display);
+        match.stop();
+        recorder.close();
+        recorder.report(std::cerr);
+        delete display;
+        return 0;
+    }
+
+    // a lower tick rate for slow hosts, the display interpolates between ticks; anything else
+    // here is a mode missing its operand
+    float rate = 0;
+    if (argc >= 3) {
+        char *end = nullptr;
+        rate = std::strtof(argv[2], &end);
+        if (end == argv[2] || *end != '\0' || !std::isfinite(rate) || rate <= 0) {
+            usage();
+            return -1;
+        }
+    }
+    Match match(argv[1]);
+    if (rate > 0)
+        match.setTickRate(rate);
+    // the last seconds, for DisplayOgre::REWIND_KEY
+    RollbackBuffer history(5 * RollbackBuffer::DEFAULT_TICKS);
+    match.setHistory(&history);
+    auto display = new DisplayOgre(&match);
+    display->initialize();
+    match.start();
+
+    // The simulation keeps its own pace on its thread, this loop only draws
+    loop(display);
+    match.stop();
+    history.report(std::cerr);
+    delete display;
     return 0;
-}
\ No newline at end of file
+}
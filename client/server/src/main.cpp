@@ -0,0 +1,659 @@
+#include <chrono>
+#include <csignal>
+#include <iostream>
+#include <random>
+#include <string>
+#include <thread>
+#include "match_scheduler.h"
+#include "net_server.h"
+#include "relevance.h"
+#include "replay.h"
+#include "rollback.h"
+#include "agent.h"
+#include "hpa_star.h"
+#include "visibility.h"
+#include "observation.h"
+#include "shared_host.h"
+
+using namespace Escape;
+
+// Many matches nobody watches, for load tests
+static void host(const char *folder, size_t matches, size_t threads) {
+    MatchScheduler scheduler(threads);
+    // the map is read once, every match gets its own world from it
+    for (size_t i = 0; i < matches; ++i)
+        scheduler.add(std::make_unique<Match>(folder));
+    scheduler.start();
+    std::cerr << "Hosting " << matches << " matches on " << scheduler.getWorkerCount() << " workers" << std::endl;
+
+    // Per worker: matches; ticks, missed deadlines and mean tick time since the last report;
+    // the worst tick since the start, the scheduler keeps no worst per interval
+    std::vector<MatchStats> last(matches);
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(5));
+        std::vector<size_t> count(scheduler.getWorkerCount()), ticks(count.size()), missed(count.size());
+        std::vector<double> busy_ms(count.size());
+        std::vector<float> worst(count.size());
+        for (size_t i = 0; i < matches; ++i) {
+            MatchStats stats = scheduler.getStats(i);
+            size_t w = stats.worker;
+            ++count[w];
+            ticks[w] += stats.ticks - last[i].ticks;
+            missed[w] += stats.missed - last[i].missed;
+            busy_ms[w] += stats.total_ms - last[i].total_ms;
+            worst[w] = std::max(worst[w], stats.max_ms);
+            last[i] = stats;
+        }
+        for (size_t w = 0; w < count.size(); ++w) {
+            std::cerr << "worker " << w << ": " << count[w] << " matches, " << ticks[w] << " ticks, "
+                      << missed[w] << " missed, " << (ticks[w] ? busy_ms[w] / ticks[w] : 0) << " ms mean, "
+                      << worst[w] << " ms worst since start" << std::endl;
+        }
+    }
+}
+
+// One match played by remote clients, with a report of their bandwidth
+static void serve(const char *folder, uint16_t port, float loss, float latency) {
+    Match match(folder);
+    SnapshotServer server(match);
+    if (!server.listen(port)) {
+        std::cerr << "Cannot listen on port " << port << std::endl;
+        exit(-1);
+    }
+    server.getLink().configure(loss, latency);
+    std::cerr << "Serving " << folder << " on port " << port << std::endl;
+
+    match.prepare();
+    auto last = std::chrono::steady_clock::now(), reported = last;
+    while (true) {
+        auto now = std::chrono::steady_clock::now();
+        server.poll(std::chrono::duration<float>(now - last).count());
+        last = now;
+        if (now - reported > std::chrono::seconds(5)) {
+            reported = now;
+            server.report(std::cerr);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
+
+// cleared by SIGINT and SIGTERM, for modes that have to stop their threads before exiting
+static std::atomic<bool> uninterrupted{true};
+
+static void interrupt(int) {
+    uninterrupted = false;
+}
+
+// One match drawn by a renderer process on this host, see SharedMemoryClient; runs until interrupted
+static void share(const char *folder, const std::string &name) {
+    Match match(folder);
+    SharedMemoryHost host(match);
+    if (!host.create(name)) {
+        std::cerr << "Cannot create the shared memory " << name << std::endl;
+        exit(-1);
+    }
+    std::cerr << "Sharing " << folder << " as " << name << std::endl;
+    std::signal(SIGINT, interrupt);
+    std::signal(SIGTERM, interrupt);
+    std::thread thread([&] { host.run(uninterrupted); });
+    auto reported = std::chrono::steady_clock::now();
+    while (uninterrupted) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        if (std::chrono::steady_clock::now() - reported > std::chrono::seconds(5)) {
+            reported = std::chrono::steady_clock::now();
+            host.report(std::cerr);
+        }
+    }
+    thread.join();
+    host.report(std::cerr);
+}
+
+// A recorded session as a workload that repeats exactly, see ReplayRecorder
+static void replay(const char *folder, const char *path) {
+    typedef std::chrono::steady_clock clock_type;
+    ReplayPlayer player(folder);
+    player.setPublishing(false);
+    auto began = clock_type::now();
+    if (!player.open(path)) {
+        std::cerr << "Cannot play " << path << std::endl;
+        exit(-1);
+    }
+    double open_ms = std::chrono::duration<double, std::milli>(clock_type::now() - began).count();
+    uint32_t first = player.getFirstTick(), ticks = 0;
+    double total_ms = 0, worst_ms = 0;
+    while (true) {
+        auto before = clock_type::now();
+        if (!player.next())
+            break;
+        double ms = std::chrono::duration<double, std::milli>(clock_type::now() - before).count();
+        total_ms += ms;
+        worst_ms = std::max(worst_ms, ms);
+        ++ticks;
+    }
+    // back to the middle, from its keyframe
+    began = clock_type::now();
+    player.seek(first + (player.getLastTick() - first) / 2);
+    double seek_ms = std::chrono::duration<double, std::milli>(clock_type::now() - began).count();
+    std::cerr << "opened in " << open_ms << " ms, " << ticks << " ticks of " << (ticks ? total_ms / ticks : 0)
+              << " ms (worst " << worst_ms << " ms), seek to the middle " << seek_ms << " ms" << std::endl;
+    player.report(std::cerr);
+}
+
+// What keeping the last ticks costs with agents added to a map, and going back a few of them
+static void benchRollback(const char *folder, size_t agents, size_t ticks) {
+    typedef std::chrono::steady_clock clock_type;
+    const uint32_t back = 8, every = 30;
+    Match match(folder);
+    match.setPublishing(false);
+    match.prepare();
+    RollbackBuffer history;
+    match.setHistory(&history);
+    World *world = match.getWorld();
+    entt::entity first = match.findSystem<ControlSystem>()->findPlayer(1);
+    Position spawn = first != entt::null ? world->get<Position>(first) : Position(0, 0);
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> offset(-8, 8);
+    // players nobody controls, they stand where they were put
+    for (size_t k = 0; k < agents; ++k)
+        AgentSystem::createAgent(world, Position(spawn.x + offset(rng), spawn.y + offset(rng)), 1000 + (int) k,
+                                 (int) (k % 2));
+
+    double restore_total_us = 0, restore_worst_us = 0;
+    size_t restores = 0;
+    for (size_t t = 1; t <= ticks; ++t) {
+        match.step();
+        if (t % every != 0)
+            continue;
+        auto began = clock_type::now();
+        if (!match.rollback(history.getNewestTick() - back))
+            continue;
+        double us = std::chrono::duration<double, std::micro>(clock_type::now() - began).count();
+        restore_total_us += us;
+        restore_worst_us = std::max(restore_worst_us, us);
+        ++restores;
+    }
+    std::cerr << world->alive() << " entities, " << restores << " restores of " << back << " ticks: "
+              << (restores ? restore_total_us / restores : 0) << " us (worst " << restore_worst_us << " us)"
+              << std::endl;
+    history.report(std::cerr);
+}
+
+// How many HPA* queries PathSystem answers on a large generated map, without a match around it
+static void benchPath(int side, size_t queries) {
+    typedef std::chrono::steady_clock clock_type;
+    const size_t actor_count = 256, per_tick = 64;
+    SystemManager manager;
+    auto *paths = new PathSystem();
+    manager.addSubSystem(paths);
+    World *world = manager.getWorld();
+
+    // open ground with rooms of random boxes, about a fifth of it walls
+    std::mt19937 rng(1);
+    TileMap map{};
+    map.width = map.height = side;
+    map.tile_width = map.tile_height = 1;
+    map.origin_x = -side / 2.0f + 0.5f;
+    map.origin_y = side / 2.0f - 0.5f;
+    map.tiles.assign((size_t) side * side, 0);
+    map.walls.assign((size_t) side * side, 0);
+    std::uniform_int_distribution<int> cell(0, side - 1), extent(1, 8);
+    for (size_t k = 0; k < (size_t) side * side / 100; ++k) {
+        int i = cell(rng), j = cell(rng), w = extent(rng), h = extent(rng);
+        for (int y = j; y < std::min(j + h, side); ++y)
+            for (int x = i; x < std::min(i + w, side); ++x)
+                map.walls[map.index(x, y)] = 1;
+    }
+    auto open = [&] {
+        while (true) {
+            int i = cell(rng), j = cell(rng);
+            if (!map.isWall(i, j))
+                return map.cellCenter(i, j);
+        }
+    };
+    entt::entity tilemap_ent = world->create();
+    world->assign<TileMap>(tilemap_ent, map);
+    // built here so that the queries per second are the searches alone
+    auto began = clock_type::now();
+    world->assign<MapGraph>(tilemap_ent, MapGraph{std::make_shared<const ClusterGraph>(ClusterGraph::build(map))});
+    double build_ms = std::chrono::duration<double, std::milli>(clock_type::now() - began).count();
+
+    std::vector<entt::entity> actors(actor_count);
+    for (auto &actor : actors) {
+        actor = world->create();
+        vec2 pos = open();
+        world->assign<Position>(actor, pos.x, pos.y);
+    }
+    // requests are made faster than they are answered, the queue never runs dry
+    size_t asked = 0, answered = 0, found = 0, waypoints = 0, ticks = 0;
+    began = clock_type::now();
+    while (answered < queries) {
+        for (size_t k = 0; k < per_tick && asked < queries; ++k, ++asked)
+            paths->request(actors[asked % actor_count], open());
+        world->clear<Path>();
+        manager.updateAll(1 / 60.0f);
+        world->view<Path>().each([&](auto ent, auto &path) {
+            ++answered;
+            found += path.found;
+            waypoints += path.waypoints.size();
+        });
+        ++ticks;
+    }
+    double total_s = std::chrono::duration<double>(clock_type::now() - began).count();
+    std::cerr << side << "x" << side << " map, graph built in " << build_ms << " ms, "
+              << world->get<MapGraph>(tilemap_ent).graph->nodes.size() << " nodes" << std::endl;
+    std::cerr << answered << " queries over " << ticks << " ticks, " << found << " found, "
+              << (found ? waypoints / found : 0) << " waypoints per path: " << paths->getQueriesPerSecond()
+              << " queries per second of planning, " << answered / total_s << " with the ticks around them"
+              << std::endl;
+}
+
+// What keeping the fog of war of 4 groups up to date costs as their agents walk around a generated map
+static void benchVisibility(size_t per_group, size_t ticks) {
+    typedef std::chrono::steady_clock clock_type;
+    const int side = 256, groups = 4;
+    // tiles per second, an agent enters another cell every few ticks
+    const float speed = 6;
+    SystemManager manager;
+    auto *raycast = new RaycastSystem();
+    auto *visibility = new VisibilitySystem();
+    manager.addSubSystem(raycast);
+    manager.addSubSystem(visibility);
+    manager.foreach([](System *sys) {
+        sys->initialize();
+    });
+    World *world = manager.getWorld();
+
+    std::mt19937 rng(1);
+    TileMap map{};
+    map.width = map.height = side;
+    map.tile_width = map.tile_height = 1;
+    map.origin_x = -side / 2.0f + 0.5f;
+    map.origin_y = side / 2.0f - 0.5f;
+    map.tiles.assign((size_t) side * side, 0);
+    map.walls.assign((size_t) side * side, 0);
+    std::uniform_int_distribution<int> cell(0, side - 1), extent(1, 6);
+    for (size_t k = 0; k < (size_t) side * side / 100; ++k) {
+        int i = cell(rng), j = cell(rng), w = extent(rng), h = extent(rng);
+        for (int y = j; y < std::min(j + h, side); ++y)
+            for (int x = i; x < std::min(i + w, side); ++x)
+                map.walls[map.index(x, y)] = 1;
+    }
+    world->assign<TileMap>(world->create(), map);
+
+    struct Walker {
+        entt::entity ent;
+        vec2 velocity;
+        int cell;
+    };
+    std::vector<Walker> walkers;
+    std::uniform_real_distribution<float> turn(0, 2 * (float) M_PI);
+    for (int g = 0; g < groups; ++g) {
+        for (size_t k = 0; k < per_group; ++k) {
+            int i, j;
+            do {
+                i = cell(rng);
+                j = cell(rng);
+            } while (map.isWall(i, j));
+            vec2 pos = map.cellCenter(i, j);
+            entt::entity ent = world->create();
+            world->assign<Position>(ent, pos.x, pos.y);
+            world->assign<AgentData>(ent, 1000 + (int) walkers.size(), g, std::string());
+            float angle = turn(rng);
+            walkers.push_back(Walker{ent, vec2(std::cos(angle) * speed, std::sin(angle) * speed), map.index(i, j)});
+        }
+    }
+
+    // the first update casts for everyone, the later ones only for agents that changed cell
+    auto began = clock_type::now();
+    manager.updateAll(1 / 60.0f);
+    double first_ms = std::chrono::duration<double, std::milli>(clock_type::now() - began).count();
+    double total_ms = 0, worst_ms = 0;
+    size_t moved = 0;
+    for (size_t t = 0; t < ticks; ++t) {
+        for (auto &walker : walkers) {
+            auto &pos = world->get<Position>(walker.ent);
+            vec2 next = pos + walker.velocity * (1 / 60.0f);
+            int i, j;
+            map.toCell(next.x, next.y, i, j);
+            // turn back from walls and the edges instead of going through
+            if (map.isWall(i, j)) {
+                walker.velocity = walker.velocity * -1.0f;
+                continue;
+            }
+            pos.x = next.x;
+            pos.y = next.y;
+            if (map.index(i, j) != walker.cell) {
+                walker.cell = map.index(i, j);
+                ++moved;
+            }
+        }
+        auto start = clock_type::now();
+        visibility->update(1 / 60.0f);
+        double ms = std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+        total_ms += ms;
+        worst_ms = std::max(worst_ms, ms);
+    }
+    size_t seen = 0;
+    for (int g = 0; g < groups; ++g)
+        for (int j = 0; j < side; ++j)
+            for (int i = 0; i < side; ++i)
+                seen += visibility->getGroup(g)->isVisible(i, j);
+    std::cerr << groups << " groups of " << per_group << " agents on " << side << "x" << side << ", "
+              << seen / groups << " cells seen per group" << std::endl;
+    std::cerr << "first update " << first_ms << " ms, then " << (ticks ? total_ms / ticks : 0) << " ms per tick (worst "
+              << worst_ms << " ms) for " << (ticks ? (double) moved / ticks : 0) << " agents changing cell, "
+              << (moved ? total_ms * 1000 / moved : 0) << " us per agent" << std::endl;
+}
+
+// How many observations learning agents get per second, on a generated map crowded with agents and bullets
+static void benchObservation(size_t instances, size_t batches) {
+    typedef std::chrono::steady_clock clock_type;
+    const int side = 200;
+    const size_t batch = 64;
+    SystemManager manager;
+    manager.addSubSystem(new RaycastSystem());
+    manager.addSubSystem(new RenderSystem());
+    auto *observation = new ObservationSystem();
+    manager.addSubSystem(observation);
+    manager.foreach([](System *sys) {
+        sys->initialize();
+    });
+    World *world = manager.getWorld();
+
+    std::mt19937 rng(1);
+    TileMap map{};
+    map.width = map.height = side;
+    map.tile_width = map.tile_height = 1;
+    map.origin_x = -side / 2.0f + 0.5f;
+    map.origin_y = side / 2.0f - 0.5f;
+    map.tiles.assign((size_t) side * side, 0);
+    map.walls.assign((size_t) side * side, 0);
+    std::uniform_int_distribution<int> cell(0, side - 1), extent(1, 6);
+    for (size_t k = 0; k < (size_t) side * side / 100; ++k) {
+        int i = cell(rng), j = cell(rng), w = extent(rng), h = extent(rng);
+        for (int y = j; y < std::min(j + h, side); ++y)
+            for (int x = i; x < std::min(i + w, side); ++x)
+                map.walls[map.index(x, y)] = 1;
+    }
+    world->assign<TileMap>(world->create(), map);
+
+    // a fifth agents in 4 groups, the rest bullets
+    std::uniform_real_distribution<float> coord(-side / 2.0f, side / 2.0f);
+    std::vector<entt::entity> agents;
+    for (size_t k = 0; k < instances; ++k) {
+        Position pos(coord(rng), coord(rng));
+        if (k % 5 == 0) {
+            agents.push_back(AgentSystem::createAgent(world, pos, 1000 + (int) k, (int) (k / 5 % 4)));
+        } else {
+            entt::entity bullet = world->create();
+            world->assign<Position>(bullet, pos);
+            world->assign<BulletData>(bullet, BulletData{0, BulletType::HANDGUN_BULLET, 10, 7.6f, 0.3f, false});
+        }
+    }
+    // the wall bitmap and the render grid, as after a tick
+    manager.updateAll(1 / 60.0f);
+
+    ObservationSpec spec;
+    std::vector<uint8_t> bytes(batch * ObservationSystem::observationSize(spec));
+    std::vector<float> floats(bytes.size());
+    std::vector<entt::entity> observers(batch);
+    double bytes_s = 0, floats_s = 0;
+    for (size_t b = 0; b < batches; ++b) {
+        for (size_t k = 0; k < batch; ++k)
+            observers[k] = agents[(b * batch + k) % agents.size()];
+        auto start = clock_type::now();
+        observation->observe(observers.data(), batch, spec, bytes.data());
+        auto middle = clock_type::now();
+        observation->observe(observers.data(), batch, spec, floats.data());
+        bytes_s += std::chrono::duration<double>(middle - start).count();
+        floats_s += std::chrono::duration<double>(clock_type::now() - middle).count();
+    }
+    double observed = (double) batches * batch;
+    std::cerr << instances << " agents and bullets on " << side << "x" << side << ", " << batches << " batches of "
+              << batch << " " << spec.size << "x" << spec.size << " observations" << std::endl;
+    std::cerr << "uint8 " << (bytes_s > 0 ? observed / bytes_s : 0) << " observations per second, float "
+              << (floats_s > 0 ? observed / floats_s : 0) << std::endl;
+}
+
+// What handing frames between two mappings of the same shared memory costs, on made up entities
+static void benchShared(size_t entities, size_t frames) {
+    typedef std::chrono::steady_clock clock_type;
+    const float side = 256;
+    const std::string name = "/escape-bench";
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-side / 2, side / 2);
+    std::vector<RenderInstance> instances(entities);
+    for (size_t k = 0; k < entities; ++k)
+        instances[k] = RenderInstance{(entt::entity) k, k % 5 == 0 ? RenderKind::AGENT : RenderKind::BULLET,
+                                      vec2(coord(rng), coord(rng)), 0, vec2(1, 1), 1, -1};
+    SpatialGrid grid(RENDER_CELL_SIZE);
+    grid.build(instances);
+
+    SharedMemory writer, reader;
+    if (!writer.create(name, sizeof(SharedChannel)) || !reader.open(name, sizeof(SharedChannel))) {
+        std::cerr << "Cannot create the shared memory " << name << std::endl;
+        exit(-1);
+    }
+    auto produced = new(writer.data()) SharedChannel();
+    auto consumed = static_cast<SharedChannel *>(reader.data());
+
+    // the renderer side spins, what it measures is the transport and not its frame rate
+    std::atomic<bool> running{true};
+    double read_us = 0, handoff_us = 0;
+    float read_max = 0, handoff_max = 0;
+    size_t received = 0, drawn = 0;
+    std::thread renderer([&] {
+        std::vector<RenderInstance> copy;
+        copy.reserve(SHARED_INSTANCES);
+        while (running || consumed->frames.size() > 0) {
+            const SharedFrame *frame = consumed->frames.peek();
+            if (frame == nullptr)
+                continue;
+            auto start = clock_type::now();
+            float handoff = (float) (std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    start.time_since_epoch()).count() - frame->committed) / 1000;
+            copy.assign(frame->instances, frame->instances + frame->count);
+            consumed->frames.release();
+            float read = std::chrono::duration<float, std::micro>(clock_type::now() - start).count();
+            read_us += read;
+            handoff_us += handoff;
+            read_max = std::max(read_max, read);
+            handoff_max = std::max(handoff_max, handoff);
+            drawn += copy.size();
+            ++received;
+        }
+    });
+
+    double write_us = 0;
+    float write_max = 0;
+    size_t dropped = 0;
+    for (size_t f = 0; f < frames; ++f) {
+        auto start = clock_type::now();
+        SharedFrame *frame = produced->frames.claim();
+        if (frame == nullptr) {
+            ++dropped;
+        } else {
+            frame->tick = f;
+            // a screen's worth, as big as the renderer would ask for
+            vec2 center = instances[f % entities].position;
+            frame->count = (uint32_t) grid.query(CameraRect::around(center.x, center.y, 160, 120),
+                                                 RenderSystem::AGENTS | RenderSystem::BULLETS, frame->instances,
+                                                 SHARED_INSTANCES);
+            auto done = clock_type::now();
+            frame->committed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    done.time_since_epoch()).count();
+            produced->frames.commit();
+            float write = std::chrono::duration<float, std::micro>(done - start).count();
+            write_us += write;
+            write_max = std::max(write_max, write);
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    running = false;
+    renderer.join();
+    size_t written = frames - dropped;
+    std::cerr << entities << " entities, " << written << " frames of " << (received ? drawn / received : 0)
+              << " instances, " << dropped << " dropped" << std::endl;
+    std::cerr << "per frame: write " << (written ? write_us / written : 0) << " us (worst " << write_max
+              << "), commit to pickup " << (received ? handoff_us / received : 0) << " us (worst " << handoff_max
+              << "), read " << (received ? read_us / received : 0) << " us (worst " << read_max << ")" << std::endl;
+}
+
+// What choosing every client's entities costs, on moving made up entities; no match or network involved
+static void benchRelevance(size_t clients, size_t entities) {
+    typedef std::chrono::steady_clock clock_type;
+    // bullets crowd the fights, a few hundred entities are on every screen
+    const float side = 256, tile = 4;
+    const int ticks = 300;
+    std::mt19937 rng(1);
+    std::uniform_real_distribution<float> coord(-side / 2, side / 2), turn(0, 2 * (float) M_PI);
+
+    std::vector<RenderInstance> instances(entities);
+    std::vector<vec2> velocities(entities);
+    for (size_t k = 0; k < entities; ++k) {
+        bool agent = k % 5 == 0;
+        float angle = turn(rng), speed = agent ? 4 : 30;
+        instances[k] = RenderInstance{(entt::entity) k, agent ? RenderKind::AGENT : RenderKind::BULLET,
+                                      vec2(coord(rng), coord(rng)), angle,
+                                      agent ? vec2(AGENT_RADIUS * 2, AGENT_RADIUS * 2) : vec2(0.5f, 0.5f), 1,
+                                      agent ? (int) (k / 5 % 2) : -1};
+        velocities[k] = vec2(std::cos(angle) * speed, std::sin(angle) * speed);
+    }
+    TileMap map{};
+    map.width = map.height = (int) (side / tile);
+    map.origin_x = -side / 2 + tile / 2;
+    map.origin_y = side / 2 - tile / 2;
+    map.tile_width = map.tile_height = tile;
+    // the players' group sees a third of the map
+    GroupVisibility seen;
+    seen.resize(map.width, map.height);
+    for (int cell = 0; cell < map.width * map.height; ++cell)
+        if (rng() % 3 == 0)
+            seen.add(cell);
+
+    struct Viewer {
+        size_t agent;
+        RelevanceFilter filter;
+        NetSnapshot sent, previous;
+    };
+    std::vector<Viewer> viewers;
+    for (size_t c = 0; c < clients && c * 5 < entities; ++c)
+        viewers.push_back(Viewer{c * 5, RelevanceFilter(VIEW_RADIUS * tile, NET_BUDGET * 8 - Net::SNAPSHOT_HEADER_BITS),
+                                 NetSnapshot(), NetSnapshot()});
+
+    SpatialGrid grid(RENDER_CELL_SIZE);
+    std::vector<RenderInstance> found;
+    uint8_t buffer[UdpSocket::MAX_PACKET];
+    double build_ms = 0, filter_ms = 0;
+    size_t candidates = 0, relevant = 0, sent = 0, kept = 0, bytes = 0, overflowed = 0;
+    for (int tick = 0; tick < ticks; ++tick) {
+        for (size_t k = 0; k < entities; ++k) {
+            vec2 &pos = instances[k].position;
+            pos += velocities[k] * (1 / 60.0f);
+            // wrap around, the density stays the same
+            pos.x = std::fmod(pos.x + side * 1.5f, side) - side / 2;
+            pos.y = std::fmod(pos.y + side * 1.5f, side) - side / 2;
+        }
+        auto start = clock_type::now();
+        grid.build(instances);
+        auto built = clock_type::now();
+        for (auto &viewer : viewers) {
+            const RenderInstance &player = instances[viewer.agent];
+            found.clear();
+            CameraRect rect = CameraRect::around(player.position.x, player.position.y, 80, 60);
+            grid.query(rect, RenderSystem::AGENTS | RenderSystem::BULLETS, found);
+            candidates += found.size();
+            RelevanceView view{rect, true, (uint32_t) viewer.agent, player.position, &seen, &map};
+            NetSnapshot current;
+            current.tick = (uint32_t) tick;
+            // every snapshot is acknowledged at once
+            viewer.filter.select(found, view, tick > 0 ? &viewer.sent : nullptr, current.entities);
+            std::swap(viewer.previous, viewer.sent);
+            viewer.sent = std::move(current);
+        }
+        auto filtered = clock_type::now();
+        build_ms += std::chrono::duration<double, std::milli>(built - start).count();
+        filter_ms += std::chrono::duration<double, std::milli>(filtered - built).count();
+
+        for (size_t c = 0; c < viewers.size(); ++c) {
+            auto &viewer = viewers[c];
+            relevant += viewer.filter.getRelevant();
+            sent += viewer.filter.getSent();
+            kept += viewer.filter.getKept();
+            // what the server would send, with a player in the header
+            viewer.sent.has_player = true;
+            size_t size = Net::encodeSnapshot(viewer.sent, tick > 0 ? &viewer.previous : nullptr, buffer,
+                                              sizeof(buffer));
+            bytes += size;
+            overflowed += size == 0;
+        }
+    }
+    double samples = (double) ticks * viewers.size();
+    std::cerr << viewers.size() << " clients, " << entities << " entities, " << ticks << " ticks" << std::endl;
+    std::cerr << "grid build " << build_ms / ticks << " ms per tick, filtering " << filter_ms / ticks
+              << " ms per tick, " << filter_ms * 1000 / samples << " us per client" << std::endl;
+    std::cerr << "per client and tick: " << candidates / samples << " on screen, " << relevant / samples
+              << " relevant, " << sent / samples << " sent, " << kept / samples << " repeated, "
+              << bytes / samples << " bytes, " << overflowed << " snapshots over a packet" << std::endl;
+}
+
+int main(int argc, const char **argv) {
+    if (argc < 2) {
+        std::cerr << "You must specify a map folder, and optionally the number of matches and of worker threads"
+                  << std::endl;
+        std::cerr << "or --listen port [loss latency_ms] to serve one match to clients" << std::endl;
+        std::cerr << "or --share name to run one match for a renderer process on this host" << std::endl;
+        std::cerr << "or --replay file to run a recorded session as fast as possible" << std::endl;
+        std::cerr << "or --bench-rollback [agents ticks] to time keeping the last ticks and going back" << std::endl;
+        std::cerr << "or --bench-path [side queries] to time path queries on a generated map" << std::endl;
+        std::cerr << "or --bench-visibility [agents_per_group ticks] to time the fog of war of 4 groups"
+                  << std::endl;
+        std::cerr << "or --bench-observation [instances batches] to time observations for learning agents"
+                  << std::endl;
+        std::cerr << "or --bench-shared [entities frames] to time handing frames through shared memory" << std::endl;
+        std::cerr << "or --bench-relevance [clients entities] to time the choice of what clients are sent"
+                  << std::endl;
+        exit(-1);
+    }
+    if (std::string(argv[1]) == "--bench-relevance") {
+        benchRelevance(argc >= 3 ? std::stoul(argv[2]) : 64, argc >= 4 ? std::stoul(argv[3]) : 10000);
+        return 0;
+    }
+    if (std::string(argv[1]) == "--bench-path") {
+        benchPath(argc >= 3 ? std::stoi(argv[2]) : 1024, argc >= 4 ? std::stoul(argv[3]) : 20000);
+        return 0;
+    }
+    if (std::string(argv[1]) == "--bench-visibility") {
+        benchVisibility(argc >= 3 ? std::stoul(argv[2]) : 200, argc >= 4 ? std::stoul(argv[3]) : 600);
+        return 0;
+    }
+    if (std::string(argv[1]) == "--bench-observation") {
+        benchObservation(argc >= 3 ? std::stoul(argv[2]) : 2000, argc >= 4 ? std::stoul(argv[3]) : 200);
+        return 0;
+    }
+    if (std::string(argv[1]) == "--bench-shared") {
+        benchShared(argc >= 3 ? std::stoul(argv[2]) : 10000, argc >= 4 ? std::stoul(argv[3]) : 2000);
+        return 0;
+    }
+    if (argc >= 4 && std::string(argv[2]) == "--share") {
+        share(argv[1], argv[3]);
+        return 0;
+    }
+    if (argc >= 3 && std::string(argv[2]) == "--bench-rollback") {
+        benchRollback(argv[1], argc >= 4 ? std::stoul(argv[3]) : 1000, argc >= 5 ? std::stoul(argv[4]) : 600);
+        return 0;
+    }
+    if (argc >= 4 && std::string(argv[2]) == "--replay") {
+        replay(argv[1], argv[3]);
+        return 0;
+    }
+    if (argc >= 4 && std::string(argv[2]) == "--listen") {
+        serve(argv[1], (uint16_t) std::stoul(argv[3]), argc >= 5 ? std::stof(argv[4]) : 0,
+              argc >= 6 ? std::stof(argv[5]) / 1000 : 0);
+        return 0;
+    }
+    size_t matches = argc >= 3 ? std::stoul(argv[2]) : 8;
+    size_t threads = argc >= 4 ? std::stoul(argv[3]) : std::max(std::thread::hardware_concurrency(), 1u);
+    host(argv[1], matches, threads);
+    return 0;
+}
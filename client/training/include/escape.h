@@ -0,0 +1,68 @@
+/*
+ * C interface for training loops: many independent matches on one map, stepped together.
+ * Buffers are owned by the caller and written in place, so they can be numpy arrays.
+ */
+#ifndef ESCAPE_C_API_H
+#define ESCAPE_C_API_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#if defined(_WIN32)
+#define ESCAPE_API __declspec(dllexport)
+#else
+#define ESCAPE_API __attribute__((visibility("default")))
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct escape_envs escape_envs;
+
+/* What the learner does for one tick, the same as a player's input */
+typedef struct escape_action {
+    float move_x, move_y;
+    int32_t shooting;
+    float aim_x, aim_y;
+    /* WeaponType to switch to, -1 to keep the current one */
+    int32_t weapon;
+} escape_action;
+
+/*
+ * count environments on the map folder, stepped by threads workers plus the calling thread.
+ * Observations are size * size cells of cell world units (0 for the tile size) around the
+ * player. Returns NULL on failure, see escape_last_error.
+ */
+ESCAPE_API escape_envs *escape_create(const char *folder, size_t count, int size, float cell, size_t threads,
+                                      size_t max_ticks);
+
+ESCAPE_API void escape_destroy(escape_envs *envs);
+
+ESCAPE_API size_t escape_count(const escape_envs *envs);
+
+/* Floats in one observation, channels first */
+ESCAPE_API size_t escape_observation_size(const escape_envs *envs);
+
+/* Starts a new episode everywhere, observations holds count * escape_observation_size floats */
+ESCAPE_API int escape_reset_all(escape_envs *envs, float *observations);
+
+/*
+ * One tick in every environment. actions holds count actions, rewards and dones count values.
+ * A finished environment starts over and its observation is the first of the next episode.
+ * Returns 0, or -1 on failure.
+ */
+ESCAPE_API int escape_step_all(escape_envs *envs, const escape_action *actions, float *observations,
+                               float *rewards, uint8_t *dones);
+
+/* Environment steps per second of time spent in escape_step_all */
+ESCAPE_API double escape_steps_per_second(const escape_envs *envs);
+
+/* Message of the last failure on this thread */
+ESCAPE_API const char *escape_last_error(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* ESCAPE_C_API_H */
@@ -0,0 +1,85 @@
+#include "escape.h"
+#include <exception>
+#include <string>
+#include "environment.h"
+
+using namespace Escape;
+
+struct escape_envs {
+    VectorEnvironment environments;
+    // converted actions, kept so a step does not allocate
+    std::vector<InputCommand> commands;
+};
+
+static std::string &lastError() {
+    thread_local std::string error;
+    return error;
+}
+
+template<typename Fn>
+static int guarded(Fn fn) {
+    try {
+        fn();
+        return 0;
+    } catch (std::exception &e) {
+        lastError() = e.what();
+    } catch (...) {
+        lastError() = "unknown error";
+    }
+    return -1;
+}
+
+escape_envs *escape_create(const char *folder, size_t count, int size, float cell, size_t threads,
+                           size_t max_ticks) {
+    escape_envs *envs = nullptr;
+    guarded([&] {
+        ObservationSpec spec{.size = size, .cell = cell, .centered = true};
+        envs = new escape_envs{VectorEnvironment(folder, count, spec, threads, 1, max_ticks),
+                               std::vector<InputCommand>(count)};
+    });
+    return envs;
+}
+
+void escape_destroy(escape_envs *envs) {
+    delete envs;
+}
+
+size_t escape_count(const escape_envs *envs) {
+    return envs->environments.size();
+}
+
+size_t escape_observation_size(const escape_envs *envs) {
+    return envs->environments.observationSize();
+}
+
+int escape_reset_all(escape_envs *envs, float *observations) {
+    return guarded([&] {
+        envs->environments.resetAll(observations);
+    });
+}
+
+int escape_step_all(escape_envs *envs, const escape_action *actions, float *observations, float *rewards,
+                    uint8_t *dones) {
+    return guarded([&] {
+        for (size_t i = 0; i < envs->commands.size(); ++i) {
+            const escape_action &action = actions[i];
+            envs->commands[i] = InputCommand{.player_id = 1,
+                    .move_x = action.move_x,
+                    .move_y = action.move_y,
+                    .shooting = action.shooting != 0,
+                    .aim_x = action.aim_x,
+                    .aim_y = action.aim_y,
+                    .weapon = action.weapon,
+            };
+        }
+        envs->environments.stepAll(envs->commands.data(), observations, rewards, dones);
+    });
+}
+
+double escape_steps_per_second(const escape_envs *envs) {
+    return envs->environments.getStepsPerSecond();
+}
+
+const char *escape_last_error(void) {
+    return lastError().c_str();
+}
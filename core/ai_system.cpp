@@ -48,5 +48,21 @@ namespace Escape {
         contr->addController(agt);
     }
 
+    void AISystem::clear() {
+        auto contr = findSystem<ControlSystem>();
+        for (auto &pair : AIs) {
+            contr->removeController(pair.second);
+            delete pair.second;
+        }
+        AIs.clear();
+    }
+
+    size_t AISystem::getMemoryUsage() const {
+        size_t total = 0;
+        for (auto &pair : AIs)
+            total += pair.second->getMemoryUsage();
+        return total;
+    }
+
 
 }
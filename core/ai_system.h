@@ -31,6 +31,11 @@ namespace Escape {
         entt::entity getEntityID() {
             return id;
         }
+
+        // Bytes held by the script runtime behind this agent, if any
+        virtual size_t getMemoryUsage() const {
+            return 0;
+        }
     };
 
     class AISystem : public ECSSystem {
@@ -45,6 +50,11 @@ namespace Escape {
         entt::entity allocate();
 
         void insert(entt::entity ent, AgentControl *agt);
+
+        // Drops every AI, agents get new ones as if they had just appeared
+        void clear();
+
+        size_t getMemoryUsage() const;
     };
 
 }
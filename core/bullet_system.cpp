@@ -60,6 +60,6 @@ namespace Escape{
 
         getWorld()->assign<Velocity>(bullet, speed * ang);
         getWorld()->assign<Position>(bullet, getWorld()->get<Position>(firer) + ang * distance);
-        getWorld()->assign<Lifespan>(bullet, lifespan->period(3));
+        getWorld()->assign<Lifespan>(bullet, lifespan->period(LIFESPAN));
     }
 }
@@ -13,6 +13,9 @@ namespace Escape {
         LifespanSystem *lifespan;
 
     public:
+        // seconds a bullet flies when it hits nothing
+        static constexpr float LIFESPAN = 3;
+
         BulletSystem();
         void initialize() override;
         void fire(entt::entity firer, BulletType type, float angle, float speed, float damage, float distance);
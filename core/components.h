@@ -3,6 +3,8 @@
 
 #include <map>
 #include <deque>
+#include <vector>
+#include <cmath>
 #include "engine/utils.h"
 #include "MyECS.h"
 
@@ -174,6 +176,52 @@ struct TerrainData {
     float argument_4;
 };
 
+// The tile layer read by MapConverter, kept in the world so navigation and rendering
+// do not have to rebuild it from wall entities. Cell (i, j) is column i, row j, rows
+// go downwards (negative y) the same way Tiled stores them.
+struct TileMap {
+    int width;
+    int height;
+    float origin_x; // world position of the center of cell (0, 0)
+    float origin_y;
+    float tile_width;
+    float tile_height;
+    std::vector<int> tiles; // Tiled gid, 0 means empty
+    std::vector<int> walls; // non-zero if the cell blocks movement and sight
+    size_t revision;        // bumped whenever tiles or walls change
+    int tileset_columns;    // layout of the tileset image, gid 1 is its top left tile
+    int tileset_rows;
+
+    bool inside(int i, int j) const {
+        return i >= 0 && j >= 0 && i < width && j < height;
+    }
+
+    int index(int i, int j) const {
+        return j * width + i;
+    }
+
+    bool isWall(int i, int j) const {
+        return !inside(i, j) || walls[index(i, j)] != 0;
+    }
+
+    void toCell(float x, float y, int &i, int &j) const {
+        i = (int) std::floor((x - origin_x) / tile_width + 0.5f);
+        j = (int) std::floor((origin_y - y) / tile_height + 0.5f);
+    }
+
+    vec2 cellCenter(int i, int j) const {
+        return vec2(origin_x + i * tile_width, origin_y - j * tile_height);
+    }
+};
+
+// Answer to a PathSystem request. Not serialized, agents ask again after loading.
+struct Path {
+    unsigned int ticket;
+    bool found;
+    std::vector<vec2> waypoints;
+    size_t next; // first waypoint not reached yet
+};
+
 struct MapInfo : public std::map<std::string, std::string> {
     using s_s_pair = std::map<std::string, std::string>;
     FORWARD_CONSTRUCTORS(MapInfo, s_s_pair);
@@ -197,6 +245,7 @@ struct MapInfo : public std::map<std::string, std::string> {
     TimeServerInfo,    \
     AgentData,         \
     TerrainData,       \
+    TileMap,           \
     MapInfo
 
 #define FOREACH_COMPONENT_TYPE(func) \
@@ -213,6 +262,7 @@ struct MapInfo : public std::map<std::string, std::string> {
     func(TimeServerInfo);    \
     func(AgentData);         \
     func(TerrainData);       \
+    func(TileMap);           \
     func(MapInfo)
 
 #endif // COMPONENTS_H
@@ -6,5 +6,10 @@
 #define ESCAPE_CONFIG_H
 #define AGENT_IMPULSE 8
 #define AGENT_RADIUS 1
+#define AGENT_DAMPING 15 // linear damping of agent bodies, per second
+#define VIEW_RADIUS 12 // in tiles
+#define RENDER_CELL_SIZE 16 // in world units
+#define NET_BUDGET 1000 // bytes of snapshot per client and tick
+#define SHARED_INSTANCES 8192 // agents and bullets in a frame handed to a renderer process
 
 #endif //ESCAPE_CONFIG_H
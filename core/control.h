@@ -11,9 +11,14 @@
 #include <vector>
 #include <sstream>
 #include <set>
+#include <cmath>
+#include <algorithm>
 #include "event_system.h"
 #include "serialization.h"
 #include "nlohmann/json.hpp"
+#include "config.h"
+#include "movement.h"
+#include "engine/spsc_queue.h"
 
 namespace Escape {
     class ControlSystem;
@@ -36,21 +41,133 @@ namespace Escape {
         }
     };
 
+    // State of a player's input devices at one frame, already in world units
+    struct InputCommand {
+        int player_id;
+        // wanted direction, longer than 1 is clamped
+        float move_x, move_y;
+        bool shooting;
+        // world position the player aims at
+        float aim_x, aim_y;
+        // WeaponType to switch to, -1 to keep the current one
+        int weapon;
+    };
+
+    // Everything one entity asked for during a tick, folded into one
+    struct Intent {
+        entt::entity actor;
+        // sum of the impulses
+        vec2 impulse;
+        bool shooting;
+        // of the newest shot
+        float angle;
+        // WeaponType of the newest change, -1 for none
+        int weapon;
+    };
+
     class ControlSystem : public ECSSystem {
-        std::set<Controller *> control;
+        // updated in the order they were added, which is the same in every run of a match
+        std::vector<Controller *> control;
+        SPSCQueue<InputCommand, 256> inputs;
+        std::vector<InputCommand> latest;
+        // shots, impulses and weapon changes of this tick in the order they came, one per request
+        std::vector<Intent> requested;
+        // last tick's, one per actor and sorted by entity
+        std::vector<Intent> intents;
+        size_t request_count = 0, dropped = 0;
+
+        void request(const Intent &intent) {
+            requested.push_back(intent);
+        }
+
+        /**
+         * Folds the requests of the tick by actor and turns each actor's into at most one event
+         * of every kind. A shot the weapon is still cooling down for, or a change to the weapon
+         * in hand, can do nothing and never reaches the EventSystem.
+         */
+        void flush() {
+            std::stable_sort(requested.begin(), requested.end(), [](const Intent &a, const Intent &b) {
+                return a.actor < b.actor;
+            });
+            intents.clear();
+            for (auto &r : requested) {
+                if (intents.empty() || intents.back().actor != r.actor)
+                    intents.push_back(Intent{r.actor, vec2(0, 0), false, 0, -1});
+                Intent &intent = intents.back();
+                intent.impulse += r.impulse;
+                if (r.shooting) {
+                    intent.shooting = true;
+                    intent.angle = r.angle;
+                }
+                if (r.weapon >= 0)
+                    intent.weapon = r.weapon;
+            }
+            request_count = requested.size();
+            requested.clear();
+
+            World *world = getWorld();
+            EventSystem *event_system = findSystem<EventSystem>();
+            WeaponSystem *weapon_system = findSystem<WeaponSystem>();
+            dropped = 0;
+            for (auto &intent : intents) {
+                if (!world->valid(intent.actor))
+                    continue;
+                if (intent.weapon >= 0) {
+                    if (world->has<Weapon>(intent.actor) &&
+                        world->get<Weapon>(intent.actor).weapon == (WeaponType) intent.weapon) {
+                        ++dropped;
+                    } else {
+                        ChangeWeapon change((WeaponType) intent.weapon);
+                        change.actor = intent.actor;
+                        event_system->enqueue(change);
+                    }
+                }
+                if (intent.shooting) {
+                    if (!weapon_system->ready(intent.actor)) {
+                        ++dropped;
+                    } else {
+                        Shooting shooting(intent.angle);
+                        shooting.actor = intent.actor;
+                        event_system->enqueue(shooting);
+                    }
+                }
+                if (intent.impulse.x != 0 || intent.impulse.y != 0) {
+                    Impulse impulse(intent.impulse.x, intent.impulse.y);
+                    impulse.actor = intent.actor;
+                    event_system->enqueue(impulse);
+                }
+            }
+        }
+
+        void apply(const InputCommand &cmd) {
+            entt::entity player = findPlayer(cmd.player_id);
+            if (player == entt::null)
+                return;
+            auto &pos = getWorld()->get<Position>(player);
+            if (cmd.shooting)
+                dispatch(player, Shooting(std::atan2(cmd.aim_y - pos.y, cmd.aim_x - pos.x)));
+            vec2 vel = Movement::impulse(cmd.move_x, cmd.move_y);
+            if (vel.x != 0 || vel.y != 0)
+                dispatch(player, Impulse(vel.x, vel.y));
+            if (cmd.weapon >= 0)
+                dispatch(player, ChangeWeapon((WeaponType) cmd.weapon));
+        }
+
     public:
+        using ECSSystem::getWorld;
+
         ControlSystem() {
 
         }
 
         void addController(Controller *c) {
-            control.insert(c);
+            control.push_back(c);
             c->init(this);
         }
 
         // this will return the ownership
         void removeController(Controller *c) {
-            control.erase(control.find(c));
+            control.erase(std::find(control.begin(), control.end(), c));
         }
 
         template<typename T>
@@ -59,10 +176,77 @@ namespace Escape {
             findSystem<EventSystem>()->enqueue(action);
         }
 
+        // Shots, impulses and weapon changes wait for the end of the tick, see flush()
+        void dispatch(entt::entity entity, const Shooting &action) {
+            request(Intent{entity, vec2(0, 0), true, action.angle, -1});
+        }
+
+        void dispatch(entt::entity entity, const Impulse &action) {
+            request(Intent{entity, vec2(action.x, action.y), false, 0, -1});
+        }
+
+        void dispatch(entt::entity entity, const ChangeWeapon &action) {
+            request(Intent{entity, vec2(0, 0), false, 0, (int) action.weapon});
+        }
+
+        // Called from the one input thread, applied on the next tick. False when the queue is full.
+        bool submit(const InputCommand &cmd) {
+            return inputs.push(cmd);
+        }
+
         void update(float delta) {
+            // the render thread sends a command every frame, several can arrive within a tick: the
+            // newest movement counts, a shot or a weapon change of any of them survives
+            latest.clear();
+            InputCommand cmd;
+            while (inputs.pop(cmd)) {
+                auto iter = std::find_if(latest.begin(), latest.end(), [&](const InputCommand &other) {
+                    return other.player_id == cmd.player_id;
+                });
+                if (iter == latest.end()) {
+                    latest.push_back(cmd);
+                    continue;
+                }
+                InputCommand folded = cmd;
+                if (!cmd.shooting && iter->shooting) {
+                    folded.shooting = true;
+                    folded.aim_x = iter->aim_x;
+                    folded.aim_y = iter->aim_y;
+                }
+                if (cmd.weapon < 0)
+                    folded.weapon = iter->weapon;
+                *iter = folded;
+            }
+            // by player, not by arrival, so every peer of a lockstep match applies them alike
+            std::sort(latest.begin(), latest.end(), [](const InputCommand &a, const InputCommand &b) {
+                return a.player_id < b.player_id;
+            });
+            for (auto &input : latest)
+                apply(input);
             for (Controller *c : control) {
                 c->update(delta);
             }
+            flush();
+        }
+
+        // Inputs applied last tick, one per player and sorted by player
+        const std::vector<InputCommand> &getApplied() const {
+            return latest;
+        }
+
+        // What last tick's requests were folded into
+        const std::vector<Intent> &getIntents() const {
+            return intents;
+        }
+
+        // Shots, impulses and weapon changes asked for last tick, before folding
+        size_t getRequestCount() const {
+            return request_count;
+        }
+
+        // Intents of last tick that could do nothing and were not sent as events
+        size_t getDropped() const {
+            return dropped;
         }
 
         virtual ~ControlSystem() {
@@ -0,0 +1,110 @@
+#if !defined(BIT_STREAM_H)
+#define BIT_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+namespace Escape {
+/**
+ * Packs values of any width from 1 to 32 bits into a caller buffer, least significant bit first.
+ * Writing past the end sets overflowed() instead of touching memory, so a packet that does not
+ * fit is detected once at the end.
+ */
+    class BitWriter {
+        uint8_t *data;
+        size_t capacity;
+        size_t bits = 0;
+        bool overflow = false;
+
+    public:
+        BitWriter(uint8_t *data, size_t capacity) : data(data), capacity(capacity) {
+            std::memset(data, 0, capacity);
+        }
+
+        void write(uint32_t value, int count) {
+            if (bits + count > capacity * 8) {
+                overflow = true;
+                return;
+            }
+            for (int i = 0; i < count; ++i, ++bits) {
+                if ((value >> i) & 1u)
+                    data[bits >> 3] |= uint8_t(1u << (bits & 7));
+            }
+        }
+
+        void writeBool(bool value) {
+            write(value ? 1 : 0, 1);
+        }
+
+        // Two's complement in count bits, the value must fit
+        void writeSigned(int32_t value, int count) {
+            write((uint32_t) value & (count == 32 ? ~0u : (1u << count) - 1), count);
+        }
+
+        void writeFloat(float value) {
+            uint32_t raw;
+            std::memcpy(&raw, &value, sizeof(raw));
+            write(raw, 32);
+        }
+
+        bool overflowed() const {
+            return overflow;
+        }
+
+        // Bytes used so far, the last one partially
+        size_t size() const {
+            return (bits + 7) / 8;
+        }
+    };
+
+    class BitReader {
+        const uint8_t *data;
+        size_t capacity;
+        size_t bits = 0;
+        bool overflow = false;
+
+    public:
+        BitReader(const uint8_t *data, size_t capacity) : data(data), capacity(capacity) {
+        }
+
+        // Zero once past the end, check overflowed() before trusting what was read
+        uint32_t read(int count) {
+            if (bits + count > capacity * 8) {
+                overflow = true;
+                bits = capacity * 8;
+                return 0;
+            }
+            uint32_t value = 0;
+            for (int i = 0; i < count; ++i, ++bits) {
+                if ((data[bits >> 3] >> (bits & 7)) & 1u)
+                    value |= 1u << i;
+            }
+            return value;
+        }
+
+        bool readBool() {
+            return read(1) != 0;
+        }
+
+        int32_t readSigned(int count) {
+            uint32_t value = read(count);
+            if (count < 32 && (value >> (count - 1)) & 1u)
+                value |= ~0u << count;
+            return (int32_t) value;
+        }
+
+        float readFloat() {
+            uint32_t raw = read(32);
+            float value;
+            std::memcpy(&value, &raw, sizeof(value));
+            return value;
+        }
+
+        bool overflowed() const {
+            return overflow;
+        }
+    };
+} // namespace Escape
+
+#endif // BIT_STREAM_H
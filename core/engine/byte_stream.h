@@ -0,0 +1,112 @@
+#if !defined(BYTE_STREAM_H)
+#define BYTE_STREAM_H
+
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+namespace Escape {
+/**
+ * Appends plain values to a growing buffer in the byte order of this machine, for files that
+ * are read back by the same build. Values are copied field by field by the callers, so
+ * padding never reaches the output.
+ */
+    class ByteWriter {
+        std::vector<uint8_t> &out;
+
+    public:
+        explicit ByteWriter(std::vector<uint8_t> &out) : out(out) {
+        }
+
+        template<typename T>
+        void write(T value) {
+            static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Write the fields one by one");
+            size_t at = out.size();
+            out.resize(at + sizeof(T));
+            std::memcpy(out.data() + at, &value, sizeof(T));
+        }
+
+        void writeBytes(const void *data, size_t size) {
+            size_t at = out.size();
+            out.resize(at + size);
+            if (size > 0)
+                std::memcpy(out.data() + at, data, size);
+        }
+
+        void writeString(const std::string &s) {
+            write((uint32_t) s.size());
+            writeBytes(s.data(), s.size());
+        }
+
+        // Bytes in the buffer, including what was there before this writer
+        size_t size() const {
+            return out.size();
+        }
+
+        // Overwrites a value written earlier at offset, for sizes known only afterwards
+        template<typename T>
+        void patch(size_t offset, T value) {
+            std::memcpy(out.data() + offset, &value, sizeof(T));
+        }
+    };
+
+    class ByteReader {
+        const uint8_t *data;
+        size_t capacity;
+        size_t position = 0;
+        bool overflow = false;
+
+    public:
+        ByteReader(const uint8_t *data, size_t capacity) : data(data), capacity(capacity) {
+        }
+
+        // Zero once past the end, check overflowed() before trusting what was read
+        template<typename T>
+        T read() {
+            T value{};
+            if (position + sizeof(T) > capacity) {
+                overflow = true;
+                position = capacity;
+                return value;
+            }
+            std::memcpy(&value, data + position, sizeof(T));
+            position += sizeof(T);
+            return value;
+        }
+
+        // Where size bytes start, nullptr past the end
+        const uint8_t *readBytes(size_t size) {
+            if (size > capacity - position) {
+                overflow = true;
+                position = capacity;
+                return nullptr;
+            }
+            const uint8_t *at = data + position;
+            position += size;
+            return at;
+        }
+
+        std::string readString() {
+            uint32_t size = read<uint32_t>();
+            const uint8_t *at = readBytes(size);
+            return at ? std::string((const char *) at, size) : std::string();
+        }
+
+        bool overflowed() const {
+            return overflow;
+        }
+
+        size_t offset() const {
+            return position;
+        }
+
+        size_t remaining() const {
+            return capacity - position;
+        }
+    };
+} // namespace Escape
+
+#endif // BYTE_STREAM_H
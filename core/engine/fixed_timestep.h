@@ -0,0 +1,49 @@
+#if !defined(FIXED_TIMESTEP_H)
+#define FIXED_TIMESTEP_H
+
+#include <cmath>
+
+namespace Escape {
+/**
+ * Turns variable real time into a whole number of fixed simulation steps.
+ * A host that cannot keep up runs at most max_steps per call and drops the rest of the
+ * backlog, so it falls behind real time instead of spiralling into ever longer frames.
+ */
+    class FixedTimestep {
+        float step;
+        int max_steps;
+        float accumulator = 0;
+
+    public:
+        FixedTimestep(float step, int max_steps = 5) : step(step), max_steps(max_steps) {
+        }
+
+        void setStep(float step_) {
+            step = step_;
+        }
+
+        float getStep() const {
+            return step;
+        }
+
+        // Adds elapsed seconds and returns how many steps should run now
+        int advance(float elapsed) {
+            accumulator += elapsed;
+            int steps = (int) (accumulator / step);
+            if (steps > max_steps) {
+                steps = max_steps;
+                accumulator = std::fmod(accumulator, step);
+            } else {
+                accumulator -= steps * step;
+            }
+            return steps;
+        }
+
+        // How far real time is into the next step, from 0 to 1
+        float alpha() const {
+            return accumulator / step;
+        }
+    };
+} // namespace Escape
+
+#endif // FIXED_TIMESTEP_H
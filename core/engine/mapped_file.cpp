@@ -0,0 +1,77 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Escape {
+    MappedFile::~MappedFile() {
+        close();
+    }
+
+#if defined(_WIN32)
+    bool MappedFile::open(const std::string &path) {
+        close();
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                                  FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+            return false;
+        LARGE_INTEGER size{};
+        if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) {
+            CloseHandle(file);
+            return false;
+        }
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+            return false;
+        void *mapped = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        // the view keeps the mapping and the file open
+        CloseHandle(mapping);
+        if (mapped == nullptr)
+            return false;
+        address = static_cast<const uint8_t *>(mapped);
+        length = (size_t) size.QuadPart;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address != nullptr)
+            UnmapViewOfFile(address);
+        address = nullptr;
+        length = 0;
+    }
+#else
+    bool MappedFile::open(const std::string &path) {
+        close();
+        int fd = ::open(path.c_str(), O_RDONLY);
+        if (fd < 0)
+            return false;
+        struct stat info{};
+        if (fstat(fd, &info) != 0 || info.st_size == 0) {
+            ::close(fd);
+            return false;
+        }
+        void *mapped = mmap(nullptr, (size_t) info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        // the mapping keeps the file open
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        address = static_cast<const uint8_t *>(mapped);
+        length = (size_t) info.st_size;
+        return true;
+    }
+
+    void MappedFile::close() {
+        if (address != nullptr)
+            munmap(const_cast<uint8_t *>(address), length);
+        address = nullptr;
+        length = 0;
+    }
+#endif
+} // namespace Escape
@@ -0,0 +1,44 @@
+#if !defined(MAPPED_FILE_H)
+#define MAPPED_FILE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Escape {
+/**
+ * A whole file mapped read only. Pages are read from disk when first touched, so opening a
+ * large file costs nothing until its parts are used.
+ */
+    class MappedFile {
+        const uint8_t *address = nullptr;
+        size_t length = 0;
+
+    public:
+        MappedFile() = default;
+
+        MappedFile(const MappedFile &) = delete;
+
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        ~MappedFile();
+
+        bool open(const std::string &path);
+
+        void close();
+
+        bool isOpen() const {
+            return address != nullptr;
+        }
+
+        const uint8_t *data() const {
+            return address;
+        }
+
+        size_t size() const {
+            return length;
+        }
+    };
+} // namespace Escape
+
+#endif // MAPPED_FILE_H
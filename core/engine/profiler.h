@@ -0,0 +1,120 @@
+#if !defined(PROFILER_H)
+#define PROFILER_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+#include <typeinfo>
+#include <algorithm>
+#include <iterator>
+#include "spsc_queue.h"
+
+#if defined(__GNUG__)
+#include <cxxabi.h>
+#include <cstdlib>
+#endif
+
+namespace Escape {
+/**
+ * Per tick timings and counters, handed from the simulation thread to a reader through a
+ * lock-free ring. Sections and counters are named up front; while disabled nothing is
+ * measured and the only cost is checking isEnabled().
+ */
+    class Profiler {
+    public:
+        static constexpr size_t MAX_SECTIONS = 32;
+        static constexpr size_t MAX_COUNTERS = 32;
+
+        struct Sample {
+            size_t tick;
+            // milliseconds
+            float total;
+            float sections[MAX_SECTIONS];
+            double counters[MAX_COUNTERS];
+        };
+
+    private:
+        typedef std::chrono::steady_clock clock_type;
+        std::atomic<bool> enabled{false};
+        std::vector<std::string> sections, counters;
+        Sample current;
+        clock_type::time_point started;
+        SPSCQueue<Sample, 256> samples;
+
+    public:
+        // Readable name of a type, without the namespace
+        static std::string nameOf(const std::type_info &type) {
+            std::string name = type.name();
+#if defined(__GNUG__)
+            int status = 0;
+            char *demangled = abi::__cxa_demangle(type.name(), nullptr, nullptr, &status);
+            if (status == 0 && demangled != nullptr)
+                name = demangled;
+            std::free(demangled);
+#endif
+            size_t colons = name.rfind("::");
+            return colons == std::string::npos ? name : name.substr(colons + 2);
+        }
+
+        // Names are only added before the writer thread starts
+        size_t addSection(std::string name) {
+            if (sections.size() < MAX_SECTIONS)
+                sections.push_back(std::move(name));
+            return sections.size() - 1;
+        }
+
+        size_t addCounter(std::string name) {
+            if (counters.size() < MAX_COUNTERS)
+                counters.push_back(std::move(name));
+            return counters.size() - 1;
+        }
+
+        const std::vector<std::string> &getSections() const {
+            return sections;
+        }
+
+        const std::vector<std::string> &getCounters() const {
+            return counters;
+        }
+
+        void setEnabled(bool enabled_) {
+            enabled.store(enabled_, std::memory_order_relaxed);
+        }
+
+        bool isEnabled() const {
+            return enabled.load(std::memory_order_relaxed);
+        }
+
+        // Writer side, one sample per tick
+        void begin(size_t tick) {
+            current.tick = tick;
+            std::fill(std::begin(current.sections), std::end(current.sections), 0.0f);
+            std::fill(std::begin(current.counters), std::end(current.counters), 0.0);
+            started = clock_type::now();
+        }
+
+        void record(size_t section, float milliseconds) {
+            if (section < MAX_SECTIONS)
+                current.sections[section] += milliseconds;
+        }
+
+        void count(size_t counter, double value) {
+            if (counter < MAX_COUNTERS)
+                current.counters[counter] = value;
+        }
+
+        void end() {
+            current.total = std::chrono::duration<float, std::milli>(clock_type::now() - started).count();
+            // a reader that stopped looking only loses samples
+            samples.push(current);
+        }
+
+        // Reader side
+        bool pop(Sample &sample) {
+            return samples.pop(sample);
+        }
+    };
+} // namespace Escape
+
+#endif // PROFILER_H
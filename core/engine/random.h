@@ -0,0 +1,67 @@
+#if !defined(RANDOM_H)
+#define RANDOM_H
+
+#include <cstdint>
+
+namespace Escape {
+/**
+ * PCG32, the same numbers on every platform and standard library, unlike the distributions of
+ * <random>. Every stream of a seed is a sequence of its own, so what one consumer draws does
+ * not depend on how much the others drew before it.
+ */
+    class RandomStream {
+        uint64_t state = 0, increment = 1;
+
+    public:
+        RandomStream(uint64_t seed = 0, uint64_t stream = 0) {
+            increment = (stream << 1u) | 1u;
+            next();
+            state += seed;
+            next();
+        }
+
+        // The exact place in the sequence, to continue it elsewhere with fromState()
+        void getState(uint64_t &state_, uint64_t &increment_) const {
+            state_ = state;
+            increment_ = increment;
+        }
+
+        static RandomStream fromState(uint64_t state_, uint64_t increment_) {
+            RandomStream stream;
+            stream.state = state_;
+            stream.increment = increment_;
+            return stream;
+        }
+
+        uint32_t next() {
+            uint64_t old = state;
+            state = old * 6364136223846793005ull + increment;
+            uint32_t shifted = (uint32_t) (((old >> 18u) ^ old) >> 27u);
+            uint32_t rotation = (uint32_t) (old >> 59u);
+            return (shifted >> rotation) | (shifted << ((-rotation) & 31u));
+        }
+
+        // [0, 1), from the 24 bits a float holds
+        float uniform() {
+            return (next() >> 8) * (1.0f / 16777216.0f);
+        }
+
+        float uniform(float l, float h) {
+            return l + (h - l) * uniform();
+        }
+
+        // [0, n) without the bias of a plain modulo
+        uint32_t below(uint32_t n) {
+            if (n == 0)
+                return 0;
+            uint32_t threshold = (0u - n) % n;
+            while (true) {
+                uint32_t r = next();
+                if (r >= threshold)
+                    return r % n;
+            }
+        }
+    };
+} // namespace Escape
+
+#endif // RANDOM_H
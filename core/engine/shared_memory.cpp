@@ -0,0 +1,96 @@
+#include "shared_memory.h"
+
+#if !defined(__ANDROID__) && !defined(_WIN32)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace Escape {
+    static std::string normalize(const std::string &name) {
+        return !name.empty() && name[0] == '/' ? name : "/" + name;
+    }
+
+    SharedMemory::~SharedMemory() {
+        close();
+    }
+
+#if defined(__ANDROID__) || defined(_WIN32)
+    // bionic has no shm_open and Windows names its mappings differently; neither runs the
+    // renderer in a process of its own
+
+    bool SharedMemory::map(int fd, size_t size) {
+        return false;
+    }
+
+    bool SharedMemory::create(const std::string &name_, size_t size) {
+        return false;
+    }
+
+    bool SharedMemory::open(const std::string &name_, size_t size) {
+        return false;
+    }
+
+    void SharedMemory::close() {
+    }
+#else
+
+    bool SharedMemory::map(int fd, size_t size) {
+        void *mapped = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        // the mapping keeps the object alive, the descriptor is not needed any more
+        ::close(fd);
+        if (mapped == MAP_FAILED)
+            return false;
+        address = mapped;
+        length = size;
+        return true;
+    }
+
+    bool SharedMemory::create(const std::string &name_, size_t size) {
+        close();
+        name = normalize(name_);
+        shm_unlink(name.c_str());
+        int fd = shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0)
+            return false;
+        // a new object reads as zeros
+        if (ftruncate(fd, (off_t) size) != 0) {
+            ::close(fd);
+            shm_unlink(name.c_str());
+            return false;
+        }
+        if (!map(fd, size)) {
+            shm_unlink(name.c_str());
+            return false;
+        }
+        owner = true;
+        return true;
+    }
+
+    bool SharedMemory::open(const std::string &name_, size_t size) {
+        close();
+        name = normalize(name_);
+        int fd = shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0)
+            return false;
+        struct stat info{};
+        // the creator may not have sized it yet
+        if (fstat(fd, &info) != 0 || (size_t) info.st_size < size) {
+            ::close(fd);
+            return false;
+        }
+        return map(fd, size);
+    }
+
+    void SharedMemory::close() {
+        if (address != nullptr)
+            munmap(address, length);
+        if (owner)
+            shm_unlink(name.c_str());
+        address = nullptr;
+        length = 0;
+        owner = false;
+    }
+#endif
+} // namespace Escape
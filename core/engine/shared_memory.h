@@ -0,0 +1,52 @@
+#if !defined(SHARED_MEMORY_H)
+#define SHARED_MEMORY_H
+
+#include <cstddef>
+#include <string>
+
+namespace Escape {
+/**
+ * A named POSIX shared memory object mapped into this process. The process that created it
+ * removes the name when it closes; processes that still have it mapped keep their mapping.
+ * Names are like "/escape", a missing leading slash is added.
+ */
+    class SharedMemory {
+        std::string name;
+        void *address = nullptr;
+        size_t length = 0;
+        bool owner = false;
+
+        bool map(int fd, size_t size);
+
+    public:
+        SharedMemory() = default;
+
+        SharedMemory(const SharedMemory &) = delete;
+
+        SharedMemory &operator=(const SharedMemory &) = delete;
+
+        ~SharedMemory();
+
+        // A new zero filled object, replacing one left behind by a process that crashed
+        bool create(const std::string &name, size_t size);
+
+        // An object another process created, false while there is none of at least size bytes
+        bool open(const std::string &name, size_t size);
+
+        void close();
+
+        bool isOpen() const {
+            return address != nullptr;
+        }
+
+        void *data() const {
+            return address;
+        }
+
+        size_t size() const {
+            return length;
+        }
+    };
+} // namespace Escape
+
+#endif // SHARED_MEMORY_H
@@ -0,0 +1,80 @@
+#if !defined(SHARED_RING_H)
+#define SHARED_RING_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <type_traits>
+
+namespace Escape {
+/**
+ * Single producer, single consumer ring that can live in shared memory, so the two sides may
+ * be different processes. Items are written and read in place: the producer claims the next
+ * free slot, fills it and commits it, the consumer peeks at the oldest one and releases it
+ * when done. Neither side ever waits; a full ring makes claim() fail.
+ * The counters are 64 bits and never wrap. Zero filled memory is an empty ring.
+ */
+    template<typename T, size_t Capacity>
+    class SharedRing {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+        static_assert(std::is_standard_layout<T>::value && std::is_trivially_destructible<T>::value,
+                      "Items are read by another process, they cannot own memory");
+        static_assert(std::atomic<uint64_t>::is_always_lock_free, "Counters must work across processes");
+
+        alignas(64) std::atomic<uint64_t> head{0};
+        alignas(64) std::atomic<uint64_t> tail{0};
+        alignas(64) T items[Capacity];
+
+    public:
+        // Producer: the slot to fill, nullptr while the consumer is Capacity items behind
+        T *claim() {
+            uint64_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == Capacity)
+                return nullptr;
+            return &items[t & (Capacity - 1)];
+        }
+
+        // Producer: hands the claimed slot to the consumer
+        void commit() {
+            tail.store(tail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool push(const T &item) {
+            T *slot = claim();
+            if (slot == nullptr)
+                return false;
+            *slot = item;
+            commit();
+            return true;
+        }
+
+        // Consumer: the oldest item, valid until release(); nullptr when empty
+        const T *peek() const {
+            uint64_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return nullptr;
+            return &items[h & (Capacity - 1)];
+        }
+
+        // Consumer: gives the peeked slot back to the producer
+        void release() {
+            head.store(head.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+        }
+
+        bool pop(T &item) {
+            const T *slot = peek();
+            if (slot == nullptr)
+                return false;
+            item = *slot;
+            release();
+            return true;
+        }
+
+        // Items committed and not released yet, from either side
+        size_t size() const {
+            return (size_t) (tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire));
+        }
+    };
+} // namespace Escape
+
+#endif // SHARED_RING_H
@@ -0,0 +1,45 @@
+#if !defined(SPSC_QUEUE_H)
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+namespace Escape {
+/**
+ * Bounded ring for exactly one producer thread and one consumer thread.
+ * Capacity must be a power of two; push fails instead of blocking when the ring is full.
+ */
+    template<typename T, size_t Capacity>
+    class SPSCQueue {
+        static_assert((Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+        T items[Capacity];
+        alignas(64) std::atomic<size_t> head{0};
+        alignas(64) std::atomic<size_t> tail{0};
+
+    public:
+        bool push(const T &item) {
+            size_t t = tail.load(std::memory_order_relaxed);
+            if (t - head.load(std::memory_order_acquire) == Capacity)
+                return false;
+            items[t & (Capacity - 1)] = item;
+            tail.store(t + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool pop(T &item) {
+            size_t h = head.load(std::memory_order_relaxed);
+            if (h == tail.load(std::memory_order_acquire))
+                return false;
+            item = std::move(items[h & (Capacity - 1)]);
+            head.store(h + 1, std::memory_order_release);
+            return true;
+        }
+
+        bool empty() const {
+            return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+        }
+    };
+} // namespace Escape
+
+#endif // SPSC_QUEUE_H
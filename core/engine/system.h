@@ -3,8 +3,10 @@
 
 #include <vector>
 #include <cassert>
+#include <chrono>
 #include <functional>
 #include "utils.h"
+#include "profiler.h"
 
 namespace Escape {
 /**
@@ -32,6 +34,21 @@ namespace Escape {
             });
         }
 
+        // Same as updateAll, timing every system into the section of its foreach order when enabled
+        void updateAll(float delta, Profiler *profiler) {
+            if (profiler == nullptr || !profiler->isEnabled()) {
+                updateAll(delta);
+                return;
+            }
+            size_t section = 0;
+            foreach([&](System *sys) {
+                auto start = std::chrono::steady_clock::now();
+                sys->update(delta);
+                profiler->record(section++, std::chrono::duration<float, std::milli>(
+                        std::chrono::steady_clock::now() - start).count());
+            });
+        }
+
         System(System *parent = nullptr) : parent(parent) {
         }
 
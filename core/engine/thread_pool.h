@@ -0,0 +1,143 @@
+#if !defined(THREAD_POOL_H)
+#define THREAD_POOL_H
+
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <functional>
+#include <condition_variable>
+
+namespace Escape {
+/**
+ * Fixed set of worker threads running one data-parallel loop at a time.
+ * The calling thread takes chunks too, so a pool of N workers uses N + 1 cores.
+ */
+    class ThreadPool {
+        std::vector<std::thread> workers;
+        std::mutex mutex;
+        std::condition_variable wake, finished;
+        // One loop. Workers hold it until they are done, so one that wakes up late takes no
+        // chunk of the next loop; fn is only called while chunks are left, before parallelFor returns.
+        struct Job {
+            const std::function<void(size_t, size_t)> *fn;
+            size_t count, grain, chunks;
+            std::atomic<size_t> next{0};
+            // under mutex
+            size_t completed = 0;
+        };
+
+        std::shared_ptr<Job> job;
+        size_t generation = 0;
+        bool busy = false;
+        bool stopping = false;
+
+        static bool &insideWorker() {
+            thread_local bool inside = false;
+            return inside;
+        }
+
+        // Returns the number of chunks of job this thread finished
+        static size_t work(Job &job) {
+            size_t done = 0;
+            for (size_t chunk = job.next++; chunk < job.chunks; chunk = job.next++) {
+                size_t begin = chunk * job.grain;
+                (*job.fn)(begin, std::min(begin + job.grain, job.count));
+                ++done;
+            }
+            return done;
+        }
+
+        void run() {
+            insideWorker() = true;
+            size_t seen = 0;
+            std::unique_lock<std::mutex> lock(mutex);
+            while (true) {
+                wake.wait(lock, [&] { return stopping || generation != seen; });
+                if (stopping)
+                    return;
+                seen = generation;
+                // the loop may be over already
+                std::shared_ptr<Job> current = job;
+                if (current == nullptr)
+                    continue;
+                lock.unlock();
+                size_t done = work(*current);
+                lock.lock();
+                current->completed += done;
+                if (done > 0 && current->completed == current->chunks)
+                    finished.notify_all();
+            }
+        }
+
+    public:
+        explicit ThreadPool(size_t threads = std::max(std::thread::hardware_concurrency(), 1u) - 1) {
+            for (size_t i = 0; i < threads; ++i)
+                workers.emplace_back([this] { run(); });
+        }
+
+        ~ThreadPool() {
+            {
+                std::lock_guard<std::mutex> lock(mutex);
+                stopping = true;
+            }
+            wake.notify_all();
+            for (auto &worker : workers)
+                worker.join();
+        }
+
+        ThreadPool(const ThreadPool &) = delete;
+
+        ThreadPool &operator=(const ThreadPool &) = delete;
+
+        size_t size() const {
+            return workers.size() + 1;
+        }
+
+        // Loops started on the calling thread run on it alone, for threads that own a core already
+        static void setInline(bool enabled) {
+            insideWorker() = enabled;
+        }
+
+        // Calls fn(begin, end) over [0, count) in chunks of grain and waits for all of them.
+        // Nested calls, or calls while another loop is running, are executed inline.
+        void parallelFor(size_t count_, size_t grain_, const std::function<void(size_t, size_t)> &fn) {
+            if (count_ == 0)
+                return;
+            grain_ = std::max<size_t>(grain_, 1);
+            {
+                std::unique_lock<std::mutex> lock(mutex);
+                if (busy || insideWorker() || workers.empty() || count_ <= grain_) {
+                    lock.unlock();
+                    fn(0, count_);
+                    return;
+                }
+                busy = true;
+                job = std::make_shared<Job>();
+                job->fn = &fn;
+                job->count = count_;
+                job->grain = grain_;
+                job->chunks = (count_ + grain_ - 1) / grain_;
+                ++generation;
+            }
+            wake.notify_all();
+            std::shared_ptr<Job> current = job;
+            size_t done = work(*current);
+            std::unique_lock<std::mutex> lock(mutex);
+            current->completed += done;
+            finished.wait(lock, [&] { return current->completed == current->chunks; });
+            job = nullptr;
+            busy = false;
+        }
+
+        // Pool shared by the systems of every world in the process
+        static ThreadPool &shared() {
+            static ThreadPool pool;
+            return pool;
+        }
+    };
+} // namespace Escape
+
+#endif // THREAD_POOL_H
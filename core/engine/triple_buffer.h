@@ -0,0 +1,45 @@
+#if !defined(TRIPLE_BUFFER_H)
+#define TRIPLE_BUFFER_H
+
+#include <atomic>
+
+namespace Escape {
+/**
+ * Hands the latest value from one writer thread to one reader thread without locks.
+ * The writer fills back() and publishes it, the reader picks up the newest published
+ * value with update() and keeps reading front() until the next one. Neither side ever
+ * waits, a value the reader did not pick up in time is simply overwritten.
+ */
+    template<typename T>
+    class TripleBuffer {
+        static constexpr int FRESH = 4;
+
+        T slots[3];
+        int back_index = 0, front_index = 1;
+        // index of the slot in between, with FRESH set when the writer published it
+        std::atomic<int> middle{2};
+
+    public:
+        T &back() {
+            return slots[back_index];
+        }
+
+        void publish() {
+            back_index = middle.exchange(back_index | FRESH, std::memory_order_acq_rel) & ~FRESH;
+        }
+
+        // Returns whether a newer value became the front
+        bool update() {
+            if (!(middle.load(std::memory_order_relaxed) & FRESH))
+                return false;
+            front_index = middle.exchange(front_index, std::memory_order_acq_rel) & ~FRESH;
+            return true;
+        }
+
+        const T &front() const {
+            return slots[front_index];
+        }
+    };
+} // namespace Escape
+
+#endif // TRIPLE_BUFFER_H
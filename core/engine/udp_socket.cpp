@@ -0,0 +1,145 @@
+#include "udp_socket.h"
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+
+#if !defined(_WIN32)
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace Escape {
+    bool NetAddress::parse(const std::string &text, NetAddress &out) {
+        auto colon = text.rfind(':');
+        if (colon == std::string::npos)
+            return false;
+        std::string host = text.substr(0, colon);
+        if (host == "localhost")
+            host = "127.0.0.1";
+        // dotted quads only, no name lookups
+        unsigned a, b, c, d;
+        char rest;
+        if (std::sscanf(host.c_str(), "%u.%u.%u.%u%c", &a, &b, &c, &d, &rest) != 4 || a > 255 || b > 255 ||
+            c > 255 || d > 255)
+            return false;
+        int port = std::atoi(text.c_str() + colon + 1);
+        if (port <= 0 || port > 65535)
+            return false;
+        out.host = (a << 24) | (b << 16) | (c << 8) | d;
+        out.port = (uint16_t) port;
+        return true;
+    }
+
+    std::string NetAddress::toString() const {
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%u.%u.%u.%u:%u", host >> 24, (host >> 16) & 255, (host >> 8) & 255,
+                      host & 255, port);
+        return buffer;
+    }
+
+    UdpSocket::~UdpSocket() {
+        close();
+    }
+
+#if defined(_WIN32)
+    // no Winsock here, the networked modes are for the Ogre client and the server on POSIX hosts
+
+    bool UdpSocket::open(uint16_t port) {
+        return false;
+    }
+
+    void UdpSocket::close() {
+        fd = -1;
+    }
+
+    bool UdpSocket::send(const NetAddress &to, const uint8_t *data, size_t size) {
+        return false;
+    }
+
+    size_t UdpSocket::receive(NetAddress &from, uint8_t *data, size_t capacity) {
+        return 0;
+    }
+#else
+
+    bool UdpSocket::open(uint16_t port) {
+        close();
+        fd = ::socket(AF_INET, SOCK_DGRAM, 0);
+        if (fd < 0)
+            return false;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_ANY);
+        addr.sin_port = htons(port);
+        if (bind(fd, (sockaddr *) &addr, sizeof(addr)) != 0 || fcntl(fd, F_SETFL, O_NONBLOCK) != 0) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void UdpSocket::close() {
+        if (fd >= 0)
+            ::close(fd);
+        fd = -1;
+    }
+
+    bool UdpSocket::send(const NetAddress &to, const uint8_t *data, size_t size) {
+        if (fd < 0 || size > MAX_PACKET)
+            return false;
+        sockaddr_in addr{};
+        addr.sin_family = AF_INET;
+        addr.sin_addr.s_addr = htonl(to.host);
+        addr.sin_port = htons(to.port);
+        return sendto(fd, data, size, 0, (sockaddr *) &addr, sizeof(addr)) == (ssize_t) size;
+    }
+
+    size_t UdpSocket::receive(NetAddress &from, uint8_t *data, size_t capacity) {
+        if (fd < 0)
+            return 0;
+        sockaddr_in addr{};
+        socklen_t length = sizeof(addr);
+        ssize_t size = recvfrom(fd, data, capacity, 0, (sockaddr *) &addr, &length);
+        if (size <= 0)
+            return 0;
+        from.host = ntohl(addr.sin_addr.s_addr);
+        from.port = ntohs(addr.sin_port);
+        return (size_t) size;
+    }
+#endif
+
+    bool LossyLink::send(const NetAddress &to, const uint8_t *data, size_t size) {
+        if (size > UdpSocket::MAX_PACKET)
+            return false;
+        if (loss > 0 && std::uniform_real_distribution<float>(0, 1)(random) < loss) {
+            ++dropped;
+            // the sender cannot tell either
+            return true;
+        }
+        if (latency <= 0 && jitter <= 0)
+            return socket.send(to, data, size);
+        float delay = latency + (jitter > 0 ? std::uniform_real_distribution<float>(0, jitter)(random) : 0);
+        pending.emplace_back();
+        Pending &packet = pending.back();
+        packet.due = clock_type::now() + std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<float>(delay));
+        packet.to = to;
+        packet.size = size;
+        std::memcpy(packet.data, data, size);
+        return true;
+    }
+
+    void LossyLink::flush() {
+        auto now = clock_type::now();
+        // jitter reorders packets, like it would on the way
+        auto due = std::stable_partition(pending.begin(), pending.end(), [&](const Pending &packet) {
+            return packet.due <= now;
+        });
+        for (auto iter = pending.begin(); iter != due; ++iter)
+            socket.send(iter->to, iter->data, iter->size);
+        pending.erase(pending.begin(), due);
+    }
+} // namespace Escape
@@ -0,0 +1,102 @@
+#if !defined(UDP_SOCKET_H)
+#define UDP_SOCKET_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace Escape {
+    // IPv4 address and port, in host byte order
+    struct NetAddress {
+        uint32_t host = 0;
+        uint16_t port = 0;
+
+        // "127.0.0.1:7777"
+        static bool parse(const std::string &text, NetAddress &out);
+
+        std::string toString() const;
+
+        bool operator==(const NetAddress &other) const {
+            return host == other.host && port == other.port;
+        }
+    };
+
+/**
+ * Non-blocking datagram socket. Packets larger than MAX_PACKET are never sent, so they are
+ * never fragmented on the usual links.
+ */
+    class UdpSocket {
+        int fd = -1;
+
+    public:
+        static constexpr size_t MAX_PACKET = 1200;
+
+        UdpSocket() = default;
+
+        UdpSocket(const UdpSocket &) = delete;
+
+        UdpSocket &operator=(const UdpSocket &) = delete;
+
+        ~UdpSocket();
+
+        // Binds to port on every interface, 0 for any free port
+        bool open(uint16_t port = 0);
+
+        void close();
+
+        bool isOpen() const {
+            return fd >= 0;
+        }
+
+        bool send(const NetAddress &to, const uint8_t *data, size_t size);
+
+        // Size of the packet copied into data, 0 when nothing is waiting
+        size_t receive(NetAddress &from, uint8_t *data, size_t capacity);
+    };
+
+/**
+ * Outgoing side of a socket that drops and delays packets like a bad network would, so the
+ * protocol can be exercised over localhost. With nothing configured it sends right away.
+ */
+    class LossyLink {
+        typedef std::chrono::steady_clock clock_type;
+
+        struct Pending {
+            clock_type::time_point due;
+            NetAddress to;
+            size_t size;
+            uint8_t data[UdpSocket::MAX_PACKET];
+        };
+
+        UdpSocket &socket;
+        float loss = 0, latency = 0, jitter = 0;
+        std::mt19937 random{12345};
+        std::vector<Pending> pending;
+        size_t dropped = 0;
+
+    public:
+        explicit LossyLink(UdpSocket &socket) : socket(socket) {
+        }
+
+        // Fraction of packets lost, and seconds every packet waits, plus up to jitter more
+        void configure(float loss_, float latency_, float jitter_ = 0) {
+            loss = loss_;
+            latency = latency_;
+            jitter = jitter_;
+        }
+
+        bool send(const NetAddress &to, const uint8_t *data, size_t size);
+
+        // Sends the delayed packets that are due
+        void flush();
+
+        size_t getDropped() const {
+            return dropped;
+        }
+    };
+} // namespace Escape
+
+#endif // UDP_SOCKET_H
@@ -0,0 +1,118 @@
+#include "environment.h"
+#include <chrono>
+#include "map_converter.h"
+#include "render.h"
+#include "lua_ai.h"
+
+namespace Escape {
+    Environment::Environment(const std::string &folder, int player_id, size_t max_ticks) : folder(folder),
+                                                                                           player_id(player_id),
+                                                                                           max_ticks(max_ticks) {
+        reset();
+    }
+
+    void Environment::reset() {
+        if (logic != nullptr) {
+            removeSubSystem(logic);
+            delete logic;
+        }
+        MapConverter mapConverter;
+        logic = new Logic(mapConverter.convert(folder));
+        logic->addSubSystem(new RenderSystem());
+        logic->addSubSystem(new ObservationSystem());
+        addSubSystem(logic);
+        configure();
+        timeserver = findSystem<TimeServer>();
+        ai_system = findSystem<AISystem>();
+        control_system = findSystem<ControlSystem>();
+        observation_system = findSystem<ObservationSystem>();
+        // ticks run as fast as they are asked for
+        timeserver->setPacing(false);
+        foreach([](System *sys) {
+            sys->initialize();
+        });
+        // the render grid is only filled by a tick, observations need it from the start
+        findSystem<RenderSystem>()->rebuild();
+
+        player = control_system->findPlayer(player_id);
+        group = player != entt::null ? getWorld()->get<AgentData>(player).group : -1;
+        ticks = 0;
+        measure(own_health, enemy_health);
+    }
+
+    void Environment::update(float delta) {
+        for (entt::entity ent = ai_system->allocate(); ent != entt::null; ent = ai_system->allocate()) {
+            auto data = getWorld()->get<AgentData>(ent);
+            auto ai_path = folder + "/" + data.ai + ".lua";
+            ai_system->insert(ent, new Agent_Lua(std::move(ai_path)));
+        }
+    }
+
+    void Environment::measure(float &own, float &enemies) {
+        own = enemies = 0;
+        getWorld()->view<AgentData, Health>().each([&](auto ent, auto &agt, auto &health) {
+            float fraction = health.health / health.max_health;
+            if (agt.player == player_id)
+                own = fraction;
+            else if (agt.group != group)
+                enemies += fraction;
+        });
+    }
+
+    bool Environment::step(const InputCommand &action, float &reward) {
+        InputCommand cmd = action;
+        cmd.player_id = player_id;
+        control_system->submit(cmd);
+        updateAll(timeserver->getDelta());
+        ++ticks;
+
+        float own, enemies;
+        measure(own, enemies);
+        reward = (enemy_health - enemies) - (own_health - own);
+        own_health = own;
+        enemy_health = enemies;
+        return !getWorld()->valid(player) || enemies <= 0 || ticks >= max_ticks;
+    }
+
+    void Environment::observe(const ObservationSpec &spec, float *out) {
+        observation_system->observe(&player, 1, spec, out);
+    }
+
+    VectorEnvironment::VectorEnvironment(const std::string &folder, size_t count, const ObservationSpec &spec,
+                                         size_t threads, int player_id, size_t max_ticks) : spec(spec),
+                                                                                            pool(threads) {
+        environments.resize(count);
+        pool.parallelFor(count, 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i)
+                environments[i] = std::make_unique<Environment>(folder, player_id, max_ticks);
+        });
+    }
+
+    void VectorEnvironment::resetAll(float *observations) {
+        const size_t stride = observationSize();
+        pool.parallelFor(environments.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                environments[i]->reset();
+                environments[i]->observe(spec, observations + stride * i);
+            }
+        });
+    }
+
+    void VectorEnvironment::stepAll(const InputCommand *actions, float *observations, float *rewards,
+                                    uint8_t *dones) {
+        auto start = std::chrono::steady_clock::now();
+        const size_t stride = observationSize();
+        pool.parallelFor(environments.size(), 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                Environment &env = *environments[i];
+                bool done = env.step(actions[i], rewards[i]);
+                dones[i] = done;
+                if (done)
+                    env.reset();
+                env.observe(spec, observations + stride * i);
+            }
+        });
+        steps += environments.size();
+        seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,98 @@
+#ifndef ESCAPE_ENVIRONMENT_H
+#define ESCAPE_ENVIRONMENT_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <cstdint>
+#include "MyECS.h"
+#include "logic.h"
+#include "control.h"
+#include "ai_system.h"
+#include "timeserver.h"
+#include "observation.h"
+#include "engine/thread_pool.h"
+
+namespace Escape {
+    /**
+     * One match driven by a learner instead of a window: the learner plays player_id, every
+     * other agent gets its Lua AI. Ticks only run when step() is called. The reward is the
+     * health the enemies lost minus the health the player lost, in fractions of the maximum.
+     */
+    class Environment : public ECSSystem {
+        std::string folder;
+        int player_id;
+        size_t max_ticks;
+        Logic *logic = nullptr;
+        TimeServer *timeserver;
+        AISystem *ai_system;
+        ControlSystem *control_system;
+        ObservationSystem *observation_system;
+        // the learner's agent, looked up once per episode
+        entt::entity player = entt::null;
+        int group = -1;
+        size_t ticks = 0;
+        float own_health = 0, enemy_health = 0;
+
+        // Health of the player and the sum over its enemies, as fractions
+        void measure(float &own, float &enemies);
+
+    public:
+        using ECSSystem::getWorld;
+
+        Environment(const std::string &folder, int player_id = 1, size_t max_ticks = 60 * 60);
+
+        // Loads the map again and starts a new episode
+        void reset();
+
+        // Gives Lua AIs to new agents, before the rest of the tick
+        void update(float delta) override;
+
+        // Applies the action for one tick and runs it. Returns whether the episode is over.
+        bool step(const InputCommand &action, float &reward);
+
+        void observe(const ObservationSpec &spec, float *out);
+    };
+
+    /**
+     * count Environments on the same map stepped together over a thread pool. Results go
+     * straight into buffers of the caller, one slot per environment; a finished environment
+     * is reset right away and its slot shows the first observation of the next episode.
+     */
+    class VectorEnvironment {
+        std::vector<std::unique_ptr<Environment>> environments;
+        ObservationSpec spec;
+        ThreadPool pool;
+        size_t steps = 0;
+        double seconds = 0;
+
+    public:
+        VectorEnvironment(const std::string &folder, size_t count, const ObservationSpec &spec, size_t threads,
+                          int player_id = 1, size_t max_ticks = 60 * 60);
+
+        size_t size() const {
+            return environments.size();
+        }
+
+        size_t observationSize() const {
+            return ObservationSystem::observationSize(spec);
+        }
+
+        Environment &get(size_t index) {
+            return *environments[index];
+        }
+
+        // Resets every environment, observations holds size() * observationSize() values
+        void resetAll(float *observations);
+
+        // actions holds size() commands, rewards and dones size() values each
+        void stepAll(const InputCommand *actions, float *observations, float *rewards, uint8_t *dones);
+
+        // Environment steps per second of wall time spent in stepAll since the start
+        double getStepsPerSecond() const {
+            return seconds > 0 ? steps / seconds : 0;
+        }
+    };
+}
+
+#endif //ESCAPE_ENVIRONMENT_H
@@ -48,6 +48,8 @@ namespace Escape {
 
         entt::dispatcher dispatcher{};
         std::vector<VirtualBase *> wrappers;
+        // events enqueued since the last update, and how many the last update delivered
+        size_t queued = 0, delivered = 0;
     public:
         EventSystem() {
 
@@ -65,9 +67,15 @@ namespace Escape {
 
 
         void update(float delta) override {
+            delivered = queued;
+            queued = 0;
             dispatcher.update();
         }
 
+        size_t getQueueDepth() const {
+            return delivered;
+        }
+
 
         template<class Ret, class Arg1, class ...Args>
         static constexpr auto curry(Ret f(Arg1, Args...), Arg1 arg)
@@ -100,6 +108,7 @@ namespace Escape {
 
         template<typename T>
         void enqueue(T event) {
+            ++queued;
             dispatcher.enqueue(event);
         }
 
@@ -0,0 +1,146 @@
+#include "flow_field.h"
+#include "terrain.h"
+
+namespace Escape {
+    // Orthogonal moves first, so they win ties against diagonal ones.
+    // Opposite directions are paired up, d ^ 1 reverses d.
+    static const int DIRECTIONS[8][2] = {{1,  0},
+                                         {-1, 0},
+                                         {0,  1},
+                                         {0,  -1},
+                                         {1,  1},
+                                         {-1, -1},
+                                         {1,  -1},
+                                         {-1, 1}};
+
+    static vec2 normalized(vec2 v) {
+        float len = std::sqrt(v.x * v.x + v.y * v.y);
+        if (len < 1e-6f)
+            return vec2(0, 0);
+        return v / len;
+    }
+
+    void FlowField::build(const TileMap &map, int target_i, int target_j) {
+        width = map.width;
+        height = map.height;
+        target = map.index(target_i, target_j);
+        cost.assign(width * height, UNREACHABLE);
+        next.assign(width * height, -1);
+        buckets.resize(4);
+        for (auto &bucket : buckets)
+            bucket.clear();
+
+        cost[target] = 0;
+        buckets[0].push_back(target);
+        size_t pending = 1;
+        for (unsigned int current = 0; pending > 0; ++current) {
+            auto &bucket = buckets[current % buckets.size()];
+            for (size_t k = 0; k < bucket.size(); ++k) {
+                int idx = bucket[k];
+                if (cost[idx] != current)
+                    continue;
+                int i = idx % width, j = idx / width;
+                for (int d = 0; d < 8; ++d) {
+                    int ni = i + DIRECTIONS[d][0], nj = j + DIRECTIONS[d][1];
+                    if (map.isWall(ni, nj))
+                        continue;
+                    bool diagonal = d >= 4;
+                    if (diagonal && (map.isWall(ni, j) || map.isWall(i, nj)))
+                        continue;
+                    unsigned int c = current + (diagonal ? 3 : 2);
+                    int nidx = map.index(ni, nj);
+                    if (c < cost[nidx]) {
+                        cost[nidx] = c;
+                        // the neighbour walks back along the opposite direction
+                        next[nidx] = (signed char) (d ^ 1);
+                        buckets[c % buckets.size()].push_back(nidx);
+                        ++pending;
+                    }
+                }
+            }
+            pending -= bucket.size();
+            bucket.clear();
+        }
+    }
+
+    unsigned int FlowField::getCost(const TileMap &map, int i, int j) const {
+        if (!map.inside(i, j) || map.width != width || map.height != height)
+            return UNREACHABLE;
+        return cost[map.index(i, j)];
+    }
+
+    bool FlowField::step(const TileMap &map, int i, int j, int &next_i, int &next_j) const {
+        if (getCost(map, i, j) == UNREACHABLE)
+            return false;
+        signed char d = next[map.index(i, j)];
+        if (d < 0)
+            return false;
+        next_i = i + DIRECTIONS[d][0];
+        next_j = j + DIRECTIONS[d][1];
+        return true;
+    }
+
+    void FlowFieldSystem::rebuild(Entry &entry, const TileMap &map, const Position &pos) {
+        int i, j;
+        map.toCell(pos.x, pos.y, i, j);
+        if (!map.inside(i, j))
+            return;
+        if (entry.field.getTarget() != map.index(i, j) || entry.revision != map.revision) {
+            entry.field.build(map, i, j);
+            entry.revision = map.revision;
+        }
+    }
+
+    FlowFieldSystem::Entry *FlowFieldSystem::acquire(entt::entity target) {
+        if (!getWorld()->valid(target) || !getWorld()->has<Position>(target))
+            return nullptr;
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        if (map == nullptr)
+            return nullptr;
+        auto iter = fields.find(target);
+        if (iter == fields.end()) {
+            iter = fields.emplace(target, Entry{.revision = map->revision}).first;
+            rebuild(iter->second, *map, getWorld()->get<Position>(target));
+        }
+        iter->second.last_query = tick;
+        return &iter->second;
+    }
+
+    void FlowFieldSystem::update(float delta) {
+        ++tick;
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        auto iter = fields.begin();
+        while (iter != fields.end()) {
+            if (map == nullptr || !getWorld()->valid(iter->first) || !getWorld()->has<Position>(iter->first) ||
+                tick - iter->second.last_query > IDLE_TICKS) {
+                fields.erase(iter++);
+            } else {
+                rebuild(iter->second, *map, getWorld()->get<Position>(iter->first));
+                ++iter;
+            }
+        }
+    }
+
+    const FlowField *FlowFieldSystem::getField(entt::entity target) {
+        Entry *entry = acquire(target);
+        return entry ? &entry->field : nullptr;
+    }
+
+    vec2 FlowFieldSystem::direction(entt::entity target, const vec2 &pos) {
+        Entry *entry = acquire(target);
+        if (entry == nullptr)
+            return vec2(0, 0);
+        const TileMap &map = *TerrainSystem::getTileMap(getWorld());
+        int i, j;
+        map.toCell(pos.x, pos.y, i, j);
+        if (map.inside(i, j) && map.index(i, j) == entry->field.getTarget()) {
+            const Position &goal = getWorld()->get<Position>(target);
+            return normalized(vec2(goal.x - pos.x, goal.y - pos.y));
+        }
+        int ni, nj;
+        if (!entry->field.step(map, i, j, ni, nj))
+            return vec2(0, 0);
+        vec2 center = map.cellCenter(ni, nj);
+        return normalized(vec2(center.x - pos.x, center.y - pos.y));
+    }
+}
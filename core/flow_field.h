@@ -0,0 +1,69 @@
+#ifndef ESCAPE_FLOW_FIELD_H
+#define ESCAPE_FLOW_FIELD_H
+
+#include <map>
+#include <vector>
+#include "MyECS.h"
+#include "components.h"
+
+namespace Escape {
+    /**
+     * Integration field over a TileMap toward one target cell. Every reachable cell
+     * stores which neighbour leads to the target, so any number of agents can follow
+     * the same field with a constant time lookup.
+     */
+    class FlowField {
+        int width = 0, height = 0;
+        int target = -1;
+        std::vector<unsigned int> cost;
+        std::vector<signed char> next;
+        std::vector<std::vector<int>> buckets;
+
+    public:
+        static constexpr unsigned int UNREACHABLE = ~0u;
+
+        // One pass of Dial's algorithm, orthogonal steps cost 2 and diagonal ones 3
+        void build(const TileMap &map, int target_i, int target_j);
+
+        int getTarget() const {
+            return target;
+        }
+
+        unsigned int getCost(const TileMap &map, int i, int j) const;
+
+        // The neighbour of (i, j) one step closer to the target
+        bool step(const TileMap &map, int i, int j, int &next_i, int &next_j) const;
+    };
+
+    class FlowFieldSystem : public ECSSystem {
+        struct Entry {
+            FlowField field;
+            size_t revision;
+            size_t last_query;
+        };
+        // fields nobody asked for during this many ticks are dropped
+        static constexpr size_t IDLE_TICKS = 120;
+
+        std::map<entt::entity, Entry> fields;
+        size_t tick = 0;
+
+        Entry *acquire(entt::entity target);
+
+        void rebuild(Entry &entry, const TileMap &map, const Position &pos);
+
+    public:
+        void update(float delta) override;
+
+        // Drops every field, they are built again when asked for
+        void clear() {
+            fields.clear();
+        }
+
+        const FlowField *getField(entt::entity target);
+
+        // Unit vector from pos toward target following the field, zero if there is no way
+        vec2 direction(entt::entity target, const vec2 &pos);
+    };
+}
+
+#endif //ESCAPE_FLOW_FIELD_H
@@ -0,0 +1,374 @@
+#include "hpa_star.h"
+#include <queue>
+#include <chrono>
+#include <algorithm>
+
+namespace Escape {
+    // Same move set and costs as the flow field: orthogonal 2, diagonal 3, no corner cutting
+    static const int DIRECTIONS[8][2] = {{1,  0},
+                                         {-1, 0},
+                                         {0,  1},
+                                         {0,  -1},
+                                         {1,  1},
+                                         {-1, -1},
+                                         {1,  -1},
+                                         {-1, 1}};
+    static constexpr unsigned int INF = ~0u;
+
+    static unsigned int octile(const TileMap &map, int a, int b) {
+        int dx = std::abs(a % map.width - b % map.width), dy = std::abs(a / map.width - b / map.width);
+        return 2 * std::max(dx, dy) + std::min(dx, dy);
+    }
+
+    using Queue = std::priority_queue<std::pair<unsigned int, int>, std::vector<std::pair<unsigned int, int>>,
+            std::greater<std::pair<unsigned int, int>>>;
+
+    ClusterGraph ClusterGraph::build(const TileMap &map, int cluster_size) {
+        ClusterGraph graph;
+        graph.cluster_size = cluster_size;
+        graph.clusters_x = (map.width + cluster_size - 1) / cluster_size;
+        graph.clusters_y = (map.height + cluster_size - 1) / cluster_size;
+        graph.revision = map.revision;
+        graph.cluster_nodes.resize(graph.clusters_x * graph.clusters_y);
+
+        std::unordered_map<int, int> node_of_cell;
+        auto node = [&](int cell) {
+            auto iter = node_of_cell.find(cell);
+            if (iter != node_of_cell.end())
+                return iter->second;
+            int id = (int) graph.nodes.size();
+            graph.nodes.push_back(Node{.cell = cell, .cluster = graph.clusterOf(map, cell)});
+            graph.cluster_nodes[graph.nodes.back().cluster].push_back(id);
+            node_of_cell[cell] = id;
+            return id;
+        };
+        auto connect = [&](int a, int b) {
+            int na = node(a), nb = node(b);
+            graph.nodes[na].edges.push_back(Edge{nb, 2});
+            graph.nodes[nb].edges.push_back(Edge{na, 2});
+        };
+        // Cells a(k) and b(k) face each other across a cluster border for k in [begin, end)
+        auto entrances = [&](int begin, int end, auto a, auto b) {
+            int run = begin;
+            for (int k = begin; k <= end; ++k) {
+                bool open = k < end && map.walls[a(k)] == 0 && map.walls[b(k)] == 0;
+                if (open)
+                    continue;
+                int length = k - run;
+                if (length > 0 && length < 6) {
+                    int mid = run + length / 2;
+                    connect(a(mid), b(mid));
+                } else if (length >= 6) {
+                    connect(a(run), b(run));
+                    connect(a(k - 1), b(k - 1));
+                }
+                run = k + 1;
+            }
+        };
+
+        for (int cy = 0; cy < graph.clusters_y; ++cy) {
+            for (int cx = 0; cx < graph.clusters_x; ++cx) {
+                int x0 = cx * cluster_size, y0 = cy * cluster_size;
+                int x1 = std::min(x0 + cluster_size, map.width), y1 = std::min(y0 + cluster_size, map.height);
+                if (x1 < map.width) {
+                    entrances(y0, y1,
+                              [&](int y) { return map.index(x1 - 1, y); },
+                              [&](int y) { return map.index(x1, y); });
+                }
+                if (y1 < map.height) {
+                    entrances(x0, x1,
+                              [&](int x) { return map.index(x, y1 - 1); },
+                              [&](int x) { return map.index(x, y1); });
+                }
+            }
+        }
+
+        HierarchicalPlanner planner;
+        std::vector<int> targets;
+        std::vector<unsigned int> costs;
+        for (int cluster = 0; cluster < (int) graph.cluster_nodes.size(); ++cluster) {
+            auto &members = graph.cluster_nodes[cluster];
+            targets.clear();
+            for (int id : members)
+                targets.push_back(graph.nodes[id].cell);
+            auto rect = planner.clusterRect(map, graph, cluster);
+            for (size_t a = 0; a < members.size(); ++a) {
+                planner.distances(map, graph.nodes[members[a]].cell, rect, targets, costs);
+                for (size_t b = 0; b < members.size(); ++b) {
+                    if (a != b && costs[b] != INF)
+                        graph.nodes[members[a]].edges.push_back(Edge{members[b], costs[b]});
+                }
+            }
+        }
+        return graph;
+    }
+
+    void HierarchicalPlanner::prepare(size_t cells) {
+        if (stamp.size() != cells) {
+            g.assign(cells, INF);
+            parent.assign(cells, -1);
+            stamp.assign(cells, 0);
+            generation = 0;
+        }
+        if (++generation == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+    }
+
+    HierarchicalPlanner::Rect
+    HierarchicalPlanner::clusterRect(const TileMap &map, const ClusterGraph &graph, int cluster) const {
+        int x0 = (cluster % graph.clusters_x) * graph.cluster_size;
+        int y0 = (cluster / graph.clusters_x) * graph.cluster_size;
+        return Rect{x0, y0, std::min(x0 + graph.cluster_size, map.width) - 1,
+                    std::min(y0 + graph.cluster_size, map.height) - 1};
+    }
+
+    // Relaxes every neighbour of cell inside rect, calls visit(neighbour, cost)
+    template<typename Fn>
+    static void expand(const TileMap &map, int cell, int x0, int y0, int x1, int y1, Fn visit) {
+        int i = cell % map.width, j = cell / map.width;
+        for (int d = 0; d < 8; ++d) {
+            int ni = i + DIRECTIONS[d][0], nj = j + DIRECTIONS[d][1];
+            if (ni < x0 || nj < y0 || ni > x1 || nj > y1 || map.isWall(ni, nj))
+                continue;
+            bool diagonal = d >= 4;
+            if (diagonal && (map.isWall(ni, j) || map.isWall(i, nj)))
+                continue;
+            visit(map.index(ni, nj), diagonal ? 3u : 2u);
+        }
+    }
+
+    bool HierarchicalPlanner::search(const TileMap &map, int from, int to, const Rect &rect, std::vector<int> &path) {
+        prepare(map.tiles.size());
+        Queue open;
+        stamp[from] = generation;
+        g[from] = 0;
+        parent[from] = -1;
+        open.emplace(octile(map, from, to), from);
+        while (!open.empty()) {
+            auto[f, cell] = open.top();
+            open.pop();
+            if (cell == to)
+                break;
+            if (f != g[cell] + octile(map, cell, to))
+                continue;
+            expand(map, cell, rect.x0, rect.y0, rect.x1, rect.y1, [&](int next, unsigned int w) {
+                unsigned int cost = g[cell] + w;
+                if (stamp[next] != generation || cost < g[next]) {
+                    stamp[next] = generation;
+                    g[next] = cost;
+                    parent[next] = cell;
+                    open.emplace(cost + octile(map, next, to), next);
+                }
+            });
+        }
+        if (stamp[to] != generation)
+            return false;
+        size_t begin = path.size();
+        for (int cell = to; cell != from; cell = parent[cell])
+            path.push_back(cell);
+        std::reverse(path.begin() + begin, path.end());
+        return true;
+    }
+
+    void HierarchicalPlanner::distances(const TileMap &map, int from, const Rect &rect, const std::vector<int> &targets,
+                                        std::vector<unsigned int> &out) {
+        prepare(map.tiles.size());
+        Queue open;
+        stamp[from] = generation;
+        g[from] = 0;
+        open.emplace(0, from);
+        while (!open.empty()) {
+            auto[cost, cell] = open.top();
+            open.pop();
+            if (cost != g[cell])
+                continue;
+            expand(map, cell, rect.x0, rect.y0, rect.x1, rect.y1, [&](int next, unsigned int w) {
+                if (stamp[next] != generation || cost + w < g[next]) {
+                    stamp[next] = generation;
+                    g[next] = cost + w;
+                    open.emplace(cost + w, next);
+                }
+            });
+        }
+        out.resize(targets.size());
+        for (size_t k = 0; k < targets.size(); ++k)
+            out[k] = stamp[targets[k]] == generation ? g[targets[k]] : INF;
+    }
+
+    bool HierarchicalPlanner::lineOfSight(const TileMap &map, int from, int to) {
+        int i = from % map.width, j = from / map.width;
+        int di = to % map.width - i, dj = to / map.width - j;
+        int nx = std::abs(di), ny = std::abs(dj);
+        int sx = di > 0 ? 1 : -1, sy = dj > 0 ? 1 : -1;
+        for (int ix = 0, iy = 0; ix < nx || iy < ny;) {
+            long decision = (1 + 2L * ix) * ny - (1 + 2L * iy) * nx;
+            if (decision == 0) {
+                // passing exactly through a corner, both side cells must be open
+                if (map.isWall(i + sx, j) || map.isWall(i, j + sy))
+                    return false;
+                i += sx;
+                j += sy;
+                ++ix;
+                ++iy;
+            } else if (decision < 0) {
+                i += sx;
+                ++ix;
+            } else {
+                j += sy;
+                ++iy;
+            }
+            if (map.isWall(i, j))
+                return false;
+        }
+        return true;
+    }
+
+    void HierarchicalPlanner::smooth(const TileMap &map, const std::vector<int> &cells, const vec2 &goal,
+                                     std::vector<vec2> &out) const {
+        size_t anchor = 0;
+        for (size_t k = 2; k < cells.size(); ++k) {
+            if (!lineOfSight(map, cells[anchor], cells[k])) {
+                anchor = k - 1;
+                out.push_back(map.cellCenter(cells[anchor] % map.width, cells[anchor] / map.width));
+            }
+        }
+        out.push_back(goal);
+    }
+
+    bool HierarchicalPlanner::plan(const TileMap &map, const ClusterGraph &graph, const vec2 &from, const vec2 &to,
+                                   std::vector<vec2> &waypoints) {
+        int si, sj, gi, gj;
+        map.toCell(from.x, from.y, si, sj);
+        map.toCell(to.x, to.y, gi, gj);
+        if (map.isWall(si, sj) || map.isWall(gi, gj))
+            return false;
+        int start = map.index(si, sj), goal = map.index(gi, gj);
+        int start_cluster = graph.clusterOf(map, start), goal_cluster = graph.clusterOf(map, goal);
+
+        std::vector<int> cells{start};
+        if (start_cluster == goal_cluster &&
+            search(map, start, goal, clusterRect(map, graph, start_cluster), cells)) {
+            smooth(map, cells, to, waypoints);
+            return true;
+        }
+
+        // Connect start and goal to the abstract nodes of their own clusters
+        std::vector<int> targets;
+        std::vector<unsigned int> start_costs, goal_costs;
+        for (int id : graph.cluster_nodes[start_cluster])
+            targets.push_back(graph.nodes[id].cell);
+        distances(map, start, clusterRect(map, graph, start_cluster), targets, start_costs);
+        targets.clear();
+        for (int id : graph.cluster_nodes[goal_cluster])
+            targets.push_back(graph.nodes[id].cell);
+        distances(map, goal, clusterRect(map, graph, goal_cluster), targets, goal_costs);
+
+        // A* over the abstract graph, the start is node n and the goal node n + 1
+        int n = (int) graph.nodes.size(), start_node = n, goal_node = n + 1;
+        node_g.assign(n + 2, INF);
+        node_parent.assign(n + 2, -1);
+        auto cellOf = [&](int id) { return id == start_node ? start : id == goal_node ? goal : graph.nodes[id].cell; };
+        Queue open;
+        node_g[start_node] = 0;
+        open.emplace(octile(map, start, goal), start_node);
+        auto relax = [&](int id, int next, unsigned int w) {
+            if (node_g[id] + w < node_g[next]) {
+                node_g[next] = node_g[id] + w;
+                node_parent[next] = id;
+                open.emplace(node_g[next] + octile(map, cellOf(next), goal), next);
+            }
+        };
+        while (!open.empty()) {
+            auto[f, id] = open.top();
+            open.pop();
+            if (id == goal_node)
+                break;
+            if (f != node_g[id] + octile(map, cellOf(id), goal))
+                continue;
+            if (id == start_node) {
+                auto &members = graph.cluster_nodes[start_cluster];
+                for (size_t k = 0; k < members.size(); ++k)
+                    if (start_costs[k] != INF)
+                        relax(id, members[k], start_costs[k]);
+                continue;
+            }
+            for (auto &edge : graph.nodes[id].edges)
+                relax(id, edge.to, edge.cost);
+            if (graph.nodes[id].cluster == goal_cluster) {
+                auto &members = graph.cluster_nodes[goal_cluster];
+                size_t k = std::find(members.begin(), members.end(), id) - members.begin();
+                if (goal_costs[k] != INF)
+                    relax(id, goal_node, goal_costs[k]);
+            }
+        }
+        if (node_g[goal_node] == INF)
+            return false;
+
+        std::vector<int> abstract;
+        for (int id = goal_node; id != -1; id = node_parent[id])
+            abstract.push_back(id);
+        std::reverse(abstract.begin(), abstract.end());
+
+        // Refine every abstract edge back into tiles
+        for (size_t k = 1; k < abstract.size(); ++k) {
+            int a = cellOf(abstract[k - 1]), b = cellOf(abstract[k]);
+            if (a == b)
+                continue;
+            int cluster = graph.clusterOf(map, a);
+            if (cluster != graph.clusterOf(map, b)) {
+                cells.push_back(b);
+            } else if (!search(map, a, b, clusterRect(map, graph, cluster), cells)) {
+                return false;
+            }
+        }
+        smooth(map, cells, to, waypoints);
+        return true;
+    }
+
+    const ClusterGraph *PathSystem::getGraph(entt::entity tilemap_ent, const TileMap &map) {
+        auto *shared = getWorld()->try_get<MapGraph>(tilemap_ent);
+        if (shared == nullptr || shared->graph == nullptr || shared->graph->revision != map.revision)
+            shared = &getWorld()->assign_or_replace<MapGraph>(
+                    tilemap_ent, MapGraph{std::make_shared<const ClusterGraph>(ClusterGraph::build(map))});
+        return shared->graph.get();
+    }
+
+    unsigned int PathSystem::request(entt::entity actor, const vec2 &goal) {
+        unsigned int ticket = next_ticket++;
+        requests.push_back(Request{ticket, actor, goal});
+        return ticket;
+    }
+
+    void PathSystem::update(float delta) {
+        entt::entity tilemap_ent = entt::null;
+        getWorld()->view<TileMap>().each([&](entt::entity ent, auto &map) {
+            tilemap_ent = ent;
+        });
+
+        auto begin = std::chrono::steady_clock::now();
+        size_t done = 0;
+        for (; done < QUERIES_PER_TICK && !requests.empty(); ++done) {
+            Request req = requests.front();
+            requests.pop_front();
+            if (!getWorld()->valid(req.actor) || !getWorld()->has<Position>(req.actor))
+                continue;
+            Path path{.ticket = req.ticket, .found = false, .waypoints = {}, .next = 0};
+            if (tilemap_ent != entt::null) {
+                auto &map = getWorld()->get<TileMap>(tilemap_ent);
+                path.found = planner.plan(map, *getGraph(tilemap_ent, map), getWorld()->get<Position>(req.actor),
+                                          req.goal, path.waypoints);
+            }
+            getWorld()->assign_or_replace<Path>(req.actor, std::move(path));
+        }
+        if (done > 0) {
+            answered += done;
+            seconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+        }
+    }
+
+    double PathSystem::getQueriesPerSecond() const {
+        return seconds > 0 ? answered / seconds : 0;
+    }
+}
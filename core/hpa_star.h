@@ -0,0 +1,121 @@
+#ifndef ESCAPE_HPA_STAR_H
+#define ESCAPE_HPA_STAR_H
+
+#include <deque>
+#include <memory>
+#include <vector>
+#include <unordered_map>
+#include "MyECS.h"
+#include "components.h"
+
+namespace Escape {
+    /**
+     * Abstract graph for hierarchical pathfinding (HPA*). The tile map is cut into square
+     * clusters, every entrance between two clusters gets a pair of nodes, and nodes of the
+     * same cluster are connected with their exact in-cluster distance.
+     * It is built by MapConverter and kept next to the TileMap, see MapGraph.
+     */
+    struct ClusterGraph {
+        struct Edge {
+            int to;
+            unsigned int cost;
+        };
+
+        struct Node {
+            int cell;
+            int cluster;
+            std::vector<Edge> edges;
+        };
+
+        int cluster_size;
+        int clusters_x, clusters_y;
+        size_t revision;
+        std::vector<Node> nodes;
+        std::vector<std::vector<int>> cluster_nodes;
+
+        int clusterOf(const TileMap &map, int cell) const {
+            return (cell / map.width / cluster_size) * clusters_x + (cell % map.width) / cluster_size;
+        }
+
+        static ClusterGraph build(const TileMap &map, int cluster_size = 16);
+    };
+
+    // Component of the TileMap entity. Every world of a map folder shares the graph it was
+    // loaded with, PathSystem builds one of its own once its map changed.
+    struct MapGraph {
+        std::shared_ptr<const ClusterGraph> graph;
+    };
+
+    // Searches on the tile grid and on a ClusterGraph. Keeps its scratch memory between queries.
+    class HierarchicalPlanner {
+        struct Rect {
+            int x0, y0, x1, y1;
+        };
+
+        std::vector<unsigned int> g;
+        std::vector<int> parent;
+        std::vector<unsigned int> stamp;
+        unsigned int generation = 0;
+
+        std::vector<unsigned int> node_g;
+        std::vector<int> node_parent;
+
+        void prepare(size_t cells);
+
+        Rect clusterRect(const TileMap &map, const ClusterGraph &graph, int cluster) const;
+
+        // A* restricted to rect, appends the cells after `from` up to `to` into path
+        bool search(const TileMap &map, int from, int to, const Rect &rect, std::vector<int> &path);
+
+        // Dijkstra restricted to rect, cost to every target or ~0u when unreachable
+        void distances(const TileMap &map, int from, const Rect &rect, const std::vector<int> &targets,
+                       std::vector<unsigned int> &out);
+
+        void smooth(const TileMap &map, const std::vector<int> &cells, const vec2 &goal, std::vector<vec2> &out) const;
+
+        friend ClusterGraph;
+    public:
+        static bool lineOfSight(const TileMap &map, int from, int to);
+
+        // Waypoints from `from` to `to`, the start position itself is not included
+        bool plan(const TileMap &map, const ClusterGraph &graph, const vec2 &from, const vec2 &to,
+                  std::vector<vec2> &waypoints);
+    };
+
+    /**
+     * Asynchronous path requests. Controllers ask for a route during one tick, the planner
+     * answers during a later one by writing a Path component on the requesting entity.
+     */
+    class PathSystem : public ECSSystem {
+        struct Request {
+            unsigned int ticket;
+            entt::entity actor;
+            vec2 goal;
+        };
+
+        static constexpr size_t QUERIES_PER_TICK = 32;
+
+        std::deque<Request> requests;
+        HierarchicalPlanner planner;
+        unsigned int next_ticket = 1;
+        size_t answered = 0;
+        double seconds = 0;
+
+        const ClusterGraph *getGraph(entt::entity tilemap_ent, const TileMap &map);
+
+    public:
+        unsigned int request(entt::entity actor, const vec2 &goal);
+
+        void update(float delta) override;
+
+        // Forgets the requests not answered yet, for a world that was replaced
+        void clear() {
+            requests.clear();
+        }
+
+        // Measured planner throughput since start, queries per second of planning time
+        double getQueriesPerSecond() const;
+    };
+}
+
+#endif //ESCAPE_HPA_STAR_H
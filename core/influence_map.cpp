@@ -0,0 +1,353 @@
+#include "influence_map.h"
+#include <cmath>
+#include <thread>
+#include "terrain.h"
+#include "timeserver.h"
+#include "weapon_system.h"
+
+namespace Escape {
+    InfluenceSystem::InfluenceSystem(float decay) : decay(decay) {
+        readers[0] = 0;
+        readers[1] = 0;
+    }
+
+    void InfluenceSystem::initialize() {
+        ECSSystem::initialize();
+        weapon_system = findSystem<WeaponSystem>();
+        timeserver = findSystem<TimeServer>();
+    }
+
+    int InfluenceSystem::acquire() const {
+        // The reader stores its count then loads front, the writer stores front then loads the
+        // counts. Only seq_cst on both sides keeps one of them from missing the other's store.
+        while (true) {
+            int index = front.load(std::memory_order_seq_cst);
+            if (index == CLOSED) {
+                std::this_thread::yield();
+                continue;
+            }
+            readers[index].fetch_add(1, std::memory_order_seq_cst);
+            if (front.load(std::memory_order_seq_cst) == index)
+                return index;
+            // the buffers were swapped in between, the writer may be about to reuse this one
+            readers[index].fetch_sub(1, std::memory_order_acq_rel);
+        }
+    }
+
+    void InfluenceSystem::release(int index) const {
+        readers[index].fetch_sub(1, std::memory_order_acq_rel);
+    }
+
+    float InfluenceSystem::valueAt(const Buffer &buffer, size_t index) const {
+        const Cell &cell = buffer.cells[index];
+        if (cell.value == 0)
+            return 0;
+        return cell.value * std::pow(decay, (float) (buffer.tick - cell.tick));
+    }
+
+    void InfluenceSystem::add(Buffer &buffer, size_t index, float weight) {
+        buffer.cells[index] = Cell{valueAt(buffer, index) + weight, buffer.tick};
+        dirty.push_back(index);
+    }
+
+    void InfluenceSystem::stamp(Buffer &buffer, int group, InfluenceLayer layer, const vec2 &pos, int radius,
+                                float strength, const vec2 &facing) {
+        if (group < 0 || group >= MAX_GROUPS)
+            return;
+        int width = buffer.width, height = buffer.height;
+        int ci = (int) std::floor((pos.x - buffer.origin_x) / buffer.cell_width);
+        int cj = (int) std::floor((buffer.origin_y - pos.y) / buffer.cell_height);
+        size_t offset = buffer.layerOffset(group, layer);
+        bool facing_any = facing.x != 0 || facing.y != 0;
+        for (int j = std::max(cj - radius, 0); j <= std::min(cj + radius, height - 1); ++j) {
+            for (int i = std::max(ci - radius, 0); i <= std::min(ci + radius, width - 1); ++i) {
+                float distance = std::sqrt((float) ((i - ci) * (i - ci) + (j - cj) * (j - cj)));
+                float weight = strength * (1 - distance / (radius + 1));
+                if (weight <= 0)
+                    continue;
+                if (facing_any && distance > 0) {
+                    // rows grow downwards, against y
+                    float along = ((i - ci) * facing.x - (j - cj) * facing.y) / distance;
+                    weight *= 0.25f + 0.75f * std::max(along, 0.0f);
+                }
+                add(buffer, offset + (size_t) j * width + i, weight);
+            }
+        }
+    }
+
+    void InfluenceSystem::stampPath(Buffer &buffer, const TileMap &map, int group, const vec2 &pos,
+                                    const vec2 &velocity, float seconds, float strength) {
+        if (group < 0 || group >= MAX_GROUPS)
+            return;
+        float speed = std::sqrt(velocity.x * velocity.x + velocity.y * velocity.y);
+        float step = std::min(map.tile_width, map.tile_height);
+        float reach = std::min(speed * std::max(seconds, 0.0f),
+                               MAX_REACH * std::max(buffer.cell_width, buffer.cell_height));
+        size_t offset = buffer.layerOffset(group, InfluenceLayer::THREAT);
+        long last = -1;
+        // a tile at a time, so no wall is stepped over
+        for (float travelled = 0; ; travelled += step) {
+            float t = speed > 0 ? std::min(travelled, reach) / speed : 0;
+            vec2 at(pos.x + velocity.x * t, pos.y + velocity.y * t);
+            int ti, tj;
+            map.toCell(at.x, at.y, ti, tj);
+            if (map.isWall(ti, tj))
+                break;
+            int i = (int) std::floor((at.x - buffer.origin_x) / buffer.cell_width);
+            int j = (int) std::floor((buffer.origin_y - at.y) / buffer.cell_height);
+            if (i >= 0 && j >= 0 && i < buffer.width && j < buffer.height && j * buffer.width + i != last) {
+                last = j * buffer.width + i;
+                add(buffer, offset + (size_t) last, strength);
+            }
+            if (travelled >= reach)
+                break;
+        }
+    }
+
+    void InfluenceSystem::update(float delta) {
+        stamped = false;
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        if (map == nullptr)
+            return;
+        int back = 1 - front.load(std::memory_order_relaxed);
+        // seq_cst against the store of front in the last update, see acquire()
+        while (readers[back].load(std::memory_order_seq_cst) != 0)
+            std::this_thread::yield();
+
+        // only the back buffer changes, readers may be in the other one
+        Buffer &current = buffers[back];
+        const Buffer &previous = buffers[1 - back];
+        if (map->revision != previous.revision) {
+            current.revision = map->revision;
+            // tiles are measured from their centers, cells from their corner
+            current.origin_x = map->origin_x - map->tile_width / 2;
+            current.origin_y = map->origin_y + map->tile_height / 2;
+            current.cell_width = map->tile_width * CELL_TILES;
+            current.cell_height = map->tile_height * CELL_TILES;
+            current.width = (map->width + CELL_TILES - 1) / CELL_TILES;
+            current.height = (map->height + CELL_TILES - 1) / CELL_TILES;
+            current.cells.assign((size_t) MAX_GROUPS * 2 * current.width * current.height, Cell{0, 0});
+        } else if (current.revision != previous.revision) {
+            // laid out for the new map the tick before, in the other buffer
+            current = previous;
+        } else {
+            // catch up with what was written into the other buffer during the last tick
+            for (size_t index : dirty)
+                current.cells[index] = previous.cells[index];
+        }
+        dirty.clear();
+        current.tick = previous.tick + 1;
+
+        getWorld()->view<AgentData, Position>().each([&](auto ent, auto &agt, auto &pos) {
+            stamp(current, agt.group, InfluenceLayer::PRESENCE, pos, 2, 1);
+            auto *weapon = getWorld()->try_get<Weapon>(ent);
+            if (weapon == nullptr)
+                return;
+            const WeaponPrototype &prototype = weapon_system->getPrototype(weapon->weapon);
+            float range = prototype.bullet_speed * BulletSystem::LIFESPAN;
+            int radius = std::min((int) std::ceil(range / std::max(current.cell_width, current.cell_height)),
+                                  MAX_REACH);
+            float dps = prototype.bullet_damage * prototype.bullet_number / prototype.cd;
+            // agents face where they move, standing still they cover every side
+            vec2 facing(0, 0);
+            if (auto *vel = getWorld()->try_get<Velocity>(ent)) {
+                float speed = std::sqrt(vel->x * vel->x + vel->y * vel->y);
+                if (speed > 1e-3f)
+                    facing = vec2(vel->x / speed, vel->y / speed);
+            }
+            stamp(current, agt.group, InfluenceLayer::THREAT, pos, radius, dps / THREAT_DAMAGE, facing);
+        });
+        float now = timeserver->now();
+        getWorld()->view<BulletData, Position, Velocity>().each([&](auto ent, auto &bullet, auto &pos, auto &vel) {
+            auto firer = (entt::entity) bullet.firer_id;
+            if (!getWorld()->valid(firer))
+                return;
+            auto *agt = getWorld()->try_get<AgentData>(firer);
+            if (agt == nullptr)
+                return;
+            auto *life = getWorld()->try_get<Lifespan>(ent);
+            float seconds = life != nullptr ? life->end - now : BulletSystem::LIFESPAN;
+            stampPath(current, *map, agt->group, pos, vel, seconds, bullet.damage / THREAT_DAMAGE);
+        });
+
+        stamped = true;
+        // seq_cst, see acquire()
+        front.store(back, std::memory_order_seq_cst);
+    }
+
+    int InfluenceSystem::close() {
+        // seq_cst like the swap in update(), see acquire()
+        int index = front.exchange(CLOSED, std::memory_order_seq_cst);
+        for (auto &count : readers)
+            while (count.load(std::memory_order_seq_cst) != 0)
+                std::this_thread::yield();
+        return index;
+    }
+
+    void InfluenceSystem::reopen(int index) {
+        front.store(index, std::memory_order_seq_cst);
+    }
+
+    void InfluenceSystem::recordUndo(Undo &undo) const {
+        int index = front.load(std::memory_order_relaxed);
+        const Buffer &current = buffers[index], &previous = buffers[1 - index];
+        undo.revision = current.revision;
+        undo.indices.clear();
+        undo.cells.clear();
+        if (!stamped) {
+            undo.tick = current.tick;
+            return;
+        }
+        if (previous.revision != current.revision) {
+            // the tick laid out a new map, there is nothing to go back to
+            undo.revision = previous.revision;
+            undo.tick = previous.tick;
+            return;
+        }
+        // the other buffer is the tick before, where it matters it was not caught up yet
+        undo.tick = previous.tick;
+        for (size_t cell : dirty) {
+            undo.indices.push_back((uint32_t) cell);
+            undo.cells.push_back(previous.cells[cell]);
+        }
+    }
+
+    bool InfluenceSystem::undo(const Undo &undo) {
+        int index = front.load(std::memory_order_relaxed);
+        if (undo.revision != buffers[index].revision) {
+            clear();
+            return false;
+        }
+        index = close();
+        // both buffers agree first, then both take the tick back
+        Buffer &current = buffers[index], &other = buffers[1 - index];
+        if (other.revision != current.revision) {
+            other = current;
+        } else {
+            for (size_t cell : dirty)
+                other.cells[cell] = current.cells[cell];
+        }
+        dirty.clear();
+        for (auto &buffer : buffers) {
+            for (size_t k = 0; k < undo.indices.size(); ++k)
+                buffer.cells[undo.indices[k]] = undo.cells[k];
+            buffer.tick = undo.tick;
+        }
+        stamped = false;
+        reopen(index);
+        return true;
+    }
+
+    void InfluenceSystem::clear() {
+        int index = close();
+        // the next update() sees a new map and starts from nothing
+        for (auto &buffer : buffers) {
+            buffer.revision = ~size_t(0);
+            buffer.cells.clear();
+            buffer.tick = 0;
+        }
+        dirty.clear();
+        stamped = false;
+        reopen(index);
+    }
+
+    void InfluenceSystem::save(ByteWriter &out) const {
+        const Buffer &current = buffers[front.load(std::memory_order_relaxed)];
+        out.write((uint64_t) current.revision);
+        out.write((int32_t) current.width);
+        out.write((int32_t) current.height);
+        out.write(current.origin_x);
+        out.write(current.origin_y);
+        out.write(current.cell_width);
+        out.write(current.cell_height);
+        out.write(current.tick);
+        size_t count_at = out.size();
+        out.write((uint32_t) 0);
+        uint32_t count = 0;
+        for (size_t index = 0; index < current.cells.size(); ++index) {
+            const Cell &cell = current.cells[index];
+            if (cell.value == 0)
+                continue;
+            out.write((uint32_t) index);
+            out.write(cell.value);
+            out.write(cell.tick);
+            ++count;
+        }
+        out.patch(count_at, count);
+    }
+
+    bool InfluenceSystem::load(ByteReader &in) {
+        Buffer loaded;
+        loaded.revision = (size_t) in.read<uint64_t>();
+        loaded.width = in.read<int32_t>();
+        loaded.height = in.read<int32_t>();
+        loaded.origin_x = in.read<float>();
+        loaded.origin_y = in.read<float>();
+        loaded.cell_width = in.read<float>();
+        loaded.cell_height = in.read<float>();
+        loaded.tick = in.read<uint32_t>();
+        uint32_t count = in.read<uint32_t>();
+        if (in.overflowed() || loaded.width < 0 || loaded.height < 0)
+            return false;
+        size_t size = (size_t) MAX_GROUPS * 2 * loaded.width * loaded.height;
+        std::vector<Cell> &cells = loaded.cells;
+        cells.assign(size, Cell{0, 0});
+        for (uint32_t k = 0; k < count && !in.overflowed(); ++k) {
+            uint32_t index = in.read<uint32_t>();
+            Cell cell;
+            cell.value = in.read<float>();
+            cell.tick = in.read<uint32_t>();
+            if (index >= size)
+                return false;
+            cells[index] = cell;
+        }
+        if (in.overflowed())
+            return false;
+        int index = close();
+        buffers[0] = loaded;
+        buffers[1] = std::move(loaded);
+        dirty.clear();
+        stamped = false;
+        reopen(index);
+        return true;
+    }
+
+    float InfluenceSystem::read(const Buffer &buffer, int group, InfluenceLayer layer, int i, int j) const {
+        i = std::min(std::max(i, 0), buffer.width - 1);
+        j = std::min(std::max(j, 0), buffer.height - 1);
+        return valueAt(buffer, buffer.layerOffset(group, layer) + (size_t) j * buffer.width + i);
+    }
+
+    float InfluenceSystem::sample(int group, InfluenceLayer layer, const vec2 &pos) const {
+        if (group < 0 || group >= MAX_GROUPS)
+            return 0;
+        int index = acquire();
+        const Buffer &buffer = buffers[index];
+        float value = 0;
+        if (!buffer.cells.empty()) {
+            int i = (int) std::floor((pos.x - buffer.origin_x) / buffer.cell_width);
+            int j = (int) std::floor((buffer.origin_y - pos.y) / buffer.cell_height);
+            value = read(buffer, group, layer, i, j);
+        }
+        release(index);
+        return value;
+    }
+
+    vec2 InfluenceSystem::gradient(int group, InfluenceLayer layer, const vec2 &pos) const {
+        if (group < 0 || group >= MAX_GROUPS)
+            return vec2(0, 0);
+        int index = acquire();
+        const Buffer &buffer = buffers[index];
+        vec2 result(0, 0);
+        if (!buffer.cells.empty()) {
+            int i = (int) std::floor((pos.x - buffer.origin_x) / buffer.cell_width);
+            int j = (int) std::floor((buffer.origin_y - pos.y) / buffer.cell_height);
+            float right = read(buffer, group, layer, i + 1, j), left = read(buffer, group, layer, i - 1, j);
+            // rows grow downwards, so the row above is j - 1
+            float up = read(buffer, group, layer, i, j - 1), down = read(buffer, group, layer, i, j + 1);
+            result = vec2((right - left) / (2 * buffer.cell_width), (up - down) / (2 * buffer.cell_height));
+        }
+        release(index);
+        return result;
+    }
+}
@@ -0,0 +1,138 @@
+#ifndef ESCAPE_INFLUENCE_MAP_H
+#define ESCAPE_INFLUENCE_MAP_H
+
+#include <atomic>
+#include <vector>
+#include <cstdint>
+#include "MyECS.h"
+#include "components.h"
+#include "engine/byte_stream.h"
+
+namespace Escape {
+    class TimeServer;
+
+    class WeaponSystem;
+
+    enum class InfluenceLayer {
+        PRESENCE,
+        THREAT
+    };
+
+    /**
+     * Threat and presence of every group on a grid coarser than the tile map.
+     * Agents stamp their presence every tick. Armed agents also stamp threat as far as their
+     * bullets fly, weighted by the damage per second of their weapon and stronger in front of
+     * where they move; bullets stamp threat on the cells ahead of them up to the first wall.
+     * Cells decay lazily: a cell keeps the tick of its last write and readers apply the decay
+     * for the ticks since then, so a tick costs only the cells that were stamped.
+     * The layers are double buffered. AI code may sample from other threads while the next
+     * tick is being written, without taking a lock. Every buffer carries the layout it was
+     * made for, a new map is laid out in the back buffer first and in the other one the tick
+     * after, once nobody reads it anymore.
+     * The layers carry history the world does not have, so they go into keyframes with save()
+     * and a rollback takes ticks back with the Undo each of them left.
+     */
+    class InfluenceSystem : public ECSSystem {
+    public:
+        static constexpr int MAX_GROUPS = 8;
+        static constexpr int CELL_TILES = 4;
+        // damage worth a threat of 1: per second for an armed agent, per bullet for its path
+        static constexpr float THREAT_DAMAGE = 20;
+        // widest threat kernel, in cells
+        static constexpr int MAX_REACH = 6;
+
+        struct Cell {
+            float value;
+            uint32_t tick;
+        };
+
+        // The cells one tick wrote and what they held before it
+        struct Undo {
+            size_t revision = 0;
+            uint32_t tick = 0;
+            std::vector<uint32_t> indices;
+            std::vector<Cell> cells;
+        };
+
+    private:
+        struct Buffer {
+            // revision of the TileMap the cells are laid out for
+            size_t revision = ~size_t(0);
+            int width = 0, height = 0;
+            float origin_x = 0, origin_y = 0, cell_width = 1, cell_height = 1;
+            // MAX_GROUPS * 2 layers of width * height cells
+            std::vector<Cell> cells;
+            uint32_t tick = 0;
+
+            size_t layerOffset(int group, InfluenceLayer layer) const {
+                return ((size_t) group * 2 + (layer == InfluenceLayer::THREAT)) * width * height;
+            }
+        };
+
+        // front while clear(), load() or undo() change both buffers, readers wait
+        static constexpr int CLOSED = 2;
+
+        float decay;
+        WeaponSystem *weapon_system;
+        TimeServer *timeserver;
+
+        Buffer buffers[2];
+        std::atomic<int> front{0};
+        mutable std::atomic<int> readers[2];
+        std::vector<size_t> dirty;
+        // whether the last update() stamped, dirty is from an earlier tick otherwise
+        bool stamped = false;
+
+        float valueAt(const Buffer &buffer, size_t index) const;
+
+        void add(Buffer &buffer, size_t index, float weight);
+
+        // A cone kernel around pos; with a facing, the cells behind keep a quarter of their weight
+        void stamp(Buffer &buffer, int group, InfluenceLayer layer, const vec2 &pos, int radius, float strength,
+                   const vec2 &facing = vec2(0, 0));
+
+        // Every cell the bullet crosses before a wall or the end of its life, once each
+        void stampPath(Buffer &buffer, const TileMap &map, int group, const vec2 &pos, const vec2 &velocity,
+                       float seconds, float strength);
+
+        int acquire() const;
+
+        void release(int index) const;
+
+        float read(const Buffer &buffer, int group, InfluenceLayer layer, int i, int j) const;
+
+        // Keeps readers out of both buffers until reopen(), returns the front to give back
+        int close();
+
+        void reopen(int index);
+
+    public:
+        InfluenceSystem(float decay = 0.9f);
+
+        void initialize() override;
+
+        void update(float delta) override;
+
+        float sample(int group, InfluenceLayer layer, const vec2 &pos) const;
+
+        // Change of the layer per world unit around pos, points toward higher influence
+        vec2 gradient(int group, InfluenceLayer layer, const vec2 &pos) const;
+
+        // Replaces undo with what the last update() changed; reuses its buffers
+        void recordUndo(Undo &undo) const;
+
+        // Takes back the tick of undo, newest tick first and one after the other. False when the
+        // map changed since, the layers are empty then and older undos do not apply either.
+        bool undo(const Undo &undo);
+
+        // Empty layers, built up again from the next tick
+        void clear();
+
+        // The cells that ever had influence, for keyframes of the same map
+        void save(ByteWriter &out) const;
+
+        bool load(ByteReader &in);
+    };
+}
+
+#endif //ESCAPE_INFLUENCE_MAP_H
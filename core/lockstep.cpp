@@ -0,0 +1,187 @@
+#include "lockstep.h"
+#include <algorithm>
+#include <iostream>
+#include "agent.h"
+#include "timeserver.h"
+#include "world_hash.h"
+
+namespace Escape {
+    static InputCommand idle(int player_id) {
+        return InputCommand{player_id, 0, 0, false, 0, 0, -1};
+    }
+
+    LockstepSession::LockstepSession(Match &match, int player_id, uint64_t seed) : match(match), player_id(player_id),
+                                                                                   timestep(match.getTickInterval()) {
+        match.findSystem<TimeServer>()->setSeed(seed);
+        command = idle(player_id);
+        last = clock_type::now();
+    }
+
+    bool LockstepSession::listen(uint16_t port) {
+        return socket.open(port);
+    }
+
+    void LockstepSession::addPeer(const NetAddress &address) {
+        peers.emplace_back();
+        peers.back().address = address;
+    }
+
+    bool LockstepSession::submit(const InputCommand &cmd) {
+        // frames come faster than ticks, a shot or a weapon change must survive until the next one
+        bool shooting = command.shooting || cmd.shooting;
+        int weapon = cmd.weapon >= 0 ? cmd.weapon : command.weapon;
+        command = cmd;
+        command.player_id = player_id;
+        command.shooting = shooting;
+        command.weapon = weapon;
+        return true;
+    }
+
+    void LockstepSession::receive() {
+        NetAddress from;
+        uint8_t packet[UdpSocket::MAX_PACKET];
+        size_t size;
+        LockstepPacket input;
+        while ((size = socket.receive(from, packet, sizeof(packet))) > 0) {
+            if (!Net::decodeLockstep(packet, size, input) || input.player_id == 0 || input.player_id == player_id)
+                continue;
+            auto iter = std::find_if(peers.begin(), peers.end(), [&](const Peer &p) {
+                return p.address == from;
+            });
+            if (iter == peers.end() || (iter->player_id != 0 && iter->player_id != input.player_id))
+                continue;
+            Peer &peer = *iter;
+            peer.player_id = input.player_id;
+            peer.acked = std::max(peer.acked, input.ack);
+            // inputs only ever arrive in order, the sender starts from what we acknowledged
+            for (size_t k = 0; k < input.commands.size(); ++k) {
+                uint32_t t = input.first + (uint32_t) k;
+                if (t < peer.received)
+                    continue;
+                if (t > peer.received || t >= tick + WINDOW)
+                    break;
+                peer.inputs[t % WINDOW] = input.commands[k];
+                ++peer.received;
+            }
+            if (input.hash_tick != Net::NO_TICK && (peer.hash_tick == Net::NO_TICK || input.hash_tick > peer.hash_tick)) {
+                peer.hash_tick = input.hash_tick;
+                peer.hash = input.hash;
+            }
+        }
+    }
+
+    void LockstepSession::start() {
+        started = true;
+        // every peer creates the same agents in the same order
+        std::vector<int> players{player_id};
+        for (auto &peer : peers)
+            players.push_back(peer.player_id);
+        std::sort(players.begin(), players.end());
+        World *world = match.getWorld();
+        ControlSystem *control_system = match.findSystem<ControlSystem>();
+        for (int id : players) {
+            if (control_system->findPlayer(id) != entt::null)
+                continue;
+            entt::entity first = control_system->findPlayer(1);
+            Position spawn = first != entt::null ? world->get<Position>(first) : Position(0, 0);
+            AgentSystem::createAgent(world, spawn, id, 1);
+        }
+        // nobody has input for the first ticks, they run idle everywhere
+        for (uint32_t t = 0; t < INPUT_DELAY; ++t)
+            local[t] = idle(player_id);
+        produced = INPUT_DELAY;
+        for (auto &peer : peers) {
+            for (uint32_t t = 0; t < INPUT_DELAY; ++t)
+                peer.inputs[t] = idle(peer.player_id);
+            peer.received = std::max(peer.received, INPUT_DELAY);
+            peer.acked = std::max(peer.acked, INPUT_DELAY);
+        }
+        std::cerr << "Lockstep with " << peers.size() << " peers as player " << player_id << std::endl;
+    }
+
+    bool LockstepSession::ready() const {
+        return std::all_of(peers.begin(), peers.end(), [&](const Peer &peer) {
+            return peer.received > tick;
+        });
+    }
+
+    void LockstepSession::verify(const Peer &peer) {
+        if (desync_tick != Net::NO_TICK || peer.hash_tick == Net::NO_TICK || peer.hash_tick >= tick ||
+            tick - peer.hash_tick > WINDOW)
+            return;
+        if (hashes[peer.hash_tick % WINDOW] != peer.hash) {
+            desync_tick = peer.hash_tick;
+            std::cerr << "Out of sync with player " << peer.player_id << " after tick " << desync_tick << std::endl;
+        }
+    }
+
+    void LockstepSession::send() {
+        for (auto &peer : peers) {
+            LockstepPacket packet{player_id, peer.received, peer.acked, {}, Net::NO_TICK, 0};
+            for (uint32_t t = peer.acked; t < produced && packet.commands.size() < MAX_BATCH; ++t)
+                packet.commands.push_back(local[t % WINDOW]);
+            if (tick > 0) {
+                packet.hash_tick = tick - 1;
+                packet.hash = hashes[(tick - 1) % WINDOW];
+            }
+            size_t size = Net::encodeLockstep(packet, buffer, sizeof(buffer));
+            if (size > 0 && link.send(peer.address, buffer, size)) {
+                ++packets;
+                bytes += size;
+            }
+        }
+    }
+
+    void LockstepSession::poll(float elapsed) {
+        receive();
+        if (!started && std::all_of(peers.begin(), peers.end(), [](const Peer &peer) {
+            return peer.player_id != 0;
+        }))
+            start();
+
+        int steps = timestep.advance(elapsed);
+        if (started) {
+            for (int i = 0; i < steps; ++i) {
+                if (!ready()) {
+                    ++stalls;
+                    break;
+                }
+                // our input for a later tick, the delay covers the trip to the other peers
+                if (produced == tick + INPUT_DELAY) {
+                    local[produced % WINDOW] = Net::quantize(command);
+                    command.shooting = false;
+                    command.weapon = -1;
+                    ++produced;
+                }
+                match.submit(local[tick % WINDOW]);
+                for (auto &peer : peers)
+                    match.submit(peer.inputs[tick % WINDOW]);
+                match.step();
+                hashes[tick % WINDOW] = hashWorld(*match.getWorld());
+                ++tick;
+            }
+            for (auto &peer : peers)
+                verify(peer);
+        }
+        // once per tick, waiting or not; the peers learn from it that we are here
+        if (steps > 0)
+            send();
+        link.flush();
+    }
+
+    const RenderSnapshot &LockstepSession::latest() {
+        auto now = clock_type::now();
+        poll(std::chrono::duration<float>(now - last).count());
+        last = now;
+        return match.latest();
+    }
+
+    void LockstepSession::report(std::ostream &out) const {
+        float seconds = tick * match.getTickInterval();
+        out << "lockstep: " << tick << " ticks, " << stalls << " waited for input, " << packets << " packets, "
+            << (seconds > 0 ? bytes / seconds : 0) << " bytes/s";
+        if (desync_tick != Net::NO_TICK)
+            out << ", out of sync after tick " << desync_tick;
+        out << std::endl;
+    }
+}
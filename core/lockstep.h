@@ -0,0 +1,132 @@
+#ifndef ESCAPE_LOCKSTEP_H
+#define ESCAPE_LOCKSTEP_H
+
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include "match.h"
+#include "net_protocol.h"
+#include "engine/udp_socket.h"
+#include "engine/fixed_timestep.h"
+
+namespace Escape {
+    /**
+     * Every peer runs the whole Match and only InputCommands go over the network, so the
+     * bandwidth does not grow with the number of entities. A tick runs once the inputs of every
+     * peer for it have arrived; the local input is scheduled INPUT_DELAY ticks ahead so it has
+     * time to get there. Packets repeat every input the other side has not acknowledged yet,
+     * lost ones need no retransmission.
+     * Peers also send the hash of their newest tick. A hash that differs from the local one for
+     * the same tick means the simulations went apart, which is reported once with its tick.
+     * Everything runs on the thread calling latest() or poll(), which also ticks the match.
+     */
+    class LockstepSession : public MatchView {
+        typedef std::chrono::steady_clock clock_type;
+
+    public:
+        static constexpr uint32_t INPUT_DELAY = 3;
+        // ticks of inputs and hashes kept, far more than the peers can be apart
+        static constexpr size_t WINDOW = 64;
+        // inputs in a packet at most
+        static constexpr size_t MAX_BATCH = 16;
+
+    private:
+        struct Peer {
+            NetAddress address;
+            // 0 until the peer was heard from
+            int player_id = 0;
+            // our inputs before this tick have arrived there
+            uint32_t acked = 0;
+            // its inputs before this tick have arrived here, at tick % WINDOW
+            uint32_t received = 0;
+            InputCommand inputs[WINDOW];
+            // newest hash it sent
+            uint32_t hash_tick = Net::NO_TICK;
+            uint64_t hash = 0;
+        };
+
+        Match &match;
+        int player_id;
+        UdpSocket socket;
+        LossyLink link{socket};
+        std::vector<Peer> peers;
+        FixedTimestep timestep;
+        clock_type::time_point last;
+        bool started = false;
+
+        // input collected from the frames since the last tick
+        InputCommand command;
+        // our inputs before produced exist, at tick % WINDOW
+        InputCommand local[WINDOW];
+        uint32_t produced = 0;
+        // next tick to run, hashes of the world after the ticks before it
+        uint32_t tick = 0;
+        uint64_t hashes[WINDOW];
+        uint32_t desync_tick = Net::NO_TICK;
+
+        size_t stalls = 0, packets = 0, bytes = 0;
+        uint8_t buffer[UdpSocket::MAX_PACKET];
+
+        void receive();
+
+        void start();
+
+        bool ready() const;
+
+        void verify(const Peer &peer);
+
+        void send();
+
+    public:
+        // The match must have been prepared on the calling thread
+        LockstepSession(Match &match, int player_id, uint64_t seed = 0);
+
+        bool listen(uint16_t port);
+
+        // Every peer lists all the others and none starts before it heard from each of them
+        void addPeer(const NetAddress &address);
+
+        // Loss and latency of everything this peer sends
+        LossyLink &getLink() {
+            return link;
+        }
+
+        // Receives, runs the ticks that are due and whose inputs are all here, sends our inputs
+        void poll(float elapsed);
+
+        uint32_t getTick() const {
+            return tick;
+        }
+
+        // First tick a peer hashed differently, NO_TICK while in sync
+        uint32_t getDesyncTick() const {
+            return desync_tick;
+        }
+
+        // Ticks waited for and bytes sent
+        void report(std::ostream &out) const;
+
+        const std::string &getFolder() const override {
+            return match.getFolder();
+        }
+
+        bool submit(const InputCommand &cmd) override;
+
+        // A task would change only this peer's world
+        bool post(std::function<void(World &)> task) override {
+            return false;
+        }
+
+        void setCamera(const CameraRect &rect) override {
+            match.setCamera(rect);
+        }
+
+        const RenderSnapshot &latest() override;
+
+        Profiler &getProfiler() override {
+            return match.getProfiler();
+        }
+    };
+}
+
+#endif //ESCAPE_LOCKSTEP_H
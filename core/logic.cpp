@@ -10,6 +10,11 @@
 #include "control.h"
 #include "ai_system.h"
 #include "event_system.h"
+#include "flow_field.h"
+#include "hpa_star.h"
+#include "raycast.h"
+#include "visibility.h"
+#include "influence_map.h"
 namespace Escape {
     void Logic::addSystems() {
         addSubSystem(new TimeServer(60));
@@ -17,6 +22,11 @@ namespace Escape {
         addSubSystem(new LifespanSystem());
         addSubSystem(new BulletSystem());
         addSubSystem(new WeaponSystem());
+        addSubSystem(new FlowFieldSystem());
+        addSubSystem(new PathSystem());
+        addSubSystem(new RaycastSystem());
+        addSubSystem(new VisibilitySystem());
+        addSubSystem(new InfluenceSystem());
         addSubSystem(new AISystem());
         addSubSystem(new ControlSystem());
         addSubSystem(new AgentSystem());
@@ -13,6 +13,26 @@ namespace Escape {
 
     void Agent_Lua::init(ControlSystem *c) {
         control = c;
+        flow_field = control->findSystem<FlowFieldSystem>();
+        path_system = control->findSystem<PathSystem>();
+        raycast_system = control->findSystem<RaycastSystem>();
+        visibility_system = control->findSystem<VisibilitySystem>();
+        influence_system = control->findSystem<InfluenceSystem>();
+        timeserver = control->findSystem<TimeServer>();
+
+        // math.random from the agent's own stream, so scripts replay alike on every peer
+        lua["math"]["random"] = [&](sol::optional<int64_t> m, sol::optional<int64_t> n) -> sol::object {
+            RandomStream &random = timeserver->stream(getEntityID());
+            if (!m)
+                return sol::make_object(lua, (double) random.uniform());
+            int64_t low = n ? *m : 1, high = n ? *n : *m;
+            if (high < low)
+                throw std::runtime_error("bad argument to 'random' (interval is empty)");
+            return sol::make_object(lua, low + (int64_t) random.below((uint32_t) (high - low + 1)));
+        };
+        // the seed is the match's, see TimeServer::setSeed
+        lua["math"]["randomseed"] = [](sol::variadic_args) {
+        };
 
         lua["get"] = [&](const sol::object &query) -> sol::object {
 
@@ -30,6 +50,67 @@ namespace Escape {
             }
             throw std::runtime_error("Canot find the command " + query.as<std::string>());
         };
+        // Direction to walk toward the target around walls, (0, 0) if it cannot be reached
+        lua["flow"] = [&](const sol::object &query) -> std::tuple<float, float> {
+            entt::entity target = resolve(query);
+            if (target == entt::null || !control->valid(getEntityID()))
+                return std::make_tuple(0.0f, 0.0f);
+            vec2 dir = flow_field->direction(target, control->get<Position>(getEntityID()));
+            return std::make_tuple(dir.x, dir.y);
+        };
+        // Asks the planner for a route, the answer is available from next_waypoint() a tick or more later
+        lua["find_path"] = [&](float x, float y) -> unsigned int {
+            return path_system->request(getEntityID(), vec2(x, y));
+        };
+        // Next point to walk to on the last planned route: found, x, y
+        lua["next_waypoint"] = [&]() -> std::tuple<bool, float, float> {
+            entt::entity self = getEntityID();
+            if (!control->valid(self) || !control->has<Path>(self))
+                return std::make_tuple(false, 0.0f, 0.0f);
+            auto &path = control->getWorld()->get<Path>(self);
+            auto pos = control->get<Position>(self);
+            while (path.next + 1 < path.waypoints.size()) {
+                const vec2 &p = path.waypoints[path.next];
+                if ((p.x - pos.x) * (p.x - pos.x) + (p.y - pos.y) * (p.y - pos.y) > AGENT_RADIUS * AGENT_RADIUS)
+                    break;
+                ++path.next;
+            }
+            if (!path.found || path.next >= path.waypoints.size())
+                return std::make_tuple(false, 0.0f, 0.0f);
+            return std::make_tuple(true, path.waypoints[path.next].x, path.waypoints[path.next].y);
+        };
+        // Whether nothing blocks the straight line between the two entities
+        lua["los"] = [&](const sol::object &a, const sol::object &b) -> bool {
+            return raycast_system->lineOfSight(resolve(a), resolve(b));
+        };
+        // Casts from an entity's position: hit, distance
+        lua["raycast"] = [&](const sol::object &origin, float angle, float max_distance) -> std::tuple<bool, float> {
+            entt::entity ent = resolve(origin);
+            if (!control->valid(ent) || !control->has<Position>(ent))
+                return std::make_tuple(false, max_distance);
+            auto pos = control->get<Position>(ent);
+            RayHit hit = raycast_system->cast(Ray{pos.x, pos.y, std::cos(angle), std::sin(angle), max_distance});
+            return std::make_tuple(hit.hit, hit.distance);
+        };
+        // Whether any member of this agent's group can currently see the target
+        lua["visible"] = [&](const sol::object &query) -> bool {
+            entt::entity self = getEntityID();
+            if (!control->valid(self) || !control->has<AgentData>(self))
+                return false;
+            return visibility_system->isVisible(control->getWorld()->get<AgentData>(self).group, resolve(query));
+        };
+        // Influence of a group ("presence" or "threat") at this agent's position: value, gx, gy
+        // The gradient points toward higher influence, the group defaults to the agent's own
+        lua["influence"] = [&](const std::string &layer, sol::optional<int> group) -> std::tuple<float, float, float> {
+            entt::entity self = getEntityID();
+            if (!control->valid(self) || !control->has<AgentData>(self))
+                return std::make_tuple(0.0f, 0.0f, 0.0f);
+            InfluenceLayer which = layer == "threat" ? InfluenceLayer::THREAT : InfluenceLayer::PRESENCE;
+            int g = group ? *group : control->getWorld()->get<AgentData>(self).group;
+            auto pos = control->get<Position>(self);
+            vec2 grad = influence_system->gradient(g, which, pos);
+            return std::make_tuple(influence_system->sample(g, which, pos), grad.x, grad.y);
+        };
         lua["id"] = getEntityID();
         lua["post"] = [&](const sol::table &tab) {
             submit(getEntityID(), tab);
@@ -42,11 +123,23 @@ namespace Escape {
         lua.script("update()");
     }
 
+    size_t Agent_Lua::getMemoryUsage() const {
+        return lua.memory_used();
+    }
+
     void Agent_Lua::submit(entt::entity ent, const sol::table &table) {
 
         control->dispatch(ent, converter.toJSON(table));
     }
 
+    entt::entity Agent_Lua::resolve(const sol::object &query) {
+        if (query.get_type() == sol::type::number)
+            return (entt::entity) query.as<ENTT_ID_TYPE>();
+        if (query.get_type() == sol::type::string && query.as<std::string>() == "player")
+            return control->findPlayer(1);
+        return entt::null;
+    }
+
     sol::table Agent_Lua::getEntityInfo(entt::entity ent) {
         return converter.toTable(control->getEntityInfo(ent));
     }
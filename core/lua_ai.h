@@ -9,13 +9,27 @@
 #include "ai_system.h"
 #include "lua_script.h"
 #include "config.h"
+#include "flow_field.h"
+#include "hpa_star.h"
+#include "raycast.h"
+#include "visibility.h"
+#include "influence_map.h"
+#include "timeserver.h"
 
 namespace Escape {
     class Agent_Lua : public AgentControl {
         sol::state lua;
         Converter converter = lua;
         ControlSystem *control;
+        FlowFieldSystem *flow_field;
+        PathSystem *path_system;
+        RaycastSystem *raycast_system;
+        VisibilitySystem *visibility_system;
+        InfluenceSystem *influence_system;
+        TimeServer *timeserver;
         std::string file;
+
+        entt::entity resolve(const sol::object &query);
     public:
         Agent_Lua(std::string &&filename);
 
@@ -23,6 +37,8 @@ namespace Escape {
 
         void update(float delta) override;
 
+        size_t getMemoryUsage() const override;
+
         void submit(entt::entity ent, const sol::table &table);
 
         sol::table getEntityInfo(entt::entity ent);
@@ -5,8 +5,11 @@
 #include "map_converter.h"
 #include <nlohmann/json.hpp>
 #include <fstream>
+#include <mutex>
+#include <unordered_map>
 #include "terrain.h"
 #include "agent.h"
+#include "hpa_star.h"
 
 using nlohmann::json;
 namespace Escape {
@@ -23,7 +26,7 @@ namespace Escape {
         return;
     }
 
-    World *MapConverter::convert(const std::string &input) {
+    static std::shared_ptr<MapData> parse(const std::string &input) {
 
         json configuration;
         {
@@ -37,21 +40,39 @@ namespace Escape {
             is >> map;
         }
 
-        entt::registry *world = new entt::registry;
+        auto data = std::make_shared<MapData>();
         int width = map["width"], height = map["height"];
         float tilewidth = map["tilewidth"], tileheight = map["tileheight"];
         float scale_x = 1.0f / 16.0f, scale_y = 1.0f / 16.0f;
+
+        data->tilemap = TileMap{.width = width,
+                .height = height,
+                .origin_x = 0,
+                .origin_y = 0,
+                .tile_width = tilewidth * scale_x,
+                .tile_height = tileheight * scale_y,
+                .tiles = std::vector<int>(width * height, 0),
+                .walls = std::vector<int>(width * height, 0),
+                .revision = 0,
+                .tileset_columns = configuration["columns"],
+                .tileset_rows = (int) configuration["tilecount"] / (int) configuration["columns"],
+        };
+        TileMap &tilemap = data->tilemap;
         for (auto &&layer : map["layers"]) {
             if (layer["data"].is_array()) {
-                auto &&data = layer["data"];
-                for (size_t i = 0; i < height; i++) {
-                    for (size_t j = 0; j < width; j++) {
+                auto &&layer_data = layer["data"];
+                tilemap.origin_x = (float) layer["x"] * scale_x;
+                tilemap.origin_y = -(float) layer["y"] * scale_y;
+                for (size_t i = 0; i < width; i++) {
+                    for (size_t j = 0; j < height; j++) {
                         float x = (i * tilewidth + (float) layer["x"]) * scale_x, y =
                                 -(j * tileheight + (float) layer["y"]) * scale_y;
-                        int type = data[j * width + i];
+                        int type = layer_data[j * width + i];
                         if (type > 0) {
+                            tilemap.tiles[j * width + i] = type;
                             if (configuration["tiles"][type - 1]["type"] == "Wall") {              // It's wall
-                                TerrainSystem::createWall(world, x, y, tilewidth * scale_x, tileheight * scale_y);
+                                tilemap.walls[j * width + i] = 1;
+                                data->walls.push_back(MapData::Wall{x, y, tilewidth * scale_x, tileheight * scale_y});
                             }
                         }
                     }
@@ -61,17 +82,49 @@ namespace Escape {
                     if (obj["type"] == "SpawnPoint") {
                         float x = ((float) obj["x"]) * scale_x, y = -((float) obj["y"]) * scale_y;
                         if (obj["name"] == "player") {
-                            AgentSystem::createAgent(world, Position(x, y), 1, 1);
+                            data->spawns.push_back(MapData::Spawn{Position(x, y), true, ""});
                         } else if (obj["name"] == "agent") {
                             std::string ai_file = "simple_ai";
                             bool success;
                             getProperty(obj, "ai", ai_file, success);
-                            AgentSystem::createAgent(world, Position(x, y), 0, 0, std::move(ai_file));
+                            data->spawns.push_back(MapData::Spawn{Position(x, y), false, std::move(ai_file)});
                         }
                     }
                 }
             }
         }
+        data->graph = std::make_shared<const ClusterGraph>(ClusterGraph::build(tilemap));
+        return data;
+    }
+
+    std::shared_ptr<const MapData> MapConverter::load(const std::string &input) {
+        static std::mutex mutex;
+        static std::unordered_map<std::string, std::shared_ptr<const MapData>> cache;
+        std::lock_guard<std::mutex> lock(mutex);
+        auto &data = cache[input];
+        if (!data)
+            data = parse(input);
+        return data;
+    }
+
+    World *MapConverter::instantiate(const MapData &data) {
+        entt::registry *world = new entt::registry;
+        for (auto &wall : data.walls)
+            TerrainSystem::createWall(world, wall.x, wall.y, wall.width, wall.height);
+        for (auto &spawn : data.spawns) {
+            if (spawn.player)
+                AgentSystem::createAgent(world, spawn.position, 1, 1);
+            else
+                AgentSystem::createAgent(world, spawn.position, 0, 0, std::string(spawn.ai));
+        }
+        entt::entity tile_ent = world->create();
+        world->assign<Name>(tile_ent, "tilemap");
+        world->assign<MapGraph>(tile_ent, MapGraph{data.graph});
+        world->assign<TileMap>(tile_ent, data.tilemap);
         return world;
     }
+
+    World *MapConverter::convert(const std::string &input) {
+        return instantiate(*load(input));
+    }
 } // namespace Escape
@@ -5,13 +5,41 @@
 #ifndef ESCAPE_MAP_CONVERTER_H
 #define ESCAPE_MAP_CONVERTER_H
 
+#include <memory>
 #include <string>
+#include <vector>
 #include "MyECS.h"
+#include "components.h"
+#include "hpa_star.h"
 
 namespace Escape
 {
+// A map folder as read from disk, shared read-only by every world created from it
+struct MapData {
+    struct Wall {
+        float x, y, width, height;
+    };
+
+    struct Spawn {
+        Position position;
+        bool player;
+        std::string ai;
+    };
+
+    TileMap tilemap;
+    std::shared_ptr<const ClusterGraph> graph;
+    std::vector<Wall> walls;
+    std::vector<Spawn> spawns;
+};
+
 class MapConverter {
 public:
+    // Parses the folder the first time it is asked for, later calls share the same data
+    static std::shared_ptr<const MapData> load(const std::string &input);
+
+    // A new world with its own copy of the tile map, which can change; the graph is shared
+    World *instantiate(const MapData &data);
+
     World *convert(const std::string &input);
 };
     
@@ -0,0 +1,233 @@
+#include "match.h"
+#include "map_converter.h"
+#include "terrain.h"
+#include "lua_ai.h"
+#include "hpa_star.h"
+#include "influence_map.h"
+#include "visibility.h"
+#include "flow_field.h"
+#include "replay.h"
+#include "rollback.h"
+#include "world_snapshot.h"
+#include <algorithm>
+#include <chrono>
+
+namespace Escape {
+    Match::Match(const std::string &folder, int player_id) : folder(folder), player_id(player_id),
+                                                             timestep(1 / 60.0f) {
+        MapConverter mapConverter;
+        auto *world = mapConverter.convert(folder);
+        logic = new Logic(world);
+        logic->addSubSystem(new RenderSystem());
+        addSubSystem(logic);
+        configure();
+        timeserver = findSystem<TimeServer>();
+        ai_system = findSystem<AISystem>();
+        control_system = findSystem<ControlSystem>();
+        render_system = findSystem<RenderSystem>();
+        event_system = findSystem<EventSystem>();
+        // the accumulator paces the ticks instead
+        timeserver->setPacing(false);
+        timestep.setStep(timeserver->getDelta());
+        setCamera(CameraRect{0, 0, 0, 0});
+
+        foreach([this](System *sys) {
+            profiler.addSection(Profiler::nameOf(typeid(*sys)));
+        });
+#define ADD_COUNTER(T) profiler.addCounter(#T)
+        FOREACH_COMPONENT_TYPE(ADD_COUNTER);
+#undef ADD_COUNTER
+        counter_entities = profiler.addCounter("entities");
+        counter_events = profiler.addCounter("events");
+        counter_requests = profiler.addCounter("control requests");
+        counter_dropped = profiler.addCounter("control dropped");
+        counter_lua = profiler.addCounter("lua KB");
+        counter_rollback = profiler.addCounter("rollback capture us");
+    }
+
+    Match::~Match() {
+        stop();
+    }
+
+    void Match::update(float delta) {
+        for (entt::entity ent = ai_system->allocate(); ent != entt::null; ent = ai_system->allocate()) {
+            auto data = getWorld()->get<AgentData>(ent);
+            auto ai_path = folder + "/" + data.ai + ".lua";
+            ai_system->insert(ent, new Agent_Lua(std::move(ai_path)));
+        }
+        std::function<void(World &)> task;
+        while (tasks.pop(task))
+            task(*getWorld());
+    }
+
+    void Match::prepare() {
+        foreach([](System *sys) {
+            sys->initialize();
+        });
+    }
+
+    void Match::step() {
+        uint32_t back = rewinding.exchange(0);
+        if (back > 0 && history != nullptr && history->getNewestTick() >= history->getOldestTick()) {
+            auto tick = (uint32_t) timeserver->getTick();
+            rollback(std::max(tick > back ? tick - back : 0, history->getOldestTick()));
+        }
+        if (recorder != nullptr)
+            recorder->beginTick();
+        if (!profiler.isEnabled()) {
+            updateAll(timeserver->getDelta());
+            if (publishing)
+                publish();
+        } else {
+            profiler.begin(timeserver->getTick());
+            updateAll(timeserver->getDelta(), &profiler);
+            if (publishing)
+                publish();
+            measure();
+            profiler.end();
+        }
+        if (recorder != nullptr)
+            recorder->endTick();
+        if (history != nullptr)
+            history->capture(*getWorld(), *timeserver, *findSystem<InfluenceSystem>());
+    }
+
+    void Match::save(ByteWriter &out) {
+        saveWorld(*getWorld(), out);
+        timeserver->save(out);
+        findSystem<InfluenceSystem>()->save(out);
+    }
+
+    bool Match::restore(ByteReader &in) {
+        if (!loadWorld(*getWorld(), in) || !timeserver->load(in) || !findSystem<InfluenceSystem>()->load(in))
+            return false;
+        restarted();
+        return true;
+    }
+
+    bool Match::rollback(uint32_t tick) {
+        if (history == nullptr || !history->restore(*getWorld(), *timeserver, *findSystem<InfluenceSystem>(), tick))
+            return false;
+        restarted();
+        return true;
+    }
+
+    bool Match::rewind(uint32_t ticks) {
+        // a recording would hold the same ticks twice
+        if (history == nullptr || recorder != nullptr)
+            return false;
+        rewinding += ticks;
+        return true;
+    }
+
+    void Match::restarted() {
+        // the agents get new scripts on the next tick, and ask for their paths again
+        ai_system->clear();
+        findSystem<PathSystem>()->clear();
+        // caches keyed by entities that may now be others, built again from the world
+        findSystem<VisibilitySystem>()->clear();
+        findSystem<FlowFieldSystem>()->clear();
+    }
+
+    void Match::measure() {
+        World *world = getWorld();
+        size_t counter = 0;
+#define COUNT(T) profiler.count(counter++, world->size<T>())
+        FOREACH_COMPONENT_TYPE(COUNT);
+#undef COUNT
+        profiler.count(counter_entities, world->alive());
+        profiler.count(counter_events, event_system->getQueueDepth());
+        profiler.count(counter_requests, control_system->getRequestCount());
+        profiler.count(counter_dropped, control_system->getDropped());
+        profiler.count(counter_lua, ai_system->getMemoryUsage() / 1024.0);
+        profiler.count(counter_rollback, history != nullptr ? history->getCaptureMicros() : 0);
+    }
+
+    int Match::advance(float elapsed) {
+        int steps = timestep.advance(elapsed);
+        for (int i = 0; i < steps; ++i)
+            step();
+        return steps;
+    }
+
+    void Match::setTickRate(float rate) {
+        auto apply = [this, rate](World &) {
+            timeserver->setRate(rate);
+            timestep.setStep(timeserver->getDelta());
+        };
+        if (running)
+            post(apply);
+        else
+            apply(*getWorld());
+    }
+
+    void Match::publish() {
+        RenderSnapshot &snapshot = snapshots.back();
+        snapshot.tick = timeserver->getTick();
+        snapshot.delta = timeserver->getDelta();
+        entt::entity player = control_system->findPlayer(player_id);
+        snapshot.has_player = player != entt::null;
+        if (snapshot.has_player)
+            snapshot.player = control_system->get<Position>(player);
+
+        // the camera keeps moving while this snapshot waits to be drawn
+        CameraRect rect = CameraRect{camera[0], camera[1], camera[2], camera[3]}.grown(0.25f);
+        render_system->extract(rect, snapshot.instances, RenderSystem::AGENTS | RenderSystem::BULLETS);
+
+        if (walls_version != render_system->getWallsVersion()) {
+            walls_version = render_system->getWallsVersion();
+            walls = std::make_shared<const std::vector<RenderInstance>>(render_system->getWalls());
+        }
+        snapshot.walls = walls;
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        if (map == nullptr)
+            tilemap.reset();
+        else if (!tilemap || tilemap->revision != map->revision)
+            tilemap = std::make_shared<const TileMap>(*map);
+        snapshot.tilemap = tilemap;
+        snapshots.publish();
+    }
+
+    void Match::start() {
+        if (running)
+            return;
+        running = true;
+        thread = std::thread([this] {
+            prepare();
+            auto last = std::chrono::steady_clock::now();
+            while (running) {
+                auto now = std::chrono::steady_clock::now();
+                advance(std::chrono::duration<float>(now - last).count());
+                last = now;
+                // wake up when the next tick is due
+                std::this_thread::sleep_for(std::chrono::duration<float>((1 - timestep.alpha()) * timestep.getStep()));
+            }
+        });
+    }
+
+    void Match::stop() {
+        running = false;
+        if (thread.joinable())
+            thread.join();
+    }
+
+    bool Match::submit(const InputCommand &cmd) {
+        return control_system->submit(cmd);
+    }
+
+    bool Match::post(std::function<void(World &)> task) {
+        return tasks.push(task);
+    }
+
+    void Match::setCamera(const CameraRect &rect) {
+        camera[0] = rect.left;
+        camera[1] = rect.bottom;
+        camera[2] = rect.right;
+        camera[3] = rect.top;
+    }
+
+    const RenderSnapshot &Match::latest() {
+        snapshots.update();
+        return snapshots.front();
+    }
+}
@@ -0,0 +1,201 @@
+#ifndef ESCAPE_MATCH_H
+#define ESCAPE_MATCH_H
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+#include <functional>
+#include "MyECS.h"
+#include "logic.h"
+#include "control.h"
+#include "ai_system.h"
+#include "render.h"
+#include "event_system.h"
+#include "timeserver.h"
+#include "engine/triple_buffer.h"
+#include "engine/spsc_queue.h"
+#include "engine/fixed_timestep.h"
+#include "engine/profiler.h"
+#include "engine/byte_stream.h"
+
+namespace Escape {
+    class ReplayRecorder;
+
+    class RollbackBuffer;
+
+    // What a front-end draws for one tick. Never changed after it was published.
+    struct RenderSnapshot {
+        size_t tick = 0;
+        // seconds between this tick and the next, for front-ends interpolating toward it
+        float delta = 0;
+        bool has_player = false;
+        // the local player, for the camera to follow
+        vec2 player;
+        // agents and bullets around the camera
+        std::vector<RenderInstance> instances;
+        // every wall, shared between snapshots until the terrain changes
+        std::shared_ptr<const std::vector<RenderInstance>> walls;
+        // the tile layer, shared between snapshots until its revision changes; null without one
+        std::shared_ptr<const TileMap> tilemap;
+    };
+
+    // What a front-end talks to: a Match in the process, or a connection to a server running one
+    class MatchView {
+    public:
+        virtual ~MatchView() = default;
+
+        virtual const std::string &getFolder() const = 0;
+
+        // From the render thread
+        virtual bool submit(const InputCommand &cmd) = 0;
+
+        // From the render thread, task runs on the simulation thread before the next tick.
+        // False when there is no simulation in this process.
+        virtual bool post(std::function<void(World &)> task) = 0;
+
+        // From the render thread, the area the next snapshots should cover
+        virtual void setCamera(const CameraRect &rect) = 0;
+
+        // From the render thread, the newest snapshot
+        virtual const RenderSnapshot &latest() = 0;
+
+        virtual Profiler &getProfiler() = 0;
+
+        // From the render thread, goes back ticks before the next one. False when the view
+        // keeps no history.
+        virtual bool rewind(uint32_t ticks) {
+            return false;
+        }
+    };
+
+    /**
+     * One game on one map folder: the world, its Logic, and a Lua AI for every agent that
+     * asks for one. Ticks are fixed steps at the TimeServer rate, run by advance() from real
+     * time, and start() does that on a thread of its own. After each tick a RenderSnapshot is
+     * published for the render thread, which sends InputCommands and tasks back through
+     * single producer queues. The two threads never wait for each other.
+     */
+    class Match : public ECSSystem, public MatchView {
+        std::string folder;
+        Logic *logic;
+        TimeServer *timeserver;
+        AISystem *ai_system;
+        ControlSystem *control_system;
+        RenderSystem *render_system;
+        EventSystem *event_system;
+        int player_id;
+        FixedTimestep timestep;
+        // a section per system in foreach order; counters are the component sizes, then the gauges below
+        Profiler profiler;
+        size_t counter_entities, counter_events, counter_requests, counter_dropped, counter_lua, counter_rollback;
+
+        TripleBuffer<RenderSnapshot> snapshots;
+        std::shared_ptr<const std::vector<RenderInstance>> walls;
+        size_t walls_version = ~size_t(0);
+        std::shared_ptr<const TileMap> tilemap;
+        // left, bottom, right, top of the last camera; a torn update is off by one frame at most
+        std::atomic<float> camera[4];
+        SPSCQueue<std::function<void(World &)>, 64> tasks;
+
+        std::thread thread;
+        std::atomic<bool> running{false};
+        bool publishing = true;
+        ReplayRecorder *recorder = nullptr;
+        RollbackBuffer *history = nullptr;
+        // ticks to go back before the next one, from the render thread
+        std::atomic<uint32_t> rewinding{0};
+
+        void publish();
+
+        // After the world was replaced under the systems
+        void restarted();
+
+        void measure();
+
+    public:
+        using ECSSystem::getWorld;
+
+        Match(const std::string &folder, int player_id = 1);
+
+        ~Match() override;
+
+        // Gives Lua AIs to new agents and runs the posted tasks, before the rest of the tick
+        void update(float delta) override;
+
+        // Initializes every system, on the thread that is going to run the ticks
+        void prepare();
+
+        // Runs one tick on the calling thread
+        void step();
+
+        // Runs the ticks that are due after elapsed seconds of real time, returns how many ran
+        int advance(float elapsed);
+
+        // Ticks per second; from the render thread once started
+        void setTickRate(float rate);
+
+        // Seconds between ticks
+        float getTickInterval() const {
+            return timestep.getStep();
+        }
+
+        // Without a front-end nothing reads the snapshots, step() can skip them
+        void setPublishing(bool enabled) {
+            publishing = enabled;
+        }
+
+        // Writes every tick to recorder, nullptr to stop; not while started
+        void setRecorder(ReplayRecorder *recorder_) {
+            recorder = recorder_;
+        }
+
+        // Keeps every tick in history, nullptr to stop; not while started
+        void setHistory(RollbackBuffer *history_) {
+            history = history_;
+        }
+
+        // Goes back to the state after tick from history, on the thread running the ticks. Lua
+        // AIs start over as in restore(). False when history no longer holds it.
+        bool rollback(uint32_t tick);
+
+        // Appends the state of the match at the current tick: the world, see saveWorld, the random
+        // streams and the influence layers
+        void save(ByteWriter &out);
+
+        // Goes back or forth to a state from save(), on the thread running the ticks. Lua AIs start
+        // over since their scripts cannot be saved. False when the image is malformed.
+        bool restore(ByteReader &in);
+
+        void start();
+
+        void stop();
+
+        bool isRunning() const {
+            return running;
+        }
+
+        const std::string &getFolder() const override {
+            return folder;
+        }
+
+        // Enabled from any thread; samples are read from a single one
+        Profiler &getProfiler() override {
+            return profiler;
+        }
+
+        bool submit(const InputCommand &cmd) override;
+
+        bool post(std::function<void(World &)> task) override;
+
+        void setCamera(const CameraRect &rect) override;
+
+        const RenderSnapshot &latest() override;
+
+        // Never while recording, a recording holds every tick once
+        bool rewind(uint32_t ticks) override;
+    };
+}
+
+#endif //ESCAPE_MATCH_H
@@ -0,0 +1,138 @@
+#include "match_scheduler.h"
+#include <algorithm>
+#include <iostream>
+#include "engine/thread_pool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace Escape {
+    MatchScheduler::MatchScheduler(size_t threads, bool pin) : pin(pin) {
+        for (size_t i = 0; i < std::max<size_t>(threads, 1); ++i)
+            workers.push_back(std::make_unique<Worker>());
+    }
+
+    MatchScheduler::~MatchScheduler() {
+        stop();
+    }
+
+    size_t MatchScheduler::add(std::unique_ptr<Match> match) {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto least = std::min_element(workers.begin(), workers.end(), [](auto &a, auto &b) {
+            return a->load < b->load;
+        });
+        auto slot = std::make_unique<Slot>();
+        slot->match = std::move(match);
+        slot->match->setPublishing(false);
+        slot->worker = least - workers.begin();
+        slot->interval = std::chrono::duration_cast<clock_type::duration>(
+                std::chrono::duration<float>(slot->match->getTickInterval()));
+        Worker &worker = **least;
+        ++worker.load;
+        {
+            std::lock_guard<std::mutex> inbox_lock(worker.mutex);
+            worker.inbox.push_back(slot.get());
+        }
+        slots.push_back(std::move(slot));
+        return slots.size() - 1;
+    }
+
+    void MatchScheduler::start() {
+        if (running)
+            return;
+        running = true;
+        for (size_t i = 0; i < workers.size(); ++i) {
+            workers[i]->thread = std::thread([this, i] { run(i); });
+#if defined(__linux__)
+            if (pin) {
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(i % std::max(std::thread::hardware_concurrency(), 1u), &set);
+                if (pthread_setaffinity_np(workers[i]->thread.native_handle(), sizeof(set), &set) != 0)
+                    std::cerr << "Cannot pin worker " << i << std::endl;
+            }
+#endif
+        }
+    }
+
+    void MatchScheduler::stop() {
+        running = false;
+        for (auto &worker : workers) {
+            if (worker->thread.joinable())
+                worker->thread.join();
+        }
+    }
+
+    void MatchScheduler::run(size_t index) {
+        Worker &worker = *workers[index];
+        // the core is taken, parallel loops inside the systems run here
+        ThreadPool::setInline(true);
+        auto later = [](Slot *a, Slot *b) {
+            return a->deadline > b->deadline;
+        };
+        // earliest deadline on top
+        std::vector<Slot *> queue, arrived;
+        while (running) {
+            {
+                std::lock_guard<std::mutex> lock(worker.mutex);
+                arrived.swap(worker.inbox);
+            }
+            for (Slot *slot : arrived) {
+                slot->match->prepare();
+                slot->deadline = clock_type::now() + slot->interval;
+                queue.push_back(slot);
+                std::push_heap(queue.begin(), queue.end(), later);
+            }
+            arrived.clear();
+            if (queue.empty()) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+
+            std::pop_heap(queue.begin(), queue.end(), later);
+            Slot *slot = queue.back();
+            // a tick runs once its interval has passed, its deadline is the end of the next one
+            auto due = slot->deadline - slot->interval;
+            if (clock_type::now() < due) {
+                std::this_thread::sleep_until(std::min(due, clock_type::now() + std::chrono::milliseconds(1)));
+                std::push_heap(queue.begin(), queue.end(), later);
+                continue;
+            }
+            auto begin = clock_type::now();
+            slot->match->step();
+            auto end = clock_type::now();
+
+            int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count();
+            slot->ticks.fetch_add(1, std::memory_order_relaxed);
+            slot->total_ns.fetch_add(ns, std::memory_order_relaxed);
+            if (ns > slot->max_ns.load(std::memory_order_relaxed))
+                slot->max_ns.store(ns, std::memory_order_relaxed);
+            if (end > slot->deadline)
+                slot->missed.fetch_add(1, std::memory_order_relaxed);
+            slot->deadline += slot->interval;
+            if (end > slot->deadline + MAX_LAG * slot->interval)
+                slot->deadline = end + slot->interval;
+            std::push_heap(queue.begin(), queue.end(), later);
+        }
+    }
+
+    size_t MatchScheduler::size() const {
+        std::lock_guard<std::mutex> lock(mutex);
+        return slots.size();
+    }
+
+    MatchStats MatchScheduler::getStats(size_t index) const {
+        std::lock_guard<std::mutex> lock(mutex);
+        const Slot &slot = *slots[index];
+        size_t ticks = slot.ticks.load(std::memory_order_relaxed);
+        double total_ms = slot.total_ns.load(std::memory_order_relaxed) / 1e6;
+        return MatchStats{slot.worker,
+                          ticks,
+                          slot.missed.load(std::memory_order_relaxed),
+                          total_ms,
+                          ticks > 0 ? (float) (total_ms / ticks) : 0,
+                          slot.max_ns.load(std::memory_order_relaxed) / 1e6f};
+    }
+}
@@ -0,0 +1,83 @@
+#ifndef ESCAPE_MATCH_SCHEDULER_H
+#define ESCAPE_MATCH_SCHEDULER_H
+
+#include <atomic>
+#include <chrono>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "match.h"
+
+namespace Escape {
+    struct MatchStats {
+        size_t worker;
+        size_t ticks;
+        // ticks that ended more than one interval after they were due
+        size_t missed;
+        // all since the match was added; a mean over an interval is the difference of total_ms
+        // between two reads over that of ticks
+        double total_ms;
+        float mean_ms, max_ms;
+    };
+
+    /**
+     * Many headless matches in one process. Every worker thread owns a core and the matches
+     * given to it, and ticks them in the order of their deadlines; workers share nothing
+     * after a match was handed over. A worker that falls more than MAX_LAG ticks behind a
+     * match drops the backlog instead of catching up.
+     */
+    class MatchScheduler {
+        typedef std::chrono::steady_clock clock_type;
+
+        struct Slot {
+            std::unique_ptr<Match> match;
+            size_t worker;
+            clock_type::duration interval;
+            clock_type::time_point deadline;
+            // written by the worker, read by anyone
+            std::atomic<size_t> ticks{0}, missed{0};
+            std::atomic<int64_t> total_ns{0}, max_ns{0};
+        };
+
+        struct Worker {
+            std::thread thread;
+            std::mutex mutex;
+            // handed over but not yet taken by the worker
+            std::vector<Slot *> inbox;
+            size_t load = 0;
+        };
+
+        std::vector<std::unique_ptr<Worker>> workers;
+        mutable std::mutex mutex;
+        std::vector<std::unique_ptr<Slot>> slots;
+        std::atomic<bool> running{false};
+        bool pin;
+
+        void run(size_t index);
+
+    public:
+        static constexpr int MAX_LAG = 5;
+
+        explicit MatchScheduler(size_t threads = std::max(std::thread::hardware_concurrency(), 1u), bool pin = true);
+
+        ~MatchScheduler();
+
+        // Gives the match to the worker with the fewest, returns its index for getStats
+        size_t add(std::unique_ptr<Match> match);
+
+        void start();
+
+        void stop();
+
+        size_t size() const;
+
+        size_t getWorkerCount() const {
+            return workers.size();
+        }
+
+        MatchStats getStats(size_t index) const;
+    };
+}
+
+#endif //ESCAPE_MATCH_SCHEDULER_H
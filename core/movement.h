@@ -0,0 +1,35 @@
+#ifndef ESCAPE_MOVEMENT_MODEL_H
+#define ESCAPE_MOVEMENT_MODEL_H
+
+#include <cmath>
+#include "components.h"
+#include "config.h"
+
+namespace Escape {
+    /**
+     * How an agent moves when nothing is in its way, shared by the simulation and by clients
+     * predicting their own agent. A tick first integrates the velocity, damped the way Box2D
+     * does it, then adds the impulse of the input that was applied during the tick.
+     */
+    namespace Movement {
+        // Velocity change asked for by a movement input, its direction is clamped to a length of 1
+        inline vec2 impulse(float move_x, float move_y) {
+            vec2 vel(move_x, move_y);
+            float spd = std::sqrt(vel.x * vel.x + vel.y * vel.y);
+            if (spd == 0)
+                return vec2(0, 0);
+            if (spd > 1)
+                vel /= spd;
+            vel *= AGENT_IMPULSE;
+            return vel;
+        }
+
+        // One step of the agent body, as b2World::Step integrates it
+        inline void integrate(vec2 &position, vec2 &velocity, float delta) {
+            velocity *= 1.0f / (1.0f + delta * AGENT_DAMPING);
+            position += velocity * delta;
+        }
+    }
+}
+
+#endif //ESCAPE_MOVEMENT_MODEL_H
@@ -0,0 +1,224 @@
+#include "net_client.h"
+#include <algorithm>
+#include <cmath>
+#include "movement.h"
+
+namespace Escape {
+    SnapshotClient::SnapshotClient(const std::string &folder) : folder(folder) {
+        auto data = MapConverter::load(folder);
+        auto walls = std::make_shared<std::vector<RenderInstance>>();
+        for (auto &wall : data->walls)
+            walls->push_back(RenderInstance{entt::null, RenderKind::WALL, vec2(wall.x, wall.y), 0,
+                                            vec2(wall.width, wall.height), 1, -1});
+        snapshot.walls = walls;
+        snapshot.tilemap = std::make_shared<const TileMap>(data->tilemap);
+        snapshot.delta = tick_interval;
+        counter_compared = profiler.addCounter("inputs compared");
+        counter_corrections = profiler.addCounter("corrections");
+        counter_error = profiler.addCounter("error mm");
+        counter_unacked = profiler.addCounter("unacked inputs");
+    }
+
+    bool SnapshotClient::connect(const NetAddress &address) {
+        server = address;
+        if (!socket.open())
+            return false;
+        asked = clock_type::now();
+        size_t size = Net::encodeConnect(buffer, sizeof(buffer));
+        return link.send(server, buffer, size);
+    }
+
+    bool SnapshotClient::submit(const InputCommand &cmd) {
+        if (player_id == 0)
+            return false;
+        // frames come faster than ticks, a shot or a weapon change must survive until the next one
+        bool shooting = command.shooting || cmd.shooting;
+        int weapon = cmd.weapon >= 0 ? cmd.weapon : command.weapon;
+        command = cmd;
+        command.shooting = shooting;
+        command.weapon = weapon;
+        return true;
+    }
+
+    void SnapshotClient::replay(uint32_t acked) {
+        for (uint32_t s = acked + 1; s <= sequence; ++s) {
+            Prediction &prediction = pending[s % PREDICTION];
+            Movement::integrate(position, velocity, tick_interval);
+            velocity += Movement::impulse(prediction.command.move_x, prediction.command.move_y);
+            prediction.position = position;
+            prediction.velocity = velocity;
+        }
+    }
+
+    void SnapshotClient::reconcile(const NetSnapshot &received) {
+        if (!received.has_player) {
+            predicting = false;
+            return;
+        }
+        vec2 server_position(Net::dequantizePosition(received.player_x), Net::dequantizePosition(received.player_y));
+        vec2 server_velocity(Net::dequantizePosition(received.player_vx), Net::dequantizePosition(received.player_vy));
+        uint32_t acked = received.input_sequence;
+        bool replayable = acked <= sequence && sequence - acked < PREDICTION;
+
+        // a new agent or nothing left to compare with, start over from the server's state
+        if (!predicting || received.player_entity != player_entity || !replayable) {
+            predicting = true;
+            player_entity = received.player_entity;
+            position = server_position;
+            velocity = server_velocity;
+            offset = vec2(0, 0);
+            reconciled = acked;
+            if (replayable)
+                replay(acked);
+            return;
+        }
+        // the server ticked without a new input of ours, there is no prediction for that state
+        if (acked <= reconciled)
+            return;
+        reconciled = acked;
+
+        const Prediction &predicted = pending[acked % PREDICTION];
+        float dx = server_position.x - predicted.position.x, dy = server_position.y - predicted.position.y;
+        float error = std::sqrt(dx * dx + dy * dy);
+        ++compared;
+        error_sum += error;
+        error_max = std::max(error_max, error);
+        error_last = error;
+        if (error <= TOLERANCE)
+            return;
+
+        ++corrections;
+        vec2 shown = position + offset;
+        position = server_position;
+        velocity = server_velocity;
+        replay(acked);
+        offset = vec2(shown.x - position.x, shown.y - position.y);
+    }
+
+    void SnapshotClient::accept(const uint8_t *data, size_t size) {
+        uint32_t tick, baseline_tick;
+        if (!Net::peekSnapshot(data, size, tick, baseline_tick))
+            return;
+        // late packets are older than what is on screen
+        if (newest != Net::NO_TICK && tick <= newest)
+            return;
+        const NetSnapshot *baseline = nullptr;
+        if (baseline_tick != Net::NO_TICK) {
+            baseline = &history[baseline_tick % HISTORY];
+            if (baseline->tick != baseline_tick)
+                return;
+        }
+        if (!Net::decodeSnapshot(data, size, baseline, scratch))
+            return;
+        std::swap(history[tick % HISTORY], scratch);
+        newest = tick;
+
+        reconcile(history[tick % HISTORY]);
+        fresh = true;
+    }
+
+    void SnapshotClient::step() {
+        ++sequence;
+        InputCommand cmd = command;
+        cmd.player_id = player_id;
+        command.shooting = false;
+        command.weapon = -1;
+
+        if (predicting) {
+            Movement::integrate(position, velocity, tick_interval);
+            velocity += Movement::impulse(cmd.move_x, cmd.move_y);
+            offset *= SMOOTHING;
+        }
+        pending[sequence % PREDICTION] = Prediction{sequence, cmd, position, velocity};
+        // from the oldest the newest snapshot did not acknowledge
+        uint32_t acked = newest != Net::NO_TICK ? history[newest % HISTORY].input_sequence : 0;
+        uint32_t first = std::max(acked + 1, sequence > REDUNDANCY ? sequence - REDUNDANCY + 1 : 1);
+        input.ack = newest;
+        input.sequence = sequence;
+        input.camera = camera;
+        input.commands.clear();
+        for (uint32_t s = std::min(first, sequence); s <= sequence; ++s)
+            input.commands.push_back(pending[s % PREDICTION].command);
+        size_t size = Net::encodeInput(input, buffer, sizeof(buffer));
+        link.send(server, buffer, size);
+
+        if (profiler.isEnabled()) {
+            profiler.begin(sequence);
+            profiler.count(counter_compared, (double) compared);
+            profiler.count(counter_corrections, (double) corrections);
+            profiler.count(counter_error, error_last * 1000);
+            profiler.count(counter_unacked, (double) (sequence - reconciled));
+            profiler.end();
+        }
+    }
+
+    void SnapshotClient::publish() {
+        fresh = false;
+        if (newest == Net::NO_TICK)
+            return;
+        const NetSnapshot &received = history[newest % HISTORY];
+        // counts frames to draw, client ticks and snapshots alike
+        ++snapshot.tick;
+        snapshot.delta = tick_interval;
+        snapshot.has_player = received.has_player;
+        vec2 shown = position + offset;
+        if (received.has_player)
+            snapshot.player = predicting ? shown : vec2(Net::dequantizePosition(received.player_x),
+                                                        Net::dequantizePosition(received.player_y));
+        snapshot.instances.clear();
+        for (auto &entity : received.entities) {
+            snapshot.instances.push_back(Net::dequantize(entity));
+            if (predicting && entity.id == player_entity)
+                snapshot.instances.back().position = shown;
+        }
+    }
+
+    void SnapshotClient::receive() {
+        NetAddress from;
+        uint8_t packet[UdpSocket::MAX_PACKET];
+        size_t size;
+        while ((size = socket.receive(from, packet, sizeof(packet))) > 0) {
+            if (!(from == server))
+                continue;
+            uint8_t type = Net::peekType(packet, size);
+            if (type == (uint8_t) PacketType::WELCOME) {
+                WelcomePacket welcome;
+                if (Net::decodeWelcome(packet, size, welcome)) {
+                    player_id = welcome.player_id;
+                    tick_interval = welcome.tick_interval;
+                    timestep.setStep(tick_interval);
+                    stepped = clock_type::now();
+                }
+            } else if (type == (uint8_t) PacketType::SNAPSHOT) {
+                accept(packet, size);
+            }
+        }
+    }
+
+    const RenderSnapshot &SnapshotClient::latest() {
+        receive();
+        auto now = clock_type::now();
+        if (player_id == 0 && std::chrono::duration<float>(now - asked).count() > RETRY) {
+            asked = now;
+            size_t size = Net::encodeConnect(buffer, sizeof(buffer));
+            link.send(server, buffer, size);
+        }
+        if (player_id != 0) {
+            int steps = timestep.advance(std::chrono::duration<float>(now - stepped).count());
+            stepped = now;
+            for (int i = 0; i < steps; ++i)
+                step();
+            fresh = fresh || steps > 0;
+        }
+        if (fresh)
+            publish();
+        link.flush();
+        return snapshot;
+    }
+
+    void SnapshotClient::report(std::ostream &out) const {
+        out << "prediction: " << compared << " inputs compared, " << corrections << " corrected, error mean "
+            << (compared > 0 ? error_sum / compared : 0) << " max " << error_max << " last " << error_last << ", "
+            << sequence - reconciled << " inputs unacknowledged" << std::endl;
+    }
+}
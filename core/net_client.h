@@ -0,0 +1,143 @@
+#ifndef ESCAPE_NET_CLIENT_H
+#define ESCAPE_NET_CLIENT_H
+
+#include <chrono>
+#include <memory>
+#include <ostream>
+#include "match.h"
+#include "engine/fixed_timestep.h"
+#include "net_protocol.h"
+#include "map_converter.h"
+#include "engine/udp_socket.h"
+
+namespace Escape {
+    /**
+     * A front-end's side of a SnapshotServer: input goes out, snapshots come in and are
+     * rebuilt against the ones held before. Walls and tiles come from the local copy of the
+     * map folder. Everything runs on the render thread, from submit() and latest().
+     *
+     * The local agent is predicted: the client ticks at the server's rate, makes one input per
+     * tick and moves the agent right away with the shared movement model. Every packet repeats
+     * the last REDUNDANCY inputs the server has not acknowledged, a lost one is not a lost move. Snapshots carry the
+     * newest input the server applied; the prediction made for it is compared with the server's
+     * position and, when they disagree, the inputs still in flight are replayed from the
+     * server's state. The visual jump of a correction is blended out over a few ticks.
+     */
+    class SnapshotClient : public MatchView {
+        typedef std::chrono::steady_clock clock_type;
+
+    public:
+        static constexpr size_t HISTORY = 32;
+        // seconds between CONNECT packets until the server answers
+        static constexpr float RETRY = 0.5f;
+        // inputs kept for replaying, at sequence % PREDICTION
+        static constexpr size_t PREDICTION = 128;
+        // inputs in a packet at most
+        static constexpr uint32_t REDUNDANCY = 4;
+        // world units the prediction may be off before it is corrected, above the quantization step
+        static constexpr float TOLERANCE = 0.05f;
+        // part of a correction's visual jump still shown a tick later
+        static constexpr float SMOOTHING = 0.85f;
+
+    private:
+        // An input sent to the server and where the agent was predicted to be after it
+        struct Prediction {
+            uint32_t sequence = 0;
+            InputCommand command;
+            vec2 position, velocity;
+        };
+
+        std::string folder;
+        NetAddress server;
+        UdpSocket socket;
+        LossyLink link{socket};
+        int player_id = 0;
+        float tick_interval = 1 / 60.0f;
+        clock_type::time_point asked;
+
+        // what was received, at tick % HISTORY
+        NetSnapshot history[HISTORY];
+        NetSnapshot scratch;
+        uint32_t newest = Net::NO_TICK;
+        CameraRect camera{0, 0, 0, 0};
+
+        // input collected from the frames since the last client tick
+        InputCommand command{};
+        FixedTimestep timestep{1 / 60.0f};
+        clock_type::time_point stepped;
+        Prediction pending[PREDICTION];
+        uint32_t sequence = 0;
+        // newest input sequence a snapshot was compared against
+        uint32_t reconciled = 0;
+        bool predicting = false;
+        uint32_t player_entity = 0;
+        vec2 position, velocity;
+        // what is drawn minus what is predicted, shrinks every tick
+        vec2 offset;
+        // snapshot arrived since the RenderSnapshot was built
+        bool fresh = false;
+
+        size_t compared = 0, corrections = 0;
+        float error_sum = 0, error_max = 0, error_last = 0;
+        size_t counter_compared, counter_corrections, counter_error, counter_unacked;
+
+        RenderSnapshot snapshot;
+        Profiler profiler;
+        uint8_t buffer[UdpSocket::MAX_PACKET];
+        InputPacket input;
+
+        void receive();
+
+        void accept(const uint8_t *data, size_t size);
+
+        void reconcile(const NetSnapshot &received);
+
+        void replay(uint32_t acked);
+
+        void step();
+
+        void publish();
+
+    public:
+        explicit SnapshotClient(const std::string &folder);
+
+        bool connect(const NetAddress &address);
+
+        // Loss and latency of everything the client sends
+        LossyLink &getLink() {
+            return link;
+        }
+
+        // 0 until the server answered
+        int getPlayerId() const {
+            return player_id;
+        }
+
+        const std::string &getFolder() const override {
+            return folder;
+        }
+
+        bool submit(const InputCommand &cmd) override;
+
+        // Debugging tasks cannot reach a remote world
+        bool post(std::function<void(World &)> task) override {
+            return false;
+        }
+
+        void setCamera(const CameraRect &rect) override {
+            camera = rect;
+        }
+
+        const RenderSnapshot &latest() override;
+
+        // Client ticks, with the prediction error as counters
+        Profiler &getProfiler() override {
+            return profiler;
+        }
+
+        // Prediction error and corrections so far
+        void report(std::ostream &out) const;
+    };
+}
+
+#endif //ESCAPE_NET_CLIENT_H
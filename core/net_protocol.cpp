@@ -0,0 +1,374 @@
+#include "net_protocol.h"
+#include <algorithm>
+#include <cmath>
+#include "engine/bit_stream.h"
+
+namespace Escape {
+    namespace Net {
+        static const int KIND_BITS = 3, ANGLE_BITS = 8, HEALTH_BITS = 7, SIZE_BITS = 8, GROUP_BITS = 5;
+        static const int SMALL_GAP_BITS = 6;
+
+        int32_t quantizePosition(float v) {
+            const int32_t limit = (1 << (POSITION_BITS - 1)) - 1;
+            return std::min(std::max((int32_t) std::lround(v * POSITION_SCALE), -limit), limit);
+        }
+
+        float dequantizePosition(int32_t v) {
+            return v / POSITION_SCALE;
+        }
+
+        NetEntity quantize(const RenderInstance &inst) {
+            float turns = inst.radian / (2 * (float) M_PI);
+            turns -= std::floor(turns);
+            return NetEntity{(uint32_t) entt::to_integral(inst.ent),
+                             (uint8_t) inst.kind,
+                             quantizePosition(inst.position.x),
+                             quantizePosition(inst.position.y),
+                             (uint8_t) ((int) std::lround(turns * 256) & 255),
+                             (uint8_t) std::lround(std::min(std::max(inst.health, 0.0f), 1.0f) * HEALTH_STEPS),
+                             (uint8_t) std::min(std::lround(inst.size.x * SIZE_SCALE), 255l),
+                             (int8_t) std::min(std::max(inst.group, -1), (1 << (GROUP_BITS - 1)) - 1)};
+        }
+
+        RenderInstance dequantize(const NetEntity &entity) {
+            float diameter = entity.size / SIZE_SCALE;
+            return RenderInstance{(entt::entity) entity.id,
+                                  (RenderKind) entity.kind,
+                                  vec2(dequantizePosition(entity.x), dequantizePosition(entity.y)),
+                                  entity.angle / 256.0f * 2 * (float) M_PI,
+                                  vec2(diameter, diameter),
+                                  (float) entity.health / HEALTH_STEPS,
+                                  entity.group};
+        }
+
+        static void writeHeader(BitWriter &writer, PacketType type) {
+            writer.write(MAGIC, 16);
+            writer.write((uint32_t) type, 8);
+        }
+
+        static bool readHeader(BitReader &reader, PacketType type) {
+            return reader.read(16) == MAGIC && reader.read(8) == (uint32_t) type;
+        }
+
+        uint8_t peekType(const uint8_t *data, size_t size) {
+            BitReader reader(data, size);
+            if (reader.read(16) != MAGIC)
+                return 0;
+            uint32_t type = reader.read(8);
+            return reader.overflowed() ? 0 : (uint8_t) type;
+        }
+
+        size_t encodeConnect(uint8_t *out, size_t capacity) {
+            BitWriter writer(out, capacity);
+            writeHeader(writer, PacketType::CONNECT);
+            return writer.overflowed() ? 0 : writer.size();
+        }
+
+        size_t encodeWelcome(const WelcomePacket &packet, uint8_t *out, size_t capacity) {
+            BitWriter writer(out, capacity);
+            writeHeader(writer, PacketType::WELCOME);
+            writer.write((uint32_t) packet.player_id, 8);
+            writer.writeFloat(packet.tick_interval);
+            return writer.overflowed() ? 0 : writer.size();
+        }
+
+        bool decodeWelcome(const uint8_t *data, size_t size, WelcomePacket &packet) {
+            BitReader reader(data, size);
+            if (!readHeader(reader, PacketType::WELCOME))
+                return false;
+            packet.player_id = (int) reader.read(8);
+            packet.tick_interval = reader.readFloat();
+            return !reader.overflowed();
+        }
+
+        static void writeCommand(BitWriter &writer, const InputCommand &cmd) {
+            // directions are clamped to a length of 1 anyway
+            writer.writeSigned((int32_t) std::lround(std::min(std::max(cmd.move_x, -1.0f), 1.0f) * 127), 8);
+            writer.writeSigned((int32_t) std::lround(std::min(std::max(cmd.move_y, -1.0f), 1.0f) * 127), 8);
+            writer.writeBool(cmd.shooting);
+            if (cmd.shooting) {
+                writer.writeSigned(quantizePosition(cmd.aim_x), POSITION_BITS);
+                writer.writeSigned(quantizePosition(cmd.aim_y), POSITION_BITS);
+            }
+            writer.writeSigned(cmd.weapon, 4);
+        }
+
+        // player_id is left to the caller, it is known from who sent the packet
+        static void readCommand(BitReader &reader, InputCommand &cmd) {
+            cmd.player_id = 0;
+            cmd.move_x = reader.readSigned(8) / 127.0f;
+            cmd.move_y = reader.readSigned(8) / 127.0f;
+            cmd.shooting = reader.readBool();
+            cmd.aim_x = cmd.aim_y = 0;
+            if (cmd.shooting) {
+                cmd.aim_x = dequantizePosition(reader.readSigned(POSITION_BITS));
+                cmd.aim_y = dequantizePosition(reader.readSigned(POSITION_BITS));
+            }
+            cmd.weapon = reader.readSigned(4);
+        }
+
+        InputCommand quantize(const InputCommand &cmd) {
+            uint8_t bytes[16];
+            BitWriter writer(bytes, sizeof(bytes));
+            writeCommand(writer, cmd);
+            BitReader reader(bytes, writer.size());
+            InputCommand out;
+            readCommand(reader, out);
+            out.player_id = cmd.player_id;
+            return out;
+        }
+
+        size_t encodeLockstep(const LockstepPacket &packet, uint8_t *out, size_t capacity) {
+            BitWriter writer(out, capacity);
+            writeHeader(writer, PacketType::LOCKSTEP);
+            if (packet.commands.size() >= (1u << BATCH_BITS))
+                return 0;
+            writer.write((uint32_t) packet.player_id, 8);
+            writer.write(packet.ack, 32);
+            writer.write(packet.first, 32);
+            writer.write((uint32_t) packet.commands.size(), BATCH_BITS);
+            for (auto &cmd : packet.commands)
+                writeCommand(writer, cmd);
+            writer.write(packet.hash_tick, 32);
+            writer.write((uint32_t) (packet.hash >> 32), 32);
+            writer.write((uint32_t) packet.hash, 32);
+            return writer.overflowed() ? 0 : writer.size();
+        }
+
+        bool decodeLockstep(const uint8_t *data, size_t size, LockstepPacket &packet) {
+            BitReader reader(data, size);
+            if (!readHeader(reader, PacketType::LOCKSTEP))
+                return false;
+            packet.player_id = (int) reader.read(8);
+            packet.ack = reader.read(32);
+            packet.first = reader.read(32);
+            packet.commands.resize(reader.read(BATCH_BITS));
+            for (auto &cmd : packet.commands) {
+                readCommand(reader, cmd);
+                cmd.player_id = packet.player_id;
+            }
+            packet.hash_tick = reader.read(32);
+            packet.hash = (uint64_t) reader.read(32) << 32;
+            packet.hash |= reader.read(32);
+            return !reader.overflowed();
+        }
+
+        size_t encodeInput(const InputPacket &packet, uint8_t *out, size_t capacity) {
+            BitWriter writer(out, capacity);
+            writeHeader(writer, PacketType::INPUT);
+            if (packet.commands.empty() || packet.commands.size() >= (1u << BATCH_BITS) ||
+                packet.commands.size() > packet.sequence)
+                return 0;
+            writer.write(packet.ack, 32);
+            writer.write(packet.sequence, 32);
+            writer.write((uint32_t) packet.commands.size(), BATCH_BITS);
+            for (auto &cmd : packet.commands)
+                writeCommand(writer, cmd);
+            writer.writeSigned(quantizePosition(packet.camera.left), POSITION_BITS);
+            writer.writeSigned(quantizePosition(packet.camera.bottom), POSITION_BITS);
+            writer.writeSigned(quantizePosition(packet.camera.right), POSITION_BITS);
+            writer.writeSigned(quantizePosition(packet.camera.top), POSITION_BITS);
+            return writer.overflowed() ? 0 : writer.size();
+        }
+
+        bool decodeInput(const uint8_t *data, size_t size, InputPacket &packet) {
+            BitReader reader(data, size);
+            if (!readHeader(reader, PacketType::INPUT))
+                return false;
+            packet.ack = reader.read(32);
+            packet.sequence = reader.read(32);
+            packet.commands.resize(reader.read(BATCH_BITS));
+            for (auto &cmd : packet.commands)
+                readCommand(reader, cmd);
+            if (packet.commands.empty() || packet.commands.size() > packet.sequence)
+                return false;
+            packet.camera.left = dequantizePosition(reader.readSigned(POSITION_BITS));
+            packet.camera.bottom = dequantizePosition(reader.readSigned(POSITION_BITS));
+            packet.camera.right = dequantizePosition(reader.readSigned(POSITION_BITS));
+            packet.camera.top = dequantizePosition(reader.readSigned(POSITION_BITS));
+            return !reader.overflowed();
+        }
+
+        static void writeFull(BitWriter &writer, const NetEntity &e) {
+            writer.write(e.kind, KIND_BITS);
+            writer.writeSigned(e.x, POSITION_BITS);
+            writer.writeSigned(e.y, POSITION_BITS);
+            writer.write(e.angle, ANGLE_BITS);
+            writer.write(e.health, HEALTH_BITS);
+            writer.write(e.size, SIZE_BITS);
+            writer.writeSigned(e.group, GROUP_BITS);
+        }
+
+        static void readFull(BitReader &reader, NetEntity &e) {
+            e.kind = (uint8_t) reader.read(KIND_BITS);
+            e.x = reader.readSigned(POSITION_BITS);
+            e.y = reader.readSigned(POSITION_BITS);
+            e.angle = (uint8_t) reader.read(ANGLE_BITS);
+            e.health = (uint8_t) reader.read(HEALTH_BITS);
+            e.size = (uint8_t) reader.read(SIZE_BITS);
+            e.group = (int8_t) reader.readSigned(GROUP_BITS);
+        }
+
+        static bool fitsDelta(int32_t d) {
+            return d >= -(1 << (DELTA_BITS - 1)) && d < (1 << (DELTA_BITS - 1));
+        }
+
+        // Only the fields that changed, each behind a bit
+        static void writeDelta(BitWriter &writer, const NetEntity &e, const NetEntity &base) {
+            int32_t dx = e.x - base.x, dy = e.y - base.y;
+            writer.writeBool(dx != 0 || dy != 0);
+            if (dx != 0 || dy != 0) {
+                bool small = fitsDelta(dx) && fitsDelta(dy);
+                writer.writeBool(small);
+                writer.writeSigned(small ? dx : e.x, small ? DELTA_BITS : POSITION_BITS);
+                writer.writeSigned(small ? dy : e.y, small ? DELTA_BITS : POSITION_BITS);
+            }
+            writer.writeBool(e.angle != base.angle);
+            if (e.angle != base.angle)
+                writer.write(e.angle, ANGLE_BITS);
+            writer.writeBool(e.health != base.health);
+            if (e.health != base.health)
+                writer.write(e.health, HEALTH_BITS);
+            bool rest = e.size != base.size || e.group != base.group;
+            writer.writeBool(rest);
+            if (rest) {
+                writer.write(e.size, SIZE_BITS);
+                writer.writeSigned(e.group, GROUP_BITS);
+            }
+        }
+
+        static void readDelta(BitReader &reader, NetEntity &e, const NetEntity &base) {
+            e = base;
+            if (reader.readBool()) {
+                bool small = reader.readBool();
+                int32_t x = reader.readSigned(small ? DELTA_BITS : POSITION_BITS);
+                int32_t y = reader.readSigned(small ? DELTA_BITS : POSITION_BITS);
+                e.x = small ? base.x + x : x;
+                e.y = small ? base.y + y : y;
+            }
+            if (reader.readBool())
+                e.angle = (uint8_t) reader.read(ANGLE_BITS);
+            if (reader.readBool())
+                e.health = (uint8_t) reader.read(HEALTH_BITS);
+            if (reader.readBool()) {
+                e.size = (uint8_t) reader.read(SIZE_BITS);
+                e.group = (int8_t) reader.readSigned(GROUP_BITS);
+            }
+        }
+
+        size_t entityBits(const NetEntity &e, const NetEntity *base, uint32_t previous) {
+            size_t bits = 1 + (e.id - previous < (1u << SMALL_GAP_BITS) ? SMALL_GAP_BITS : 32) + 1;
+            if (base == nullptr)
+                return bits + KIND_BITS + 2 * POSITION_BITS + ANGLE_BITS + HEALTH_BITS + SIZE_BITS + GROUP_BITS;
+            int32_t dx = e.x - base->x, dy = e.y - base->y;
+            bits += 4;
+            if (dx != 0 || dy != 0)
+                bits += 1 + 2 * (fitsDelta(dx) && fitsDelta(dy) ? DELTA_BITS : POSITION_BITS);
+            if (e.angle != base->angle)
+                bits += ANGLE_BITS;
+            if (e.health != base->health)
+                bits += HEALTH_BITS;
+            if (e.size != base->size || e.group != base->group)
+                bits += SIZE_BITS + GROUP_BITS;
+            return bits;
+        }
+
+        size_t encodeSnapshot(const NetSnapshot &current, const NetSnapshot *baseline, uint8_t *out,
+                              size_t capacity) {
+            BitWriter writer(out, capacity);
+            writeHeader(writer, PacketType::SNAPSHOT);
+            writer.write(current.tick, 32);
+            writer.write(baseline ? baseline->tick : NO_TICK, 32);
+            writer.writeBool(current.has_player);
+            if (current.has_player) {
+                writer.write(current.player_entity, 32);
+                writer.writeSigned(current.player_x, POSITION_BITS);
+                writer.writeSigned(current.player_y, POSITION_BITS);
+                writer.writeSigned(current.player_vx, POSITION_BITS);
+                writer.writeSigned(current.player_vy, POSITION_BITS);
+                writer.write(current.input_sequence, 32);
+            }
+            if (current.entities.size() >= (1u << COUNT_BITS))
+                return 0;
+            writer.write((uint32_t) current.entities.size(), COUNT_BITS);
+            // entities missing from current are gone, nothing is written for them
+            uint32_t previous = 0;
+            size_t b = 0;
+            for (auto &e : current.entities) {
+                uint32_t gap = e.id - previous;
+                previous = e.id;
+                writer.writeBool(gap < (1u << SMALL_GAP_BITS));
+                writer.write(gap < (1u << SMALL_GAP_BITS) ? gap : e.id, gap < (1u << SMALL_GAP_BITS) ? SMALL_GAP_BITS : 32);
+                const NetEntity *base = nullptr;
+                if (baseline != nullptr) {
+                    while (b < baseline->entities.size() && baseline->entities[b].id < e.id)
+                        ++b;
+                    if (b < baseline->entities.size() && baseline->entities[b].id == e.id &&
+                        baseline->entities[b].kind == e.kind)
+                        base = &baseline->entities[b];
+                }
+                writer.writeBool(base != nullptr);
+                if (base != nullptr)
+                    writeDelta(writer, e, *base);
+                else
+                    writeFull(writer, e);
+            }
+            return writer.overflowed() ? 0 : writer.size();
+        }
+
+        bool peekSnapshot(const uint8_t *data, size_t size, uint32_t &tick, uint32_t &baseline_tick) {
+            BitReader reader(data, size);
+            if (!readHeader(reader, PacketType::SNAPSHOT))
+                return false;
+            tick = reader.read(32);
+            baseline_tick = reader.read(32);
+            return !reader.overflowed();
+        }
+
+        bool decodeSnapshot(const uint8_t *data, size_t size, const NetSnapshot *baseline, NetSnapshot &out) {
+            BitReader reader(data, size);
+            if (!readHeader(reader, PacketType::SNAPSHOT))
+                return false;
+            out.tick = reader.read(32);
+            uint32_t baseline_tick = reader.read(32);
+            if (baseline_tick != NO_TICK && (baseline == nullptr || baseline->tick != baseline_tick))
+                return false;
+            out.has_player = reader.readBool();
+            out.player_entity = 0;
+            out.player_x = out.player_y = out.player_vx = out.player_vy = 0;
+            out.input_sequence = 0;
+            if (out.has_player) {
+                out.player_entity = reader.read(32);
+                out.player_x = reader.readSigned(POSITION_BITS);
+                out.player_y = reader.readSigned(POSITION_BITS);
+                out.player_vx = reader.readSigned(POSITION_BITS);
+                out.player_vy = reader.readSigned(POSITION_BITS);
+                out.input_sequence = reader.read(32);
+            }
+            size_t count = reader.read(COUNT_BITS);
+            out.entities.resize(count);
+            uint32_t previous = 0;
+            size_t b = 0;
+            for (auto &e : out.entities) {
+                bool small = reader.readBool();
+                uint32_t value = reader.read(small ? SMALL_GAP_BITS : 32);
+                e.id = small ? previous + value : value;
+                previous = e.id;
+                if (reader.readBool()) {
+                    if (baseline_tick == NO_TICK)
+                        return false;
+                    while (b < baseline->entities.size() && baseline->entities[b].id < e.id)
+                        ++b;
+                    if (b >= baseline->entities.size() || baseline->entities[b].id != e.id)
+                        return false;
+                    readDelta(reader, e, baseline->entities[b]);
+                } else {
+                    readFull(reader, e);
+                }
+                if (reader.overflowed())
+                    return false;
+            }
+            return !reader.overflowed();
+        }
+    }
+}
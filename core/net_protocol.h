@@ -0,0 +1,133 @@
+#ifndef ESCAPE_NET_PROTOCOL_H
+#define ESCAPE_NET_PROTOCOL_H
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+#include "control.h"
+#include "render.h"
+
+namespace Escape {
+    enum class PacketType : uint8_t {
+        // client asks for a player
+        CONNECT = 1,
+        // server answers with the player id and the tick interval
+        WELCOME,
+        // client input, with the newest snapshot it received
+        INPUT,
+        SNAPSHOT,
+        // lockstep peers, the inputs of the ticks the other side still needs
+        LOCKSTEP
+    };
+
+    // An instance as it goes over the wire, every field quantized
+    struct NetEntity {
+        uint32_t id;
+        uint8_t kind;
+        // 1 / POSITION_SCALE world units
+        int32_t x, y;
+        // 1 / 256 of a turn
+        uint8_t angle;
+        // 0 to HEALTH_STEPS
+        uint8_t health;
+        // diameter in 1 / SIZE_SCALE world units
+        uint8_t size;
+        int8_t group;
+    };
+
+    // What a client sees at one tick; entities are sorted by id so deltas can be merged
+    struct NetSnapshot {
+        uint32_t tick = 0;
+        bool has_player = false;
+        // the receiver's agent, its velocity in 1 / POSITION_SCALE world units per second
+        uint32_t player_entity = 0;
+        int32_t player_x = 0, player_y = 0, player_vx = 0, player_vy = 0;
+        // newest input of the receiver applied by this tick, 0 for none
+        uint32_t input_sequence = 0;
+        std::vector<NetEntity> entities;
+    };
+
+    struct InputPacket {
+        // newest snapshot tick the client holds, NO_TICK before the first
+        uint32_t ack;
+        // counts up from 1, one per client tick; the sequence of the last command
+        uint32_t sequence;
+        // the newest inputs the server may not have yet, oldest first, so a lost packet costs nothing
+        std::vector<InputCommand> commands;
+        CameraRect camera;
+    };
+
+    // A lockstep peer's inputs for the ticks from first on, and the hash of its world after hash_tick
+    struct LockstepPacket {
+        int player_id;
+        // first tick of the receiver's inputs the sender is missing
+        uint32_t ack;
+        uint32_t first;
+        std::vector<InputCommand> commands;
+        // NO_TICK before the sender ran a tick
+        uint32_t hash_tick;
+        uint64_t hash;
+    };
+
+    struct WelcomePacket {
+        int player_id;
+        float tick_interval;
+    };
+
+    namespace Net {
+        constexpr uint16_t MAGIC = 0xE5C1;
+        constexpr uint32_t NO_TICK = ~0u;
+        constexpr float POSITION_SCALE = 64;
+        constexpr float SIZE_SCALE = 16;
+        constexpr int POSITION_BITS = 20;
+        // a moved entity whose step fits in DELTA_BITS is sent as the step only
+        constexpr int DELTA_BITS = 10;
+        constexpr int HEALTH_STEPS = 127;
+        constexpr int COUNT_BITS = 10;
+        // up to 31 commands in a lockstep or input packet
+        constexpr int BATCH_BITS = 5;
+        // everything in a snapshot with a player but the entities
+        constexpr size_t SNAPSHOT_HEADER_BITS = 16 + 8 + 32 + 32 + 1 + 32 + 4 * POSITION_BITS + 32 + COUNT_BITS;
+
+        NetEntity quantize(const RenderInstance &inst);
+
+        RenderInstance dequantize(const NetEntity &entity);
+
+        int32_t quantizePosition(float v);
+
+        float dequantizePosition(int32_t v);
+
+        // Type of a packet of ours, 0 for anything else
+        uint8_t peekType(const uint8_t *data, size_t size);
+
+        size_t encodeConnect(uint8_t *out, size_t capacity);
+
+        size_t encodeWelcome(const WelcomePacket &packet, uint8_t *out, size_t capacity);
+
+        bool decodeWelcome(const uint8_t *data, size_t size, WelcomePacket &packet);
+
+        // The command as it comes out of the wire, for a sender that must apply what the receivers apply
+        InputCommand quantize(const InputCommand &cmd);
+
+        size_t encodeInput(const InputPacket &packet, uint8_t *out, size_t capacity);
+
+        bool decodeInput(const uint8_t *data, size_t size, InputPacket &packet);
+
+        size_t encodeLockstep(const LockstepPacket &packet, uint8_t *out, size_t capacity);
+
+        bool decodeLockstep(const uint8_t *data, size_t size, LockstepPacket &packet);
+
+        // Size of an entity in a snapshot, after the entity with id previous and against base if any
+        size_t entityBits(const NetEntity &e, const NetEntity *base, uint32_t previous);
+
+        // current as changes against baseline, or whole without one. 0 when it does not fit.
+        size_t encodeSnapshot(const NetSnapshot &current, const NetSnapshot *baseline, uint8_t *out, size_t capacity);
+
+        // Tick of the snapshot and of the baseline it needs, NO_TICK for none
+        bool peekSnapshot(const uint8_t *data, size_t size, uint32_t &tick, uint32_t &baseline_tick);
+
+        bool decodeSnapshot(const uint8_t *data, size_t size, const NetSnapshot *baseline, NetSnapshot &out);
+    }
+}
+
+#endif //ESCAPE_NET_PROTOCOL_H
@@ -0,0 +1,230 @@
+#include "net_server.h"
+#include <algorithm>
+#include <iostream>
+#include <thread>
+#include "agent.h"
+#include "terrain.h"
+
+namespace Escape {
+    SnapshotServer::SnapshotServer(Match &match) : match(match), timestep(match.getTickInterval()) {
+        render_system = match.findSystem<RenderSystem>();
+        control_system = match.findSystem<ControlSystem>();
+        visibility_system = match.findSystem<VisibilitySystem>();
+        match.setPublishing(false);
+    }
+
+    bool SnapshotServer::listen(uint16_t port) {
+        return socket.open(port);
+    }
+
+    void SnapshotServer::connect(const NetAddress &from) {
+        auto iter = std::find_if(clients.begin(), clients.end(), [&](const Client &c) {
+            return c.address == from;
+        });
+        if (iter == clients.end()) {
+            if (clients.size() >= MAX_CLIENTS)
+                return;
+            // the lowest player id nobody holds, its agent is kept while nobody plays it
+            int player_id = 1;
+            while (std::any_of(clients.begin(), clients.end(), [&](const Client &c) {
+                return c.player_id == player_id;
+            }))
+                ++player_id;
+            World *world = match.getWorld();
+            if (control_system->findPlayer(player_id) == entt::null) {
+                entt::entity first = control_system->findPlayer(1);
+                Position spawn = first != entt::null ? world->get<Position>(first) : Position(0, 0);
+                AgentSystem::createAgent(world, spawn, player_id, 1);
+            }
+            clients.emplace_back();
+            iter = clients.end() - 1;
+            iter->address = from;
+            iter->player_id = player_id;
+            TileMap *map = TerrainSystem::getTileMap(world);
+            iter->relevance = RelevanceFilter(VIEW_RADIUS * (map ? map->tile_width : 1),
+                                              NET_BUDGET * 8 - Net::SNAPSHOT_HEADER_BITS);
+            std::cerr << "Client " << from.toString() << " plays " << player_id << std::endl;
+        }
+        iter->heard = clock_type::now();
+        // sent again for every CONNECT, the answer may have been lost
+        size_t size = Net::encodeWelcome(WelcomePacket{iter->player_id, match.getTickInterval()}, buffer,
+                                         sizeof(buffer));
+        link.send(from, buffer, size);
+    }
+
+    void SnapshotServer::receive() {
+        NetAddress from;
+        uint8_t packet[UdpSocket::MAX_PACKET];
+        size_t size;
+        while ((size = socket.receive(from, packet, sizeof(packet))) > 0) {
+            uint8_t type = Net::peekType(packet, size);
+            if (type == (uint8_t) PacketType::CONNECT) {
+                connect(from);
+                continue;
+            }
+            InputPacket input;
+            if (type != (uint8_t) PacketType::INPUT || !Net::decodeInput(packet, size, input))
+                continue;
+            auto iter = std::find_if(clients.begin(), clients.end(), [&](const Client &c) {
+                return c.address == from;
+            });
+            if (iter == clients.end())
+                continue;
+            iter->heard = clock_type::now();
+            // acks arrive out of order too, only the newest counts
+            if (input.ack != Net::NO_TICK && input.ack <= tick &&
+                (iter->acked == Net::NO_TICK || input.ack > iter->acked))
+                iter->acked = input.ack;
+            if (input.sequence > iter->received)
+                iter->camera = input.camera;
+            uint32_t first = input.sequence + 1 - (uint32_t) input.commands.size();
+            for (size_t k = 0; k < input.commands.size(); ++k)
+                queue(*iter, first + (uint32_t) k, input.commands[k]);
+        }
+        auto now = clock_type::now();
+        clients.erase(std::remove_if(clients.begin(), clients.end(), [&](const Client &c) {
+            bool silent = std::chrono::duration<float>(now - c.heard).count() > TIMEOUT;
+            if (silent)
+                std::cerr << "Client " << c.address.toString() << " timed out" << std::endl;
+            return silent;
+        }), clients.end());
+    }
+
+    void SnapshotServer::queue(Client &client, uint32_t sequence, const InputCommand &cmd) {
+        // repeated by the client until acknowledged, most are here already
+        if (sequence <= client.input_sequence || client.queued[sequence % INPUT_QUEUE].first == sequence)
+            return;
+        if (sequence > client.input_sequence + INPUT_BACKLOG) {
+            uint32_t skip_to = sequence - INPUT_BACKLOG;
+            for (uint32_t s = client.input_sequence + 1; s <= skip_to; ++s) {
+                if (client.queued[s % INPUT_QUEUE].first == s)
+                    ++client.inputs_skipped;
+                client.queued[s % INPUT_QUEUE].first = 0;
+            }
+            client.input_sequence = skip_to;
+        }
+        client.queued[sequence % INPUT_QUEUE] = std::make_pair(sequence, cmd);
+        client.queued[sequence % INPUT_QUEUE].second.player_id = client.player_id;
+        client.received = std::max(client.received, sequence);
+    }
+
+    void SnapshotServer::applyInput(Client &client) {
+        for (uint32_t s = client.input_sequence + 1; s <= client.received; ++s) {
+            auto &slot = client.queued[s % INPUT_QUEUE];
+            // a gap is an input lost in every packet that repeated it, newer ones are here
+            if (slot.first != s) {
+                ++client.inputs_lost;
+                continue;
+            }
+            match.submit(slot.second);
+            slot.first = 0;
+            client.input_sequence = s;
+            return;
+        }
+    }
+
+    void SnapshotServer::send(Client &client) {
+        current.tick = tick;
+        entt::entity player = control_system->findPlayer(client.player_id);
+        current.has_player = player != entt::null;
+        current.input_sequence = client.input_sequence;
+        const GroupVisibility *visibility = nullptr;
+        if (current.has_player) {
+            auto &pos = match.getWorld()->get<Position>(player);
+            auto &vel = match.getWorld()->get<Velocity>(player);
+            current.player_entity = (uint32_t) entt::to_integral(player);
+            current.player_x = Net::quantizePosition(pos.x);
+            current.player_y = Net::quantizePosition(pos.y);
+            current.player_vx = Net::quantizePosition(vel.x);
+            current.player_vy = Net::quantizePosition(vel.y);
+            visibility = visibility_system->getGroup(match.getWorld()->get<AgentData>(player).group);
+            if (visibility != nullptr && visibility->empty())
+                visibility = nullptr;
+        }
+        CameraRect rect = client.camera;
+        // the camera keeps moving while this snapshot is on its way
+        float margin_x = (rect.right - rect.left) / 4, margin_y = (rect.top - rect.bottom) / 4;
+        rect = CameraRect{rect.left - margin_x, rect.bottom - margin_y, rect.right + margin_x, rect.top + margin_y};
+        render_system->extract(rect, found, RenderSystem::AGENTS | RenderSystem::BULLETS);
+
+        const NetSnapshot *baseline = nullptr;
+        if (client.acked != Net::NO_TICK && tick - client.acked < HISTORY &&
+            client.history[client.acked % HISTORY].tick == client.acked)
+            baseline = &client.history[client.acked % HISTORY];
+
+        RelevanceView view{rect, current.has_player, current.player_entity,
+                           vec2(Net::dequantizePosition(current.player_x), Net::dequantizePosition(current.player_y)),
+                           visibility, TerrainSystem::getTileMap(match.getWorld())};
+        client.relevance.select(found, view, baseline, current.entities);
+
+        size_t size;
+        while (true) {
+            std::sort(current.entities.begin(), current.entities.end(), [](const NetEntity &a, const NetEntity &b) {
+                return a.id < b.id;
+            });
+            size = Net::encodeSnapshot(current, baseline, buffer, sizeof(buffer));
+            if (size > 0 || current.entities.empty())
+                break;
+            // more than a packet even within the budget, keep what is closest to the center of the camera
+            int32_t cx = Net::quantizePosition((rect.left + rect.right) / 2);
+            int32_t cy = Net::quantizePosition((rect.bottom + rect.top) / 2);
+            auto distance = [&](const NetEntity &e) {
+                return (int64_t) (e.x - cx) * (e.x - cx) + (int64_t) (e.y - cy) * (e.y - cy);
+            };
+            std::sort(current.entities.begin(), current.entities.end(), [&](const NetEntity &a, const NetEntity &b) {
+                return distance(a) < distance(b);
+            });
+            current.entities.resize(current.entities.size() * 3 / 4);
+        }
+        if (size == 0)
+            return;
+        link.send(client.address, buffer, size);
+        client.history[tick % HISTORY] = current;
+        client.last_bytes = size;
+        client.total_bytes += size;
+        ++client.snapshots;
+        client.deltas += baseline != nullptr;
+    }
+
+    void SnapshotServer::poll(float elapsed) {
+        receive();
+        int steps = timestep.advance(elapsed);
+        for (int i = 0; i < steps; ++i) {
+            for (auto &client : clients)
+                applyInput(client);
+            match.step();
+            ++tick;
+            for (auto &client : clients)
+                send(client);
+        }
+        link.flush();
+    }
+
+    void SnapshotServer::run(const std::atomic<bool> &running) {
+        match.prepare();
+        auto last = clock_type::now();
+        while (running) {
+            auto now = clock_type::now();
+            poll(std::chrono::duration<float>(now - last).count());
+            last = now;
+            // input is read every millisecond, ticks run at their own pace
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void SnapshotServer::report(std::ostream &out) const {
+        float interval = match.getTickInterval();
+        for (auto &client : clients) {
+            float mean = client.snapshots > 0 ? (float) client.total_bytes / client.snapshots : 0;
+            out << "client " << client.address.toString() << " player " << client.player_id << ": "
+                << client.last_bytes << " bytes last tick, " << mean << " bytes per tick, "
+                << mean * 8 / interval / 1000 << " kbit/s, " << client.deltas << "/" << client.snapshots
+                << " deltas, " << client.relevance.getRelevant() << " relevant: " << client.relevance.getSent()
+                << " sent " << client.relevance.getKept() << " repeated " << client.relevance.getDropped()
+                << " left out, " << client.inputs_lost << " inputs lost " << client.inputs_skipped << " skipped"
+                << std::endl;
+        }
+        if (link.getDropped() > 0)
+            out << link.getDropped() << " packets dropped by the link" << std::endl;
+    }
+}
@@ -0,0 +1,104 @@
+#ifndef ESCAPE_NET_SERVER_H
+#define ESCAPE_NET_SERVER_H
+
+#include <atomic>
+#include <chrono>
+#include <ostream>
+#include <vector>
+#include "match.h"
+#include "net_protocol.h"
+#include "relevance.h"
+#include "engine/udp_socket.h"
+#include "engine/fixed_timestep.h"
+
+namespace Escape {
+    /**
+     * Runs a Match authoritatively for clients over UDP. Every client sends its inputs and the
+     * newest snapshot it holds. Inputs wait in a queue per client and one is applied every
+     * tick, so two that arrive between ticks are both played; after every tick a client gets the agents and bullets around its
+     * camera, as changes against that acknowledged snapshot. A RelevanceFilter per client keeps
+     * that to what its agent can see and to NET_BUDGET bytes. Everything happens on the thread
+     * calling run(), which is also the one ticking the match.
+     */
+    class SnapshotServer {
+    public:
+        static constexpr size_t HISTORY = 32;
+        static constexpr size_t MAX_CLIENTS = 16;
+        // seconds without a packet before a client is dropped
+        static constexpr float TIMEOUT = 5;
+        // inputs a client may be ahead of the ticks, older ones are skipped to bound its latency
+        static constexpr uint32_t INPUT_BACKLOG = 8;
+        static constexpr size_t INPUT_QUEUE = 32;
+
+    private:
+        typedef std::chrono::steady_clock clock_type;
+
+        struct Client {
+            NetAddress address;
+            int player_id;
+            uint32_t acked = Net::NO_TICK;
+            // newest input applied, what snapshots acknowledge
+            uint32_t input_sequence = 0;
+            // inputs after it that arrived, at sequence % INPUT_QUEUE; sequence 0 marks a free slot
+            uint32_t received = 0;
+            std::pair<uint32_t, InputCommand> queued[INPUT_QUEUE];
+            CameraRect camera{0, 0, 0, 0};
+            clock_type::time_point heard;
+            // what was sent, at tick % HISTORY
+            NetSnapshot history[HISTORY];
+            RelevanceFilter relevance{0, 0};
+            size_t last_bytes = 0, total_bytes = 0, snapshots = 0, deltas = 0;
+            // inputs that never arrived, and ones skipped for arriving too far ahead
+            size_t inputs_lost = 0, inputs_skipped = 0;
+        };
+
+        Match &match;
+        RenderSystem *render_system;
+        ControlSystem *control_system;
+        VisibilitySystem *visibility_system;
+        UdpSocket socket;
+        LossyLink link{socket};
+        std::vector<Client> clients;
+        FixedTimestep timestep;
+        uint32_t tick = 0;
+
+        std::vector<RenderInstance> found;
+        NetSnapshot current;
+        uint8_t buffer[UdpSocket::MAX_PACKET];
+
+        void receive();
+
+        void connect(const NetAddress &from);
+
+        void queue(Client &client, uint32_t sequence, const InputCommand &cmd);
+
+        // Submits the client's next input, one per tick like the client produces them
+        void applyInput(Client &client);
+
+        void send(Client &client);
+
+    public:
+        explicit SnapshotServer(Match &match);
+
+        bool listen(uint16_t port);
+
+        // Loss and latency of everything the server sends
+        LossyLink &getLink() {
+            return link;
+        }
+
+        // Receives, runs the ticks that are due and sends a snapshot to every client after each
+        void poll(float elapsed);
+
+        void run(const std::atomic<bool> &running);
+
+        size_t getClientCount() const {
+            return clients.size();
+        }
+
+        // Bytes of the last snapshot, the mean per tick and what was relevant for every client
+        void report(std::ostream &out) const;
+    };
+}
+
+#endif //ESCAPE_NET_SERVER_H
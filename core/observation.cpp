@@ -0,0 +1,197 @@
+#include "observation.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include "terrain.h"
+
+namespace Escape {
+    template<typename T>
+    struct ObservationValue;
+
+    template<>
+    struct ObservationValue<float> {
+        static float of(float fraction) {
+            return fraction;
+        }
+    };
+
+    template<>
+    struct ObservationValue<uint8_t> {
+        static uint8_t of(float fraction) {
+            return (uint8_t) std::lround(std::min(std::max(fraction, 0.0f), 1.0f) * 255);
+        }
+    };
+
+    // Eight cells for every byte of a wall row, so a row expands with one copy per byte
+    template<typename T>
+    struct ByteExpansion {
+        T cells[256][8];
+
+        ByteExpansion() {
+            for (int byte = 0; byte < 256; ++byte)
+                for (int bit = 0; bit < 8; ++bit)
+                    cells[byte][bit] = (byte >> bit) & 1 ? ObservationValue<T>::of(1) : T(0);
+        }
+
+        static const ByteExpansion &get() {
+            static const ByteExpansion table;
+            return table;
+        }
+    };
+
+    // The wall bits of columns i0 to i0 + 63 in row j, outside the map is wall
+    static uint64_t wallBits(const WallBitmap &bitmap, int i0, int j) {
+        if (j < 0 || j >= bitmap.getHeight())
+            return ~uint64_t(0);
+        if (i0 >= 0 && i0 + 64 <= bitmap.getWidth()) {
+            const uint64_t *row = bitmap.row(j);
+            int word = i0 >> 6, shift = i0 & 63;
+            uint64_t bits = row[word] >> shift;
+            if (shift != 0)
+                bits |= row[word + 1] << (64 - shift);
+            return bits;
+        }
+        uint64_t bits = 0;
+        for (int k = 0; k < 64; ++k)
+            if (bitmap.isWall(i0 + k, j))
+                bits |= uint64_t(1) << k;
+        return bits;
+    }
+
+    void ObservationSystem::initialize() {
+        ECSSystem::initialize();
+        render_system = findSystem<RenderSystem>();
+        raycast_system = findSystem<RaycastSystem>();
+    }
+
+    ObservationSystem::Window ObservationSystem::windowOf(entt::entity ent, const ObservationSpec &spec) {
+        const WallBitmap &bitmap = raycast_system->getBitmap();
+        vec2 tile = bitmap.getTileSize();
+        Window window{0, 0, spec.cell > 0 ? spec.cell : tile.x, -1};
+        World *world = getWorld();
+        bool valid = world->valid(ent);
+        if (valid) {
+            if (auto *agt = world->try_get<AgentData>(ent))
+                window.group = agt->group;
+        }
+        if (spec.centered || bitmap.getWidth() == 0) {
+            vec2 center = valid && world->has<Position>(ent) ? (vec2) world->get<Position>(ent) : vec2(0, 0);
+            window.left = center.x - spec.size * window.cell / 2;
+            window.top = center.y + spec.size * window.cell / 2;
+        } else {
+            // tiles are measured from their centers
+            vec2 origin = bitmap.getOrigin();
+            window.left = origin.x - tile.x / 2;
+            window.top = origin.y + tile.y / 2;
+            window.cell = std::max(bitmap.getWidth() * tile.x, bitmap.getHeight() * tile.y) / spec.size;
+        }
+        return window;
+    }
+
+    template<typename T>
+    void ObservationSystem::rasterizeWalls(const Window &window, int size, T *plane) {
+        const WallBitmap &bitmap = raycast_system->getBitmap();
+        vec2 origin = bitmap.getOrigin(), tile = bitmap.getTileSize();
+        // tile of the first cell center, cells of a row then step by cell / tile.x tiles
+        float gx = (window.left + window.cell / 2 - origin.x) / tile.x + 0.5f;
+        int i0 = (int) std::floor(gx);
+        bool unit = std::abs(window.cell - tile.x) < 1e-4f * tile.x;
+        if (!unit) {
+            columns.resize((size_t) size);
+            for (int c = 0; c < size; ++c)
+                columns[c] = (int) std::floor(gx + c * window.cell / tile.x);
+        }
+        const T one = ObservationValue<T>::of(1);
+        const auto &expansion = ByteExpansion<T>::get();
+        for (int r = 0; r < size; ++r) {
+            float y = window.top - (r + 0.5f) * window.cell;
+            int j = (int) std::floor((origin.y - y) / tile.y + 0.5f);
+            T *out = plane + (size_t) r * size;
+            if (unit) {
+                // one tile per cell, a row is a run of bits
+                for (int c = 0; c < size; c += 64) {
+                    uint64_t bits = wallBits(bitmap, i0 + c, j);
+                    int n = std::min(64, size - c), k = 0;
+                    for (; k + 8 <= n; k += 8)
+                        std::memcpy(out + c + k, expansion.cells[(bits >> k) & 0xff], 8 * sizeof(T));
+                    for (; k < n; ++k)
+                        out[c + k] = (bits >> k) & 1 ? one : T(0);
+                }
+            } else {
+                for (int c = 0; c < size; ++c)
+                    out[c] = bitmap.isWall(columns[c], j) ? one : T(0);
+            }
+        }
+    }
+
+    template<typename T>
+    void ObservationSystem::rasterizeInstances(const Window &window, int size, T *observation) {
+        float extent = size * window.cell;
+        render_system->extract(CameraRect{window.left, window.top - extent, window.left + extent, window.top}, found,
+                               RenderSystem::AGENTS | RenderSystem::BULLETS);
+        const size_t plane = (size_t) size * size;
+        const T one = ObservationValue<T>::of(1);
+        for (auto &inst : found) {
+            ObservationChannel channel = inst.kind == RenderKind::BULLET ? ObservationChannel::BULLETS
+                                                                         : inst.group == window.group
+                                                                           ? ObservationChannel::ALLIES
+                                                                           : ObservationChannel::ENEMIES;
+            T *target = observation + (size_t) channel * plane;
+            T *health = observation + (size_t) ObservationChannel::HEALTH * plane;
+            T value = ObservationValue<T>::of(inst.health);
+            bool agent = inst.kind == RenderKind::AGENT;
+            // cell space, the center of cell (c, r) is at (c + 0.5, r + 0.5)
+            float cx = (inst.position.x - window.left) / window.cell;
+            float cy = (window.top - inst.position.y) / window.cell;
+            float radius = inst.size.x / 2 / window.cell;
+            int c0 = std::max((int) std::floor(cx - radius), 0), c1 = std::min((int) std::floor(cx + radius), size - 1);
+            int r0 = std::max((int) std::floor(cy - radius), 0), r1 = std::min((int) std::floor(cy + radius), size - 1);
+            for (int r = r0; r <= r1; ++r) {
+                float dy = r + 0.5f - cy;
+                for (int c = c0; c <= c1; ++c) {
+                    float dx = c + 0.5f - cx;
+                    if (dx * dx + dy * dy > radius * radius)
+                        continue;
+                    target[(size_t) r * size + c] = one;
+                    if (agent)
+                        health[(size_t) r * size + c] = std::max(health[(size_t) r * size + c], value);
+                }
+            }
+            // anything smaller than a cell still covers the cell of its center
+            int c = (int) std::floor(cx), r = (int) std::floor(cy);
+            if (c >= 0 && r >= 0 && c < size && r < size) {
+                target[(size_t) r * size + c] = one;
+                if (agent)
+                    health[(size_t) r * size + c] = std::max(health[(size_t) r * size + c], value);
+            }
+        }
+    }
+
+    template<typename T>
+    void ObservationSystem::observeAll(const entt::entity *agents, size_t count, const ObservationSpec &spec, T *out) {
+        if (count == 0 || spec.size <= 0)
+            return;
+        const size_t stride = observationSize(spec), plane = (size_t) spec.size * spec.size;
+        std::fill(out, out + stride * count, T(0));
+        // registry lookups first, the rasterizing below only touches the grids and the output
+        windows.resize(count);
+        for (size_t a = 0; a < count; ++a)
+            windows[a] = windowOf(agents[a], spec);
+        bool walls = raycast_system->getBitmap().getWidth() > 0;
+        for (size_t a = 0; a < count; ++a) {
+            T *observation = out + stride * a;
+            if (walls)
+                rasterizeWalls(windows[a], spec.size, observation + (size_t) ObservationChannel::WALLS * plane);
+            rasterizeInstances(windows[a], spec.size, observation);
+        }
+    }
+
+    void ObservationSystem::observe(const entt::entity *agents, size_t count, const ObservationSpec &spec, float *out) {
+        observeAll(agents, count, spec, out);
+    }
+
+    void ObservationSystem::observe(const entt::entity *agents, size_t count, const ObservationSpec &spec,
+                                    uint8_t *out) {
+        observeAll(agents, count, spec, out);
+    }
+}
@@ -0,0 +1,77 @@
+#ifndef ESCAPE_OBSERVATION_H
+#define ESCAPE_OBSERVATION_H
+
+#include <vector>
+#include <cstdint>
+#include "MyECS.h"
+#include "components.h"
+#include "render.h"
+#include "raycast.h"
+
+namespace Escape {
+    enum class ObservationChannel {
+        WALLS,
+        ALLIES,
+        ENEMIES,
+        BULLETS,
+        // health fraction of every agent, on the cells it covers
+        HEALTH
+    };
+
+    struct ObservationSpec {
+        // cells per side, the observation is square
+        int size = 64;
+        // world units per cell, 0 for the tile size
+        float cell = 0;
+        // around the agent, or the whole map scaled to size
+        bool centered = true;
+    };
+
+    /**
+     * Top-down observations for learning agents, rasterized from the same walls bitmap and
+     * render grid the front-ends use. Every observation is CHANNELS planes of size * size
+     * cells, row 0 at the top, written into a tensor owned by the caller: 1 or 255 where a
+     * channel is set, 0 elsewhere. Allies and enemies are relative to each observer's group.
+     * Nothing is allocated once the scratch buffers have grown to the largest batch.
+     */
+    class ObservationSystem : public ECSSystem {
+        struct Window {
+            float left, top, cell;
+            int group;
+        };
+
+        RenderSystem *render_system = nullptr;
+        RaycastSystem *raycast_system = nullptr;
+        std::vector<Window> windows;
+        std::vector<RenderInstance> found;
+        // tile column of every observation column
+        std::vector<int> columns;
+
+        Window windowOf(entt::entity ent, const ObservationSpec &spec);
+
+        template<typename T>
+        void observeAll(const entt::entity *agents, size_t count, const ObservationSpec &spec, T *out);
+
+        template<typename T>
+        void rasterizeWalls(const Window &window, int size, T *plane);
+
+        template<typename T>
+        void rasterizeInstances(const Window &window, int size, T *observation);
+
+    public:
+        static constexpr int CHANNELS = 5;
+
+        static size_t observationSize(const ObservationSpec &spec) {
+            return (size_t) CHANNELS * spec.size * spec.size;
+        }
+
+        void initialize() override;
+
+        // count observations back to back in out, which holds count * observationSize(spec) values
+        void observe(const entt::entity *agents, size_t count, const ObservationSpec &spec, float *out);
+
+        void observe(const entt::entity *agents, size_t count, const ObservationSpec &spec, uint8_t *out);
+    };
+}
+
+#endif //ESCAPE_OBSERVATION_H
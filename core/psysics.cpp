@@ -2,7 +2,9 @@
 #include <Box2D/Box2D.h>
 #include "control.h"
 #include <map>
+#include <algorithm>
 #include "event_system.h"
+#include "config.h"
 namespace Escape {
     struct ContactListener : public b2ContactListener {
         World *world;
@@ -44,8 +46,18 @@ namespace Escape {
 
         std::map<entt::entity, b2Body *> mapping;
 
+        // Bodies go in by entity, not in the order of the pools. The solver visits them in the
+        // order they were created, and floats give other results in another order.
+        order.clear();
+        for (auto ent : getWorld()->view<Position, Rotation, TerrainData>())
+            order.push_back(ent);
+        std::sort(order.begin(), order.end());
+
         // Put walls into box2d
-        getWorld()->view<Position, Rotation, TerrainData>().each([&](auto ent, auto &pos, auto &rot, auto &ter) {
+        for (auto ent : order) {
+            auto &pos = getWorld()->get<Position>(ent);
+            auto &rot = getWorld()->get<Rotation>(ent);
+            auto &ter = getWorld()->get<TerrainData>(ent);
             if (ter.type == TerrainType::BOX) {
                 b2BodyDef wallDef;
                 wallDef.position.Set(pos.x, pos.y);
@@ -63,10 +75,18 @@ namespace Escape {
                 mapping[ent] = wall;
 
             }
-        });
+        }
+
+        order.clear();
+        for (auto ent : getWorld()->view<Position, Velocity, Hitbox>())
+            order.push_back(ent);
+        std::sort(order.begin(), order.end());
 
         // put agents and bullets in box2d
-        getWorld()->view<Position, Velocity, Hitbox>().each([&](auto ent, auto &pos, auto &vel, auto &hit) {
+        for (auto ent : order) {
+            auto &pos = getWorld()->get<Position>(ent);
+            auto &vel = getWorld()->get<Velocity>(ent);
+            auto &hit = getWorld()->get<Hitbox>(ent);
             b2BodyDef bodyDef;
             bodyDef.type = b2_dynamicBody;
             bodyDef.position.Set(pos.x, pos.y);
@@ -88,7 +108,7 @@ namespace Escape {
             } else {
                 fixtureDef.density = 1;
                 fixtureDef.friction = 0.1;
-                bodyDef.linearDamping = 15;
+                bodyDef.linearDamping = AGENT_DAMPING;
             }
 
             b2Body *body = b2d_world.CreateBody(&bodyDef);
@@ -96,7 +116,7 @@ namespace Escape {
 
             body->SetUserData((void *) (ent));
             mapping[ent] = body;
-        });
+        }
 
         b2d_world.SetContactListener(&listener);
 
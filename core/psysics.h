@@ -1,5 +1,6 @@
 #if !defined(MOVEMENT_H)
 #define MOVEMENT_H
+#include <vector>
 #include "MyECS.h"
 
 #include "components.h"
@@ -8,6 +9,9 @@ namespace Escape
 {
 class PhysicsSystem : public ECSSystem
 {
+    // entities in the order their bodies are created
+    std::vector<entt::entity> order;
+
 public:
     PhysicsSystem();
     void update(float delta) override;
@@ -0,0 +1,171 @@
+#include "raycast.h"
+#include <cmath>
+#include <limits>
+#include <Box2D/Box2D.h>
+#include "terrain.h"
+#include "engine/thread_pool.h"
+
+namespace Escape {
+    void WallBitmap::build(const TileMap &map) {
+        width = map.width;
+        height = map.height;
+        words_per_row = (width + 63) / 64;
+        origin_x = map.origin_x;
+        origin_y = map.origin_y;
+        tile_width = map.tile_width;
+        tile_height = map.tile_height;
+        revision = map.revision;
+        bits.assign((size_t) words_per_row * height, 0);
+        for (int j = 0; j < height; ++j) {
+            uint64_t *words = bits.data() + (size_t) j * words_per_row;
+            for (int i = 0; i < width; ++i) {
+                if (map.walls[map.index(i, j)])
+                    words[i >> 6] |= uint64_t(1) << (i & 63);
+            }
+        }
+    }
+
+    float WallBitmap::cast(float x, float y, float dx, float dy, float max_distance) const {
+        constexpr float INF = std::numeric_limits<float>::infinity();
+        if (width == 0)
+            return max_distance;
+        // grid space, cell i covers [i, i + 1)
+        float gx = (x - origin_x) / tile_width + 0.5f, gy = (origin_y - y) / tile_height + 0.5f;
+        float gdx = dx / tile_width, gdy = -dy / tile_height;
+        int i = (int) std::floor(gx), j = (int) std::floor(gy);
+        if (isWall(i, j))
+            return 0;
+        int step_i = gdx > 0 ? 1 : -1, step_j = gdy > 0 ? 1 : -1;
+        float delta_x = gdx != 0 ? std::abs(1 / gdx) : INF;
+        float delta_y = gdy != 0 ? std::abs(1 / gdy) : INF;
+        float next_x = gdx > 0 ? (i + 1 - gx) / gdx : gdx < 0 ? (gx - i) / -gdx : INF;
+        float next_y = gdy > 0 ? (j + 1 - gy) / gdy : gdy < 0 ? (gy - j) / -gdy : INF;
+        // The border of the map counts as wall, so this always terminates
+        while (true) {
+            float t = std::min(next_x, next_y);
+            if (t >= max_distance)
+                return max_distance;
+            if (next_x < next_y) {
+                i += step_i;
+                next_x += delta_x;
+            } else {
+                j += step_j;
+                next_y += delta_y;
+            }
+            if (isWall(i, j))
+                return t;
+        }
+    }
+
+    struct ClosestHit : public b2RayCastCallback {
+        float fraction = 1;
+
+        float32 ReportFixture(b2Fixture *fixture, const b2Vec2 &point, const b2Vec2 &normal, float32 fraction_) override {
+            fraction = fraction_;
+            return fraction_;
+        }
+    };
+
+    RaycastSystem::RaycastSystem() {
+    }
+
+    RaycastSystem::~RaycastSystem() {
+    }
+
+    void RaycastSystem::initialize() {
+        ECSSystem::initialize();
+        refresh();
+    }
+
+    void RaycastSystem::update(float delta) {
+        refresh();
+    }
+
+    void RaycastSystem::setFallback(bool enabled) {
+        fallback = enabled;
+        fallback_world.reset();
+        fallback_terrain = ~size_t(0);
+    }
+
+    void RaycastSystem::refresh() {
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        if (map != nullptr && map->revision != bitmap.getRevision())
+            bitmap.build(*map);
+        if (fallback)
+            buildFallback(map);
+    }
+
+    void RaycastSystem::buildFallback(const TileMap *map) {
+        size_t terrain = getWorld()->size<TerrainData>(), revision = map ? map->revision : 0;
+        if (terrain == fallback_terrain && revision == fallback_revision)
+            return;
+        fallback_terrain = terrain;
+        fallback_revision = revision;
+        fallback_world = std::make_unique<b2World>(b2Vec2(0, 0));
+        getWorld()->view<Position, TerrainData>().each([&](auto ent, auto &pos, auto &ter) {
+            if (map != nullptr) {
+                int i, j;
+                map->toCell(pos.x, pos.y, i, j);
+                // already in the bitmap
+                if (map->inside(i, j) && map->walls[map->index(i, j)] && ter.type == TerrainType::BOX &&
+                    std::abs(ter.argument_1 - map->tile_width) < 1e-3f &&
+                    std::abs(ter.argument_2 - map->tile_height) < 1e-3f)
+                    return;
+            }
+            b2BodyDef def;
+            def.position.Set(pos.x, pos.y);
+            if (auto *rot = getWorld()->try_get<Rotation>(ent))
+                def.angle = rot->radian;
+            b2Body *body = fallback_world->CreateBody(&def);
+            if (ter.type == TerrainType::BOX) {
+                b2PolygonShape box;
+                box.SetAsBox(ter.argument_1 / 2, ter.argument_2 / 2);
+                body->CreateFixture(&box, 0);
+            } else {
+                b2CircleShape circle;
+                circle.m_radius = ter.argument_1;
+                body->CreateFixture(&circle, 0);
+            }
+        });
+        if (fallback_world->GetBodyCount() == 0)
+            fallback_world.reset();
+    }
+
+    float RaycastSystem::castFallback(const Ray &ray, float max_distance) const {
+        if (max_distance <= 0)
+            return 0;
+        ClosestHit callback;
+        b2Vec2 from(ray.x, ray.y), to(ray.x + ray.dx * max_distance, ray.y + ray.dy * max_distance);
+        fallback_world->RayCast(&callback, from, to);
+        return callback.fraction * max_distance;
+    }
+
+    RayHit RaycastSystem::cast(const Ray &ray) const {
+        float distance = bitmap.cast(ray.x, ray.y, ray.dx, ray.dy, ray.max_distance);
+        if (fallback_world)
+            distance = castFallback(ray, distance);
+        return RayHit{distance, distance < ray.max_distance};
+    }
+
+    void RaycastSystem::castBatch(const Ray *rays, RayHit *hits, size_t count) const {
+        ThreadPool::shared().parallelFor(count, BATCH_GRAIN, [&](size_t begin, size_t end) {
+            for (size_t k = begin; k < end; ++k)
+                hits[k] = cast(rays[k]);
+        });
+    }
+
+    bool RaycastSystem::lineOfSight(const vec2 &from, const vec2 &to) const {
+        float dx = to.x - from.x, dy = to.y - from.y;
+        float distance = std::sqrt(dx * dx + dy * dy);
+        if (distance < 1e-6f)
+            return true;
+        return !cast(Ray{from.x, from.y, dx / distance, dy / distance, distance}).hit;
+    }
+
+    bool RaycastSystem::lineOfSight(entt::entity from, entt::entity to) {
+        if (!getWorld()->valid(from) || !getWorld()->valid(to) ||
+            !getWorld()->has<Position>(from) || !getWorld()->has<Position>(to))
+            return false;
+        return lineOfSight(getWorld()->get<Position>(from), getWorld()->get<Position>(to));
+    }
+}
@@ -0,0 +1,115 @@
+#ifndef ESCAPE_RAYCAST_H
+#define ESCAPE_RAYCAST_H
+
+#include <memory>
+#include <vector>
+#include <cstdint>
+#include "MyECS.h"
+#include "components.h"
+
+class b2World;
+
+namespace Escape {
+    // Wall cells of a TileMap packed one bit per cell, every row starts on a fresh 64 bit word
+    class WallBitmap {
+        int width = 0, height = 0, words_per_row = 0;
+        float origin_x = 0, origin_y = 0, tile_width = 1, tile_height = 1;
+        size_t revision = ~size_t(0);
+        std::vector<uint64_t> bits;
+
+    public:
+        void build(const TileMap &map);
+
+        size_t getRevision() const {
+            return revision;
+        }
+
+        int getWidth() const {
+            return width;
+        }
+
+        int getHeight() const {
+            return height;
+        }
+
+        // Center of cell (0, 0)
+        vec2 getOrigin() const {
+            return vec2(origin_x, origin_y);
+        }
+
+        vec2 getTileSize() const {
+            return vec2(tile_width, tile_height);
+        }
+
+        const uint64_t *row(int j) const {
+            return bits.data() + (size_t) j * words_per_row;
+        }
+
+        bool isWall(int i, int j) const {
+            if (i < 0 || j < 0 || i >= width || j >= height)
+                return true;
+            return (row(j)[i >> 6] >> (i & 63)) & 1u;
+        }
+
+        // Distance along (dx, dy), which must be normalized, to the first wall cell.
+        // Returns max_distance if nothing is hit before.
+        float cast(float x, float y, float dx, float dy, float max_distance) const;
+    };
+
+    struct Ray {
+        float x, y;
+        float dx, dy; // normalized
+        float max_distance;
+    };
+
+    struct RayHit {
+        float distance;
+        bool hit;
+    };
+
+    /**
+     * Line of sight and raycast queries for agents. Rays walk the wall bitmap with a DDA,
+     * batches are spread over the shared thread pool. Terrain that is not part of the tile
+     * layer can optionally be tested with Box2D as well.
+     */
+    class RaycastSystem : public ECSSystem {
+        static constexpr size_t BATCH_GRAIN = 256;
+
+        WallBitmap bitmap;
+        bool fallback = false;
+        std::unique_ptr<b2World> fallback_world;
+        size_t fallback_terrain = ~size_t(0), fallback_revision = ~size_t(0);
+
+        void refresh();
+
+        void buildFallback(const TileMap *map);
+
+        float castFallback(const Ray &ray, float max_distance) const;
+
+    public:
+        RaycastSystem();
+
+        ~RaycastSystem() override;
+
+        void initialize() override;
+
+        void update(float delta) override;
+
+        // Also test against TerrainData entities that are not tiles, using Box2D
+        void setFallback(bool enabled);
+
+        const WallBitmap &getBitmap() const {
+            return bitmap;
+        }
+
+        RayHit cast(const Ray &ray) const;
+
+        void castBatch(const Ray *rays, RayHit *hits, size_t count) const;
+
+        bool lineOfSight(const vec2 &from, const vec2 &to) const;
+
+        bool lineOfSight(entt::entity from, entt::entity to);
+    };
+}
+
+#endif //ESCAPE_RAYCAST_H
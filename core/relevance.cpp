@@ -0,0 +1,145 @@
+#include "relevance.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Escape {
+    RelevanceFilter::RelevanceFilter(float view_distance, size_t budget_bits) : view_distance(view_distance),
+                                                                                budget_bits(budget_bits) {
+    }
+
+    bool RelevanceFilter::isRelevant(const RenderInstance &inst, const RelevanceView &view, float distance2) const {
+        if (!view.has_player || distance2 <= view_distance * view_distance)
+            return true;
+        if (view.visibility == nullptr || view.map == nullptr)
+            return false;
+        int i, j;
+        view.map->toCell(inst.position.x, inst.position.y, i, j);
+        return view.visibility->isVisible(i, j);
+    }
+
+    size_t RelevanceFilter::exactBits() const {
+        size_t bits = 0;
+        uint32_t previous = 0;
+        for (auto &s : scored) {
+            if (s.choice == Choice::DROP)
+                continue;
+            if (s.choice == Choice::SEND)
+                bits += Net::entityBits(s.entity, s.base, previous);
+            else
+                bits += Net::entityBits(*s.base, s.base, previous);
+            previous = s.entity.id;
+        }
+        return bits;
+    }
+
+    void RelevanceFilter::select(const std::vector<RenderInstance> &candidates, const RelevanceView &view,
+                                 const NetSnapshot *baseline, std::vector<NetEntity> &out) {
+        // walking in id order merges with last tick's accumulators and with the baseline
+        order.clear();
+        for (size_t k = 0; k < candidates.size(); ++k)
+            order.emplace_back((uint32_t) entt::to_integral(candidates[k].ent), (uint32_t) k);
+        std::sort(order.begin(), order.end());
+
+        scored.clear();
+        next.clear();
+        ranking.clear();
+        const CameraRect &camera = view.camera;
+        vec2 center = view.has_player ? view.player : vec2((camera.left + camera.right) / 2,
+                                                           (camera.bottom + camera.top) / 2);
+        size_t i = 0, b = 0;
+        for (auto &entry : order) {
+            const RenderInstance &inst = candidates[entry.second];
+            float dx = inst.position.x - center.x, dy = inst.position.y - center.y;
+            float distance2 = dx * dx + dy * dy;
+            bool own = view.has_player && entry.first == view.player_entity;
+            if (!own && !isRelevant(inst, view, distance2))
+                continue;
+
+            NetEntity e = Net::quantize(inst);
+            while (i < interests.size() && interests[i].id < e.id)
+                ++i;
+            float accumulator = i < interests.size() && interests[i].id == e.id ? interests[i].accumulator : 0;
+            const NetEntity *base = nullptr;
+            if (baseline != nullptr) {
+                while (b < baseline->entities.size() && baseline->entities[b].id < e.id)
+                    ++b;
+                // the encoder sends an entity whole when its kind changed, an id reused by the registry
+                if (b < baseline->entities.size() && baseline->entities[b].id == e.id &&
+                    baseline->entities[b].kind == e.kind)
+                    base = &baseline->entities[b];
+            }
+
+            float change = NEW_CHANGE;
+            if (base != nullptr) {
+                float mx = (float) (e.x - base->x), my = (float) (e.y - base->y);
+                change = std::sqrt(mx * mx + my * my) / Net::POSITION_SCALE + (e.health != base->health);
+            }
+            float weight = inst.kind == RenderKind::AGENT ? AGENT_WEIGHT : BULLET_WEIGHT;
+            accumulator += weight * (1 + change) / (1 + distance2 / (view_distance * view_distance));
+
+            ranking.emplace_back(own ? std::numeric_limits<float>::infinity() : accumulator, (uint32_t) scored.size());
+            next.push_back(Interest{e.id, accumulator});
+            // the id gap is not known before the choice is made, take the short one
+            scored.push_back(Scored{e, base, (uint32_t) Net::entityBits(e, base, e.id - 1),
+                                    base ? (uint32_t) Net::entityBits(*base, base, base->id - 1) : 0,
+                                    Choice::DROP});
+        }
+        // entities that left start over when they come back
+        interests.swap(next);
+        relevant = scored.size();
+
+        std::sort(ranking.begin(), ranking.end(), [](const std::pair<float, uint32_t> &a,
+                                                     const std::pair<float, uint32_t> &b) {
+            return a.first > b.first;
+        });
+        // repeating what the client has comes first, the least relevant go when even that does not fit
+        size_t reserved = 0, end = ranking.size();
+        for (auto &s : scored)
+            reserved += s.keep_bits;
+        while (end > 0 && reserved > budget_bits)
+            reserved -= scored[ranking[--end].second].keep_bits;
+        size_t used = reserved;
+        for (size_t k = 0; k < end; ++k) {
+            Scored &s = scored[ranking[k].second];
+            size_t extra = s.send_bits - s.keep_bits;
+            if (used + extra <= budget_bits) {
+                used += extra;
+                s.choice = Choice::SEND;
+            } else if (s.base != nullptr) {
+                s.choice = Choice::KEEP;
+            }
+        }
+
+        // ids further apart than estimated cost more, give up the least relevant until it fits
+        size_t bits;
+        while ((bits = exactBits()) > budget_bits) {
+            size_t saved = 0;
+            for (size_t k = ranking.size(); k-- > 0 && saved < bits - budget_bits;) {
+                Scored &s = scored[ranking[k].second];
+                if (s.choice == Choice::SEND && s.base != nullptr) {
+                    saved += s.send_bits - s.keep_bits;
+                    s.choice = Choice::KEEP;
+                } else if (s.choice != Choice::DROP) {
+                    saved += s.choice == Choice::SEND ? s.send_bits : s.keep_bits;
+                    s.choice = Choice::DROP;
+                }
+            }
+        }
+
+        out.clear();
+        sent = kept = 0;
+        for (size_t k = 0; k < scored.size(); ++k) {
+            const Scored &s = scored[k];
+            if (s.choice == Choice::SEND) {
+                out.push_back(s.entity);
+                interests[k].accumulator = 0;
+                ++sent;
+            } else if (s.choice == Choice::KEEP) {
+                out.push_back(*s.base);
+                ++kept;
+            }
+        }
+        dropped = relevant - sent - kept;
+    }
+}
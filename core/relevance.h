@@ -0,0 +1,106 @@
+#ifndef ESCAPE_RELEVANCE_H
+#define ESCAPE_RELEVANCE_H
+
+#include <vector>
+#include <cstdint>
+#include "components.h"
+#include "render.h"
+#include "visibility.h"
+#include "net_protocol.h"
+
+namespace Escape {
+    // What decides which entities matter to one client this tick
+    struct RelevanceView {
+        CameraRect camera;
+        bool has_player;
+        // the client's own agent, always sent
+        uint32_t player_entity;
+        vec2 player;
+        // cells seen by the player's group, nullptr when the group sees nothing
+        const GroupVisibility *visibility;
+        const TileMap *map;
+    };
+
+    /**
+     * Chooses, for one client, the entities a snapshot carries. An entity on the client's
+     * screen is relevant when it is within the view distance of the client's agent or seen by
+     * its group; without an agent everything on screen is. Every tick each relevant entity adds
+     * its priority to an accumulator, higher for near entities and for those that changed more
+     * since the baseline the client acknowledged. Entities are then sent by accumulator until
+     * the bit budget runs out, and a sent entity starts accumulating from zero again.
+     * One that is not sent is repeated unchanged from the baseline, which costs a few bits and
+     * keeps it on the client's screen; the budget reserves those bits first.
+     */
+    class RelevanceFilter {
+        struct Interest {
+            uint32_t id;
+            float accumulator;
+        };
+
+        // an entity is sent as it is now, repeated from the baseline or left out
+        enum class Choice : uint8_t {
+            SEND,
+            KEEP,
+            DROP
+        };
+
+        struct Scored {
+            NetEntity entity;
+            const NetEntity *base;
+            uint32_t send_bits, keep_bits;
+            Choice choice;
+        };
+
+        float view_distance;
+        size_t budget_bits;
+        // accumulators of what was relevant last tick, sorted by id
+        std::vector<Interest> interests, next;
+        // candidates as id and index, sorted by id
+        std::vector<std::pair<uint32_t, uint32_t>> order;
+        // what is relevant this tick, sorted by id and in step with interests
+        std::vector<Scored> scored;
+        // accumulator and index into scored, highest first
+        std::vector<std::pair<float, uint32_t>> ranking;
+        size_t relevant = 0, sent = 0, kept = 0, dropped = 0;
+
+        bool isRelevant(const RenderInstance &inst, const RelevanceView &view, float distance2) const;
+
+        size_t exactBits() const;
+
+    public:
+        static constexpr float AGENT_WEIGHT = 1;
+        static constexpr float BULLET_WEIGHT = 0.5f;
+        // change counted for an entity the client does not have yet, in world units
+        static constexpr float NEW_CHANGE = 4;
+
+        // budget_bits are for the entities only, the snapshot header comes on top
+        RelevanceFilter(float view_distance, size_t budget_bits);
+
+        void setBudget(size_t budget_bits_) {
+            budget_bits = budget_bits_;
+        }
+
+        // Replaces out with the entities to send, sorted by id. The baseline must be sorted by id.
+        void select(const std::vector<RenderInstance> &candidates, const RelevanceView &view,
+                    const NetSnapshot *baseline, std::vector<NetEntity> &out);
+
+        // Counts of the last select()
+        size_t getRelevant() const {
+            return relevant;
+        }
+
+        size_t getSent() const {
+            return sent;
+        }
+
+        size_t getKept() const {
+            return kept;
+        }
+
+        size_t getDropped() const {
+            return dropped;
+        }
+    };
+}
+
+#endif //ESCAPE_RELEVANCE_H
@@ -0,0 +1,118 @@
+#include "render.h"
+#include <cmath>
+#include <algorithm>
+#include "terrain.h"
+
+namespace Escape {
+    SpatialGrid::SpatialGrid(float cell_size) : cell_size(cell_size) {
+    }
+
+    int SpatialGrid::cellOf(float v) const {
+        return (int) std::floor(v / cell_size);
+    }
+
+    void SpatialGrid::build(const std::vector<RenderInstance> &instances) {
+        size_t bucket_count = 16;
+        while (bucket_count < instances.size() * 2)
+            bucket_count *= 2;
+        mask = bucket_count - 1;
+        max_extent = 0;
+        starts.assign(bucket_count + 1, 0);
+        input_cells.resize(instances.size() * 2);
+        buckets.resize(instances.size());
+        for (size_t k = 0; k < instances.size(); ++k) {
+            const RenderInstance &inst = instances[k];
+            int i = cellOf(inst.position.x), j = cellOf(inst.position.y);
+            input_cells[k * 2] = i;
+            input_cells[k * 2 + 1] = j;
+            buckets[k] = (uint32_t) (hash(i, j) & mask);
+            ++starts[buckets[k] + 1];
+            float hx = inst.size.x / 2, hy = inst.size.y / 2;
+            max_extent = std::max(max_extent, inst.radian != 0 ? std::sqrt(hx * hx + hy * hy) : std::max(hx, hy));
+        }
+        for (size_t b = 0; b < bucket_count; ++b)
+            starts[b + 1] += starts[b];
+        items.resize(instances.size());
+        cells.resize(instances.size() * 2);
+        cursor.assign(starts.begin(), starts.end() - 1);
+        for (size_t k = 0; k < instances.size(); ++k) {
+            uint32_t at = cursor[buckets[k]]++;
+            items[at] = instances[k];
+            cells[at * 2] = input_cells[k * 2];
+            cells[at * 2 + 1] = input_cells[k * 2 + 1];
+        }
+    }
+
+    void SpatialGrid::query(const CameraRect &rect, unsigned kinds, std::vector<RenderInstance> &out) const {
+        visit(rect, kinds, [&](const RenderInstance &inst) {
+            out.push_back(inst);
+        });
+    }
+
+    size_t SpatialGrid::query(const CameraRect &rect, unsigned kinds, RenderInstance *out, size_t capacity) const {
+        size_t count = 0;
+        visit(rect, kinds, [&](const RenderInstance &inst) {
+            if (count < capacity)
+                out[count++] = inst;
+        });
+        return count;
+    }
+
+    RenderSystem::RenderSystem(float cell_size) : moving(cell_size), walls(cell_size) {
+    }
+
+    void RenderSystem::update(float delta) {
+        rebuild();
+    }
+
+    void RenderSystem::rebuild() {
+        World *world = getWorld();
+        TileMap *map = TerrainSystem::getTileMap(world);
+        size_t count = world->size<TerrainData>(), revision = map ? map->revision : 0;
+        if (count != wall_count || revision != wall_revision) {
+            wall_count = count;
+            wall_revision = revision;
+            scratch.clear();
+            world->view<TerrainData, Position>().each([&](auto ent, auto &ter, auto &pos) {
+                auto *rot = world->try_get<Rotation>(ent);
+                vec2 size = ter.type == TerrainType::BOX ? vec2(ter.argument_1, ter.argument_2)
+                                                         : vec2(ter.argument_1 * 2, ter.argument_1 * 2);
+                scratch.push_back(RenderInstance{ent, RenderKind::WALL, pos, rot ? rot->radian : 0, size, 1, -1});
+            });
+            walls.build(scratch);
+            ++walls_version;
+        }
+
+        scratch.clear();
+        world->view<AgentData, Position, Health, Hitbox>().each(
+                [&](auto ent, auto &agt, auto &pos, auto &health, auto &hitbox) {
+                    auto *rot = world->try_get<Rotation>(ent);
+                    scratch.push_back(RenderInstance{ent, RenderKind::AGENT, pos, rot ? rot->radian : 0,
+                                                     vec2(hitbox.radius * 2, hitbox.radius * 2),
+                                                     health.health / health.max_health, agt.group});
+                });
+        world->view<BulletData, Position>().each([&](auto ent, auto &data, auto &pos) {
+            auto *rot = world->try_get<Rotation>(ent);
+            scratch.push_back(RenderInstance{ent, RenderKind::BULLET, pos, rot ? rot->radian : 0,
+                                             vec2(data.radius * 2, data.radius * 2), 1, -1});
+        });
+        moving.build(scratch);
+    }
+
+    void RenderSystem::extract(const CameraRect &rect, std::vector<RenderInstance> &out, unsigned kinds) const {
+        out.clear();
+        if (kinds & (AGENTS | BULLETS))
+            moving.query(rect, kinds, out);
+        if (kinds & WALLS)
+            walls.query(rect, kinds, out);
+    }
+
+    size_t RenderSystem::extract(const CameraRect &rect, RenderInstance *out, size_t capacity, unsigned kinds) const {
+        size_t count = 0;
+        if (kinds & (AGENTS | BULLETS))
+            count += moving.query(rect, kinds, out, capacity);
+        if (kinds & WALLS)
+            count += walls.query(rect, kinds, out + count, capacity - count);
+        return count;
+    }
+}
@@ -0,0 +1,163 @@
+#ifndef ESCAPE_RENDER_H
+#define ESCAPE_RENDER_H
+
+#include <vector>
+#include <cmath>
+#include <cstdint>
+#include "MyECS.h"
+#include "components.h"
+#include "config.h"
+
+namespace Escape {
+    enum class RenderKind : uint8_t {
+        AGENT = 1,
+        BULLET = 2,
+        WALL = 4
+    };
+
+    // Everything a front-end needs to draw one entity, copied out of the registry
+    struct RenderInstance {
+        entt::entity ent;
+        RenderKind kind;
+        vec2 position;
+        float radian;
+        // full width and height, the diameter for agents and bullets
+        vec2 size;
+        // fraction of the maximum health, 1 for everything but agents
+        float health;
+        // AgentData::group, -1 for everything but agents
+        int group;
+    };
+
+    // Area of the world shown by a camera, in world units
+    struct CameraRect {
+        float left, bottom, right, top;
+
+        static CameraRect around(float cx, float cy, float width, float height) {
+            return CameraRect{cx - width / 2, cy - height / 2, cx + width / 2, cy + height / 2};
+        }
+
+        // Larger by fraction of the width and height on every side
+        CameraRect grown(float fraction) const {
+            float mx = (right - left) * fraction, my = (top - bottom) * fraction;
+            return CameraRect{left - mx, bottom - my, right + mx, top + my};
+        }
+    };
+
+    /**
+     * Instances bucketed by the square cell their center falls in. Cells are hashed into a
+     * power of two number of buckets stored back to back, so the grid has no bounds and a
+     * rebuild only reuses the same few vectors.
+     */
+    class SpatialGrid {
+        float cell_size;
+        size_t mask = 0;
+        float max_extent = 0;
+        std::vector<uint32_t> starts;
+        std::vector<RenderInstance> items;
+        // cell coordinates of items, in the same order
+        std::vector<int> cells;
+        // per input instance while building
+        std::vector<int> input_cells;
+        std::vector<uint32_t> buckets, cursor;
+
+        int cellOf(float v) const;
+
+        static size_t hash(int i, int j) {
+            return (size_t) (uint32_t) i * 73856093u ^ (size_t) (uint32_t) j * 19349663u;
+        }
+
+        static bool overlaps(const RenderInstance &inst, const CameraRect &rect) {
+            float hx = inst.size.x / 2, hy = inst.size.y / 2;
+            if (inst.radian != 0) {
+                // a rotated box fits in the circle through its corners
+                hx = hy = std::sqrt(hx * hx + hy * hy);
+            }
+            return inst.position.x + hx >= rect.left && inst.position.x - hx <= rect.right &&
+                   inst.position.y + hy >= rect.bottom && inst.position.y - hy <= rect.top;
+        }
+
+        template<typename Fn>
+        void visit(const CameraRect &rect, unsigned kinds, Fn &&fn) const {
+            if (items.empty())
+                return;
+            int i0 = cellOf(rect.left - max_extent), i1 = cellOf(rect.right + max_extent);
+            int j0 = cellOf(rect.bottom - max_extent), j1 = cellOf(rect.top + max_extent);
+            for (int j = j0; j <= j1; ++j) {
+                for (int i = i0; i <= i1; ++i) {
+                    size_t b = hash(i, j) & mask;
+                    for (uint32_t k = starts[b]; k < starts[b + 1]; ++k) {
+                        // other cells hashed into the same bucket are visited on their own turn
+                        if (cells[k * 2] != i || cells[k * 2 + 1] != j)
+                            continue;
+                        const RenderInstance &inst = items[k];
+                        if (((unsigned) inst.kind & kinds) && overlaps(inst, rect))
+                            fn(inst);
+                    }
+                }
+            }
+        }
+
+    public:
+        explicit SpatialGrid(float cell_size);
+
+        void build(const std::vector<RenderInstance> &instances);
+
+        // Appends the instances overlapping rect whose kind is in the kinds mask
+        void query(const CameraRect &rect, unsigned kinds, std::vector<RenderInstance> &out) const;
+
+        // Writes up to capacity of them to out, returns how many it wrote
+        size_t query(const CameraRect &rect, unsigned kinds, RenderInstance *out, size_t capacity) const;
+
+        size_t size() const {
+            return items.size();
+        }
+
+        const std::vector<RenderInstance> &getItems() const {
+            return items;
+        }
+    };
+
+    /**
+     * Render extraction. Once per tick agents and bullets are copied into a spatial grid,
+     * walls into a second one that is only rebuilt when the terrain changes. Front-ends then
+     * ask for what their camera shows, at a cost that follows the viewport instead of the map.
+     */
+    class RenderSystem : public ECSSystem {
+        SpatialGrid moving, walls;
+        std::vector<RenderInstance> scratch;
+        size_t wall_count = ~size_t(0), wall_revision = ~size_t(0);
+        size_t walls_version = 0;
+
+    public:
+        static constexpr unsigned AGENTS = (unsigned) RenderKind::AGENT;
+        static constexpr unsigned BULLETS = (unsigned) RenderKind::BULLET;
+        static constexpr unsigned WALLS = (unsigned) RenderKind::WALL;
+        static constexpr unsigned ALL = AGENTS | BULLETS | WALLS;
+
+        RenderSystem(float cell_size = RENDER_CELL_SIZE);
+
+        void update(float delta) override;
+
+        // Copies the current state of the world into the grids
+        void rebuild();
+
+        // Fills out with the instances of the given kinds that overlap the camera
+        void extract(const CameraRect &rect, std::vector<RenderInstance> &out, unsigned kinds = ALL) const;
+
+        // The same into memory of a fixed size, returns how many were written; the rest are left out
+        size_t extract(const CameraRect &rect, RenderInstance *out, size_t capacity, unsigned kinds = ALL) const;
+
+        // Every wall, in no particular order
+        const std::vector<RenderInstance> &getWalls() const {
+            return walls.getItems();
+        }
+
+        // Changes whenever the walls were rebuilt
+        size_t getWallsVersion() const {
+            return walls_version;
+        }
+    };
+}
+
+#endif //ESCAPE_RENDER_H
@@ -0,0 +1,306 @@
+#include "replay.h"
+#include <algorithm>
+#include <iostream>
+#include "timeserver.h"
+#include "world_hash.h"
+
+namespace Escape {
+    ReplayRecorder::ReplayRecorder(Match &match, uint32_t period) : match(match), period(std::max(period, 1u)) {
+        timeserver = match.findSystem<TimeServer>();
+        control_system = match.findSystem<ControlSystem>();
+    }
+
+    ReplayRecorder::~ReplayRecorder() {
+        close();
+    }
+
+    bool ReplayRecorder::open(const std::string &path) {
+        file.open(path, std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+        buffer.clear();
+        ByteWriter out(buffer);
+        out.write(Replay::MAGIC);
+        out.write(Replay::VERSION);
+        out.write(match.getTickInterval());
+        out.writeString(match.getFolder());
+        file.write((const char *) buffer.data(), buffer.size());
+        offset = buffer.size();
+        keyframes.clear();
+        return (bool) file;
+    }
+
+    void ReplayRecorder::writeChunk(Replay::Chunk type, uint32_t tick) {
+        uint8_t header[Replay::CHUNK_HEADER];
+        uint32_t fields[3] = {(uint32_t) type, tick, (uint32_t) buffer.size()};
+        std::memcpy(header, fields, sizeof(header));
+        file.write((const char *) header, sizeof(header));
+        file.write((const char *) buffer.data(), buffer.size());
+        offset += sizeof(header) + buffer.size();
+    }
+
+    void ReplayRecorder::close() {
+        if (!file.is_open())
+            return;
+        uint64_t index = offset;
+        buffer.clear();
+        ByteWriter out(buffer);
+        out.write(last_tick);
+        out.write((uint32_t) keyframes.size());
+        for (auto &keyframe : keyframes) {
+            out.write(keyframe.first);
+            out.write(keyframe.second);
+        }
+        writeChunk(Replay::Chunk::INDEX, last_tick);
+        buffer.clear();
+        out.write(index);
+        out.write(Replay::MAGIC);
+        file.write((const char *) buffer.data(), buffer.size());
+        file.close();
+    }
+
+    void ReplayRecorder::beginTick() {
+        if (!file.is_open())
+            return;
+        auto tick = (uint32_t) timeserver->getTick();
+        if (!keyframes.empty() && (tick % period != 0 || keyframes.back().first == tick))
+            return;
+        auto began = std::chrono::steady_clock::now();
+        World &world = *match.getWorld();
+        buffer.clear();
+        ByteWriter out(buffer);
+        out.write(hashWorld(world));
+        match.save(out);
+        keyframes.emplace_back(tick, offset);
+        writeChunk(Replay::Chunk::KEYFRAME, tick);
+        file.flush();
+        last_tick = std::max(last_tick, tick);
+        keyframe_bytes += Replay::CHUNK_HEADER + buffer.size();
+        keyframe_ms += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - began).count();
+    }
+
+    void ReplayRecorder::endTick() {
+        if (!file.is_open() || keyframes.empty())
+            return;
+        auto tick = (uint32_t) timeserver->getTick();
+        last_tick = tick;
+        const std::vector<InputCommand> &applied = control_system->getApplied();
+        if (applied.empty())
+            return;
+        buffer.clear();
+        ByteWriter out(buffer);
+        out.write((uint32_t) applied.size());
+        for (auto &cmd : applied) {
+            out.write((int32_t) cmd.player_id);
+            out.write(cmd.move_x);
+            out.write(cmd.move_y);
+            out.write((uint8_t) cmd.shooting);
+            out.write(cmd.aim_x);
+            out.write(cmd.aim_y);
+            out.write((int32_t) cmd.weapon);
+        }
+        writeChunk(Replay::Chunk::COMMANDS, tick);
+        command_bytes += Replay::CHUNK_HEADER + buffer.size();
+    }
+
+    void ReplayRecorder::report(std::ostream &out) const {
+        out << "recording: " << last_tick << " ticks, " << keyframes.size() << " keyframes of "
+            << (keyframes.empty() ? 0 : keyframe_bytes / keyframes.size()) << " bytes in "
+            << (keyframes.empty() ? 0 : keyframe_ms / keyframes.size()) << " ms, " << command_bytes
+            << " bytes of inputs" << std::endl;
+    }
+
+    ReplayPlayer::ReplayPlayer(const std::string &folder) : match(folder) {
+        last = clock_type::now();
+    }
+
+    bool ReplayPlayer::readChunk(size_t at, size_t limit, Replay::Chunk &type, uint32_t &chunk_tick,
+                                 ByteReader &payload) const {
+        if (at > limit || limit - at < Replay::CHUNK_HEADER)
+            return false;
+        ByteReader in(file.data() + at, limit - at);
+        type = (Replay::Chunk) in.read<uint32_t>();
+        chunk_tick = in.read<uint32_t>();
+        uint32_t size = in.read<uint32_t>();
+        const uint8_t *data = in.readBytes(size);
+        if (data == nullptr)
+            return false;
+        payload = ByteReader(data, size);
+        return true;
+    }
+
+    bool ReplayPlayer::readIndex() {
+        if (file.size() < start + Replay::TRAILER)
+            return false;
+        ByteReader trailer(file.data() + file.size() - Replay::TRAILER, Replay::TRAILER);
+        uint64_t index = trailer.read<uint64_t>();
+        if (trailer.read<uint32_t>() != Replay::MAGIC || index < start || index > file.size() - Replay::TRAILER)
+            return false;
+        Replay::Chunk type;
+        uint32_t chunk_tick;
+        ByteReader in(nullptr, 0);
+        if (!readChunk(index, file.size() - Replay::TRAILER, type, chunk_tick, in) || type != Replay::Chunk::INDEX)
+            return false;
+        last_tick = in.read<uint32_t>();
+        uint32_t count = in.read<uint32_t>();
+        keyframes.clear();
+        for (uint32_t k = 0; k < count && !in.overflowed(); ++k) {
+            Keyframe keyframe;
+            keyframe.tick = in.read<uint32_t>();
+            keyframe.offset = in.read<uint64_t>();
+            keyframes.push_back(keyframe);
+        }
+        end = index;
+        return !in.overflowed();
+    }
+
+    void ReplayPlayer::scan() {
+        keyframes.clear();
+        last_tick = 0;
+        size_t at = start;
+        Replay::Chunk type;
+        uint32_t chunk_tick;
+        ByteReader payload(nullptr, 0);
+        // a crash leaves the last chunk half written, it ends the recording
+        while (readChunk(at, file.size(), type, chunk_tick, payload) && type != Replay::Chunk::INDEX) {
+            if (type == Replay::Chunk::KEYFRAME)
+                keyframes.push_back(Keyframe{chunk_tick, at});
+            last_tick = std::max(last_tick, chunk_tick);
+            at += Replay::CHUNK_HEADER + payload.remaining();
+        }
+        end = at;
+    }
+
+    bool ReplayPlayer::open(const std::string &path) {
+        if (!file.open(path))
+            return false;
+        ByteReader header(file.data(), file.size());
+        if (header.read<uint32_t>() != Replay::MAGIC || header.read<uint32_t>() != Replay::VERSION) {
+            std::cerr << path << " is not a recording of this version" << std::endl;
+            return false;
+        }
+        interval = header.read<float>();
+        std::string folder = header.readString();
+        if (header.overflowed() || interval <= 0)
+            return false;
+        if (folder != match.getFolder())
+            std::cerr << path << " was recorded on " << folder << std::endl;
+        start = header.offset();
+        if (!readIndex()) {
+            std::cerr << path << " has no index, it was not closed" << std::endl;
+            scan();
+        }
+        if (keyframes.empty())
+            return false;
+
+        match.setTickRate(1 / interval);
+        timestep.setStep(interval);
+        match.prepare();
+        return restore(keyframes.front());
+    }
+
+    bool ReplayPlayer::restore(const Keyframe &keyframe) {
+        Replay::Chunk type;
+        uint32_t chunk_tick;
+        ByteReader payload(nullptr, 0);
+        if (!readChunk(keyframe.offset, end, type, chunk_tick, payload) || type != Replay::Chunk::KEYFRAME)
+            return false;
+        payload.read<uint64_t>();
+        if (!match.restore(payload))
+            return false;
+        tick = chunk_tick;
+        cursor = keyframe.offset + Replay::CHUNK_HEADER + payload.offset() + payload.remaining();
+        loaded = true;
+        ++restored;
+        return true;
+    }
+
+    void ReplayPlayer::verify(ByteReader &payload) {
+        uint64_t hash = payload.read<uint64_t>();
+        ++verified;
+        if (diverged == Replay::NO_TICK && hash != hashWorld(*match.getWorld())) {
+            diverged = tick;
+            std::cerr << "Replay differs from the recording after tick " << tick << std::endl;
+        }
+    }
+
+    bool ReplayPlayer::next() {
+        if (!loaded || tick >= last_tick)
+            return false;
+        // the keyframe of the current state comes first, then the inputs of the next tick
+        Replay::Chunk type;
+        uint32_t chunk_tick;
+        ByteReader payload(nullptr, 0);
+        while (readChunk(cursor, end, type, chunk_tick, payload)) {
+            if (type == Replay::Chunk::KEYFRAME && chunk_tick == tick)
+                verify(payload);
+            else if (type == Replay::Chunk::COMMANDS && chunk_tick == tick + 1) {
+                uint32_t count = payload.read<uint32_t>();
+                for (uint32_t k = 0; k < count; ++k) {
+                    InputCommand cmd;
+                    cmd.player_id = payload.read<int32_t>();
+                    cmd.move_x = payload.read<float>();
+                    cmd.move_y = payload.read<float>();
+                    cmd.shooting = payload.read<uint8_t>() != 0;
+                    cmd.aim_x = payload.read<float>();
+                    cmd.aim_y = payload.read<float>();
+                    cmd.weapon = payload.read<int32_t>();
+                    if (payload.overflowed())
+                        break;
+                    match.submit(cmd);
+                }
+            } else if (chunk_tick > tick)
+                break;
+            cursor += Replay::CHUNK_HEADER + payload.offset() + payload.remaining();
+        }
+        match.step();
+        ++tick;
+        return true;
+    }
+
+    bool ReplayPlayer::seek(uint32_t target) {
+        if (keyframes.empty())
+            return false;
+        target = std::min(std::max(target, getFirstTick()), last_tick);
+        auto keyframe = std::upper_bound(keyframes.begin(), keyframes.end(), target,
+                                         [](uint32_t t, const Keyframe &k) {
+                                             return t < k.tick;
+                                         }) - 1;
+        // going on from here is shorter than from the keyframe
+        if (!loaded || tick > target || tick < keyframe->tick) {
+            if (!restore(*keyframe))
+                return false;
+        }
+        // only the state landed on is drawn
+        match.setPublishing(false);
+        while (tick + 1 < target && next()) {
+        }
+        match.setPublishing(publishing);
+        if (tick < target)
+            next();
+        return true;
+    }
+
+    void ReplayPlayer::poll(float elapsed) {
+        int steps = timestep.advance(elapsed);
+        if (paused || !loaded)
+            return;
+        for (int i = 0; i < steps && next(); ++i) {
+        }
+    }
+
+    const RenderSnapshot &ReplayPlayer::latest() {
+        auto now = clock_type::now();
+        poll(std::chrono::duration<float>(now - last).count());
+        last = now;
+        return match.latest();
+    }
+
+    void ReplayPlayer::report(std::ostream &out) const {
+        out << "replay: tick " << tick << " of " << getFirstTick() << ".." << last_tick << ", " << keyframes.size()
+            << " keyframes, " << restored << " restored, " << verified << " compared";
+        if (diverged != Replay::NO_TICK)
+            out << ", differs after tick " << diverged;
+        out << std::endl;
+    }
+}
@@ -0,0 +1,199 @@
+#ifndef ESCAPE_REPLAY_H
+#define ESCAPE_REPLAY_H
+
+#include <chrono>
+#include <fstream>
+#include <ostream>
+#include <string>
+#include <vector>
+#include "match.h"
+#include "engine/byte_stream.h"
+#include "engine/mapped_file.h"
+#include "engine/fixed_timestep.h"
+
+namespace Escape {
+    /**
+     * A recording is a header, chunks in tick order and an index of the keyframes:
+     *   header   MAGIC, VERSION, seconds per tick, map folder
+     *   chunk    type, tick, payload size, payload
+     *            COMMANDS  the InputCommands ControlSystem applied in that tick, for ticks with any
+     *            KEYFRAME  hashWorld() and Match::save() of the state reached after that tick
+     *            INDEX     last tick, then tick and file offset of every keyframe
+     *   trailer  file offset of the INDEX chunk, MAGIC
+     * A recording cut short by a crash has no index and the player finds the keyframes itself.
+     */
+    namespace Replay {
+        constexpr uint32_t MAGIC = 0x45524543;
+        constexpr uint32_t VERSION = 2;
+        constexpr size_t CHUNK_HEADER = 12;
+        constexpr size_t TRAILER = 12;
+        constexpr uint32_t NO_TICK = ~0u;
+
+        enum class Chunk : uint32_t {
+            COMMANDS = 1,
+            KEYFRAME = 2,
+            INDEX = 3
+        };
+    }
+
+    /**
+     * Writes a Match to a recording, called by Match::step on the thread running the ticks.
+     * The first tick recorded and every period-th one get a keyframe, the others only their
+     * inputs; inputs are all the match takes from outside, the rest repeats by itself. The
+     * file is flushed at every keyframe, a crash loses the ticks after the last one.
+     */
+    class ReplayRecorder {
+        Match &match;
+        TimeServer *timeserver;
+        ControlSystem *control_system;
+        uint32_t period;
+        std::ofstream file;
+        uint64_t offset = 0;
+        uint32_t last_tick = 0;
+        std::vector<std::pair<uint32_t, uint64_t>> keyframes;
+        std::vector<uint8_t> buffer;
+        size_t command_bytes = 0, keyframe_bytes = 0;
+        double keyframe_ms = 0;
+
+        // Writes buffer as the payload of a chunk
+        void writeChunk(Replay::Chunk type, uint32_t tick);
+
+    public:
+        // ten seconds at the usual tick rate
+        static constexpr uint32_t KEYFRAME_PERIOD = 600;
+
+        explicit ReplayRecorder(Match &match, uint32_t period = KEYFRAME_PERIOD);
+
+        ~ReplayRecorder();
+
+        bool open(const std::string &path);
+
+        // Writes the index, from any thread once the match stopped ticking
+        void close();
+
+        // Keyframe of the state before the tick, when one is due
+        void beginTick();
+
+        // Inputs the tick applied
+        void endTick();
+
+        // Size of what was written and the time keyframes took
+        void report(std::ostream &out) const;
+    };
+
+    /**
+     * Plays a recording back into a Match of the same map. The file is mapped, so a long
+     * recording opens at once and only what is played is read from disk. seek() restores the
+     * last keyframe before the tick and runs the ticks in between without publishing. Every
+     * keyframe played through is compared with the hash of the world: a difference means the
+     * simulation no longer repeats the recording, and the first tick it happened is kept.
+     * Everything runs on the thread calling latest() or poll(), which also ticks the match.
+     */
+    class ReplayPlayer : public MatchView {
+        typedef std::chrono::steady_clock clock_type;
+
+        struct Keyframe {
+            uint32_t tick;
+            uint64_t offset;
+        };
+
+        Match match;
+        MappedFile file;
+        std::vector<Keyframe> keyframes;
+        float interval = 1 / 60.0f;
+        uint32_t last_tick = 0;
+        // chunks lie in [start, end), cursor is the next one to play
+        size_t start = 0, end = 0, cursor = 0;
+        uint32_t tick = 0;
+        bool loaded = false, paused = false, publishing = true;
+        FixedTimestep timestep{1 / 60.0f};
+        clock_type::time_point last;
+        uint32_t diverged = Replay::NO_TICK;
+        size_t verified = 0, restored = 0;
+
+        bool readChunk(size_t at, size_t limit, Replay::Chunk &type, uint32_t &chunk_tick, ByteReader &payload) const;
+
+        bool readIndex();
+
+        void scan();
+
+        bool restore(const Keyframe &keyframe);
+
+        void verify(ByteReader &payload);
+
+    public:
+        explicit ReplayPlayer(const std::string &folder);
+
+        // Maps the recording and restores its first keyframe, on the thread that plays it
+        bool open(const std::string &path);
+
+        uint32_t getFirstTick() const {
+            return keyframes.empty() ? 0 : keyframes.front().tick;
+        }
+
+        uint32_t getLastTick() const {
+            return last_tick;
+        }
+
+        uint32_t getTick() const {
+            return tick;
+        }
+
+        // Goes to the state after tick, clamped to the recording
+        bool seek(uint32_t target);
+
+        // Runs the next recorded tick, false at the end
+        bool next();
+
+        // Runs the ticks that are due after elapsed seconds of real time
+        void poll(float elapsed);
+
+        // Headless, nothing reads the snapshots
+        void setPublishing(bool enabled) {
+            publishing = enabled;
+            match.setPublishing(enabled);
+        }
+
+        void setPaused(bool paused_) {
+            paused = paused_;
+        }
+
+        // First tick whose world differed from its keyframe, NO_TICK while they agree
+        uint32_t getDivergedTick() const {
+            return diverged;
+        }
+
+        // Keyframes compared and whether they matched
+        void report(std::ostream &out) const;
+
+        const std::string &getFolder() const override {
+            return match.getFolder();
+        }
+
+        // A recording is watched, not played
+        bool submit(const InputCommand &cmd) override {
+            return false;
+        }
+
+        bool post(std::function<void(World &)> task) override {
+            return false;
+        }
+
+        void setCamera(const CameraRect &rect) override {
+            match.setCamera(rect);
+        }
+
+        const RenderSnapshot &latest() override;
+
+        Profiler &getProfiler() override {
+            return match.getProfiler();
+        }
+
+        // Any tick of the recording is there to go back to
+        bool rewind(uint32_t ticks) override {
+            return seek(tick > ticks ? tick - ticks : 0);
+        }
+    };
+}
+
+#endif //ESCAPE_REPLAY_H
@@ -0,0 +1,210 @@
+#include "rollback.h"
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include "components.h"
+#include "hpa_star.h"
+#include "engine/byte_stream.h"
+
+namespace Escape {
+    template<typename T>
+    struct PoolCopy {
+        std::vector<entt::entity> entities;
+        std::vector<T> components;
+
+        void capture(World &world, const PoolCopy *previous) {
+            size_t count = world.size<T>();
+            // assign() keeps the capacity, the copies are as large as the pools ever were. It is
+            // a memmove for trivially copyable components; the others are copy assigned one by
+            // one, which reuses what their strings and maps hold but allocates past that.
+            entities.assign(world.data<T>(), world.data<T>() + count);
+            components.assign(world.raw<T>(), world.raw<T>() + count);
+        }
+
+        void restore(World &world) const {
+            world.assign<T>(entities.begin(), entities.end(), components.begin());
+        }
+
+        size_t getMemoryUsage() const {
+            return entities.capacity() * sizeof(entt::entity) + components.capacity() * sizeof(T);
+        }
+    };
+
+    // Large and changed rarely, a copy is made when the revision moved
+    template<>
+    struct PoolCopy<TileMap> {
+        std::vector<entt::entity> entities;
+        std::vector<std::shared_ptr<const TileMap>> components;
+
+        void capture(World &world, const PoolCopy *previous) {
+            size_t count = world.size<TileMap>();
+            const entt::entity *data = world.data<TileMap>();
+            const TileMap *raw = world.raw<TileMap>();
+            entities.assign(data, data + count);
+            components.resize(count);
+            for (size_t i = 0; i < count; ++i) {
+                if (previous != nullptr && i < previous->entities.size() && previous->entities[i] == data[i] &&
+                    previous->components[i]->revision == raw[i].revision)
+                    components[i] = previous->components[i];
+                else
+                    components[i] = std::make_shared<const TileMap>(raw[i]);
+            }
+        }
+
+        void restore(World &world) const {
+            for (size_t i = 0; i < entities.size(); ++i)
+                world.assign<TileMap>(entities[i], *components[i]);
+        }
+
+        size_t getMemoryUsage() const {
+            // the maps are shared between frames, RollbackBuffer counts each once
+            return entities.capacity() * sizeof(entt::entity);
+        }
+    };
+
+    template<typename... T>
+    struct PoolCopies {
+        std::tuple<PoolCopy<T>...> pools;
+
+        void capture(World &world, const PoolCopies *previous) {
+            (std::get<PoolCopy<T>>(pools).capture(world, previous ? &std::get<PoolCopy<T>>(previous->pools) : nullptr),
+                    ...);
+        }
+
+        void restore(World &world) const {
+            (std::get<PoolCopy<T>>(pools).restore(world), ...);
+        }
+
+        size_t getMemoryUsage() const {
+            return (std::get<PoolCopy<T>>(pools).getMemoryUsage() + ...);
+        }
+    };
+
+    // entt's snapshot asks the archive for entities and for counts, they go in one list
+    struct EntityWriter {
+        std::vector<uint32_t> &out;
+
+        void operator()(entt::entity ent) {
+            out.push_back((uint32_t) entt::to_integral(ent));
+        }
+
+        void operator()(std::underlying_type_t<entt::entity> count) {
+            out.push_back((uint32_t) count);
+        }
+    };
+
+    struct EntityReader {
+        const std::vector<uint32_t> &in;
+        size_t position = 0;
+
+        void operator()(entt::entity &ent) {
+            ent = (entt::entity) in[position++];
+        }
+
+        void operator()(std::underlying_type_t<entt::entity> &count) {
+            count = (std::underlying_type_t<entt::entity>) in[position++];
+        }
+    };
+
+    struct RollbackBuffer::Frame {
+        uint32_t tick = 0;
+        std::vector<uint32_t> entities;
+        PoolCopies<COMPONENT_LIST> pools;
+        // the random streams of the TimeServer, through its save()
+        std::vector<uint8_t> streams;
+        // takes the influence layers from this tick back to the one before
+        InfluenceSystem::Undo influence;
+    };
+
+    RollbackBuffer::RollbackBuffer(size_t ticks) : frames(std::max(ticks, size_t(1))) {
+    }
+
+    RollbackBuffer::~RollbackBuffer() = default;
+
+    bool RollbackBuffer::has(uint32_t tick) const {
+        return held > 0 && tick <= newest && newest - tick < held;
+    }
+
+    uint32_t RollbackBuffer::getOldestTick() const {
+        return newest + 1 - (uint32_t) held;
+    }
+
+    void RollbackBuffer::capture(World &world, TimeServer &timeserver, const InfluenceSystem &influence) {
+        auto began = std::chrono::steady_clock::now();
+        auto tick = (uint32_t) timeserver.getTick();
+        // a jump, from a restore of something else, starts over
+        const Frame *previous = held > 0 && tick == newest + 1 ? &frames[newest % frames.size()] : nullptr;
+        if (previous != nullptr)
+            held = std::min(held + 1, frames.size());
+        else if (held == 0 || tick != newest)
+            held = 1;
+        newest = tick;
+
+        Frame &frame = frames[tick % frames.size()];
+        frame.tick = tick;
+        frame.entities.clear();
+        EntityWriter archive{frame.entities};
+        world.snapshot().entities(archive).destroyed(archive);
+        // with a single frame the previous one is being overwritten
+        frame.pools.capture(world, previous != nullptr && previous != &frame ? &previous->pools : nullptr);
+        frame.streams.clear();
+        ByteWriter out(frame.streams);
+        timeserver.save(out);
+        influence.recordUndo(frame.influence);
+
+        capture_us = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - began).count();
+        capture_total_us += capture_us;
+        capture_worst_us = std::max(capture_worst_us, capture_us);
+        ++captures;
+    }
+
+    bool RollbackBuffer::restore(World &world, TimeServer &timeserver, InfluenceSystem &influence, uint32_t tick) {
+        if (!has(tick))
+            return false;
+        // a false undo emptied the layers, they build up again from the restored tick
+        for (uint32_t undone = newest; undone > tick; --undone)
+            if (!influence.undo(frames[undone % frames.size()].influence))
+                break;
+        const Frame &frame = frames[tick % frames.size()];
+        World loaded;
+        EntityReader archive{frame.entities};
+        loaded.loader().entities(archive).destroyed(archive);
+        frame.pools.restore(loaded);
+        // derived from the map alone and expensive to build, PathSystem checks its revision
+        world.view<MapGraph>().each([&](entt::entity ent, MapGraph &graph) {
+            if (loaded.valid(ent) && loaded.has<TileMap>(ent))
+                loaded.assign<MapGraph>(ent, std::move(graph));
+        });
+        world = std::move(loaded);
+        ByteReader in(frame.streams.data(), frame.streams.size());
+        timeserver.load(in);
+        held -= newest - tick;
+        newest = tick;
+        return true;
+    }
+
+    size_t RollbackBuffer::getMemoryUsage() const {
+        size_t total = frames.capacity() * sizeof(Frame);
+        std::vector<const TileMap *> maps;
+        for (auto &frame : frames) {
+            total += frame.entities.capacity() * sizeof(uint32_t) + frame.streams.capacity() +
+                     frame.pools.getMemoryUsage() + frame.influence.indices.capacity() * sizeof(uint32_t) +
+                     frame.influence.cells.capacity() * sizeof(InfluenceSystem::Cell);
+            for (auto &map : std::get<PoolCopy<TileMap>>(frame.pools.pools).components)
+                maps.push_back(map.get());
+        }
+        std::sort(maps.begin(), maps.end());
+        maps.erase(std::unique(maps.begin(), maps.end()), maps.end());
+        for (const TileMap *map : maps)
+            total += (map->tiles.capacity() + map->walls.capacity()) * sizeof(int);
+        return total;
+    }
+
+    void RollbackBuffer::report(std::ostream &out) const {
+        out << "rollback: " << held << " of " << frames.size() << " ticks held, "
+            << (captures ? capture_total_us / captures : 0) << " us per capture (worst " << capture_worst_us << " us), "
+            << getMemoryUsage() / 1024 << " KB" << std::endl;
+    }
+}
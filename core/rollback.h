@@ -0,0 +1,71 @@
+#ifndef ESCAPE_ROLLBACK_H
+#define ESCAPE_ROLLBACK_H
+
+#include <cstdint>
+#include <ostream>
+#include <vector>
+#include "MyECS.h"
+#include "timeserver.h"
+#include "influence_map.h"
+
+namespace Escape {
+    /**
+     * The world after each of the last ticks, kept in memory to go back to, for rollback and
+     * for rewinding while debugging. A capture copies every pool as it is stored, entities and
+     * components side by side, into buffers of a frame that was used before. Once the ring went
+     * round, a pool of trivially copyable components costs one bulk copy and no allocation;
+     * Name, AgentData and MapInfo are copied one by one and their strings and map nodes still
+     * allocate when they grow. The TileMap is shared with the previous frame until its
+     * revision changes. The influence layers are not copied, a frame keeps the Undo of its
+     * tick and a restore applies them from the newest tick back.
+     * A restore builds the registry again from the entities, including the recycled ones,
+     * and appends each pool in one piece in the order it was stored in, so views iterate as
+     * they did then. Path is left out like in saveWorld, the graph of the map is kept.
+     */
+    class RollbackBuffer {
+        struct Frame;
+
+        std::vector<Frame> frames;
+        // frames holds the ticks (newest - held, newest], tick t at t % size
+        uint32_t newest = 0;
+        size_t held = 0;
+        size_t captures = 0;
+        double capture_us = 0, capture_total_us = 0, capture_worst_us = 0;
+
+    public:
+        // two seconds at the usual tick rate
+        static constexpr size_t DEFAULT_TICKS = 120;
+
+        explicit RollbackBuffer(size_t ticks = DEFAULT_TICKS);
+
+        ~RollbackBuffer();
+
+        // Copies the state reached after the current tick, over the oldest one held
+        void capture(World &world, TimeServer &timeserver, const InfluenceSystem &influence);
+
+        // Replaces world and the influence layers with the state after tick. The ticks after it
+        // are dropped, they are the future being replaced. False when tick is not held anymore
+        // and both were left alone.
+        bool restore(World &world, TimeServer &timeserver, InfluenceSystem &influence, uint32_t tick);
+
+        bool has(uint32_t tick) const;
+
+        // Range of ticks held, oldest is greater than newest while empty
+        uint32_t getOldestTick() const;
+
+        uint32_t getNewestTick() const {
+            return newest;
+        }
+
+        // Microseconds the last capture took
+        double getCaptureMicros() const {
+            return capture_us;
+        }
+
+        size_t getMemoryUsage() const;
+
+        void report(std::ostream &out) const;
+    };
+}
+
+#endif //ESCAPE_ROLLBACK_H
@@ -36,6 +36,8 @@ ThorsAnvil_MakeTrait(WeaponPrototype, type, bullet_type, cd, accuracy, bullet_nu
                      gun_length);
 ThorsAnvil_MakeTrait(Weapon, weapon, last, next);
 ThorsAnvil_MakeTrait(TerrainData, type, argument_1, argument_2, argument_3, argument_4);
+ThorsAnvil_MakeTrait(TileMap, width, height, origin_x, origin_y, tile_width, tile_height, tiles, walls, revision,
+                     tileset_columns, tileset_rows);
 
 ThorsAnvil_MakeEnum(BulletType,
                     HANDGUN_BULLET,
@@ -0,0 +1,48 @@
+#ifndef ESCAPE_SHARED_CHANNEL_H
+#define ESCAPE_SHARED_CHANNEL_H
+
+#include <atomic>
+#include <cstdint>
+#include "config.h"
+#include "control.h"
+#include "render.h"
+#include "engine/shared_ring.h"
+
+namespace Escape {
+    // One tick as a renderer process draws it, written by the simulation straight into shared memory
+    struct SharedFrame {
+        uint64_t tick;
+        float delta;
+        bool has_player;
+        vec2 player;
+        // steady_clock nanoseconds when it was committed, the clock is the same in every process
+        int64_t committed;
+        // what writing it cost the simulation
+        float write_us;
+        // SHARED_INSTANCES when more were on screen than fit
+        uint32_t count;
+        RenderInstance instances[SHARED_INSTANCES];
+    };
+
+    /**
+     * Layout of the shared memory between a SharedMemoryHost and a SharedMemoryClient. Frames
+     * go to the renderer, inputs come back, and the camera is a few atomics that the renderer
+     * overwrites. Only plain values live here, the two processes map it at different addresses.
+     */
+    struct SharedChannel {
+        static constexpr uint32_t MAGIC = 0x45534331;
+        static constexpr size_t FRAMES = 4;
+        static constexpr size_t INPUTS = 256;
+
+        // MAGIC once the host set everything up, zero before
+        std::atomic<uint32_t> magic;
+        // steady_clock nanoseconds of the host's last poll, a renderer notices a host that died
+        std::atomic<int64_t> heartbeat;
+        // left, bottom, right, top of the renderer's camera; a torn update is off by one frame at most
+        std::atomic<float> camera[4];
+        SharedRing<SharedFrame, FRAMES> frames;
+        SharedRing<InputCommand, INPUTS> inputs;
+    };
+}
+
+#endif //ESCAPE_SHARED_CHANNEL_H
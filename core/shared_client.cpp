@@ -0,0 +1,118 @@
+#include "shared_client.h"
+#include <algorithm>
+#include "map_converter.h"
+
+namespace Escape {
+    static int64_t nanoseconds(std::chrono::steady_clock::time_point time) {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+    }
+
+    SharedMemoryClient::SharedMemoryClient(const std::string &folder) : folder(folder) {
+        auto data = MapConverter::load(folder);
+        auto walls = std::make_shared<std::vector<RenderInstance>>();
+        for (auto &wall : data->walls)
+            walls->push_back(RenderInstance{entt::null, RenderKind::WALL, vec2(wall.x, wall.y), 0,
+                                            vec2(wall.width, wall.height), 1, -1});
+        snapshot.walls = walls;
+        snapshot.tilemap = std::make_shared<const TileMap>(data->tilemap);
+        snapshot.instances.reserve(SHARED_INSTANCES);
+        counter_write = profiler.addCounter("write us");
+        counter_read = profiler.addCounter("read us");
+        counter_handoff = profiler.addCounter("handoff us");
+        counter_skipped = profiler.addCounter("frames skipped");
+    }
+
+    bool SharedMemoryClient::connect(const std::string &name_) {
+        name = name_;
+        return attach();
+    }
+
+    bool SharedMemoryClient::attach() {
+        tried = clock_type::now();
+        if (!memory.open(name, sizeof(SharedChannel)))
+            return false;
+        auto shared = static_cast<SharedChannel *>(memory.data());
+        if (shared->magic.load(std::memory_order_acquire) != SharedChannel::MAGIC) {
+            memory.close();
+            return false;
+        }
+        channel = shared;
+        ++attached;
+        return true;
+    }
+
+    bool SharedMemoryClient::submit(const InputCommand &cmd) {
+        return channel != nullptr && channel->inputs.push(cmd);
+    }
+
+    void SharedMemoryClient::setCamera(const CameraRect &rect) {
+        if (channel == nullptr)
+            return;
+        channel->camera[0].store(rect.left, std::memory_order_relaxed);
+        channel->camera[1].store(rect.bottom, std::memory_order_relaxed);
+        channel->camera[2].store(rect.right, std::memory_order_relaxed);
+        channel->camera[3].store(rect.top, std::memory_order_relaxed);
+    }
+
+    const RenderSnapshot &SharedMemoryClient::latest() {
+        auto now = clock_type::now();
+        if (channel != nullptr) {
+            int64_t beat = channel->heartbeat.load(std::memory_order_relaxed);
+            // a new host made a new object, this mapping only holds what the old one left
+            if (nanoseconds(now) - beat > (int64_t) (TIMEOUT * 1e9f)) {
+                channel = nullptr;
+                memory.close();
+            }
+        }
+        if (channel == nullptr && std::chrono::duration<float>(now - tried).count() > RETRY)
+            attach();
+        if (channel == nullptr)
+            return snapshot;
+
+        // only the newest frame is drawn
+        size_t waiting = channel->frames.size();
+        for (; waiting > 1; --waiting) {
+            channel->frames.release();
+            ++skipped;
+        }
+        const SharedFrame *frame = channel->frames.peek();
+        if (frame == nullptr)
+            return snapshot;
+        snapshot.tick = frame->tick;
+        snapshot.delta = frame->delta;
+        snapshot.has_player = frame->has_player;
+        snapshot.player = frame->player;
+        // front-ends keep the snapshot while they draw, the slot goes back to the host right away
+        snapshot.instances.assign(frame->instances, frame->instances + frame->count);
+        auto done = clock_type::now();
+        float write = frame->write_us;
+        float read = std::chrono::duration<float, std::micro>(done - now).count();
+        float handoff = (float) (nanoseconds(now) - frame->committed) / 1000;
+        full += frame->count == SHARED_INSTANCES;
+        channel->frames.release();
+
+        ++frames;
+        write_us += write;
+        read_us += read;
+        handoff_us += handoff;
+        write_max = std::max(write_max, write);
+        read_max = std::max(read_max, read);
+        if (profiler.isEnabled()) {
+            profiler.begin(snapshot.tick);
+            profiler.count(counter_write, write);
+            profiler.count(counter_read, read);
+            profiler.count(counter_handoff, handoff);
+            profiler.count(counter_skipped, (double) skipped);
+            profiler.end();
+        }
+        return snapshot;
+    }
+
+    void SharedMemoryClient::report(std::ostream &out) const {
+        double n = frames > 0 ? (double) frames : 1;
+        out << "shared memory: " << frames << " frames drawn, " << skipped << " skipped, " << full
+            << " with more on screen than fit, attached " << attached << " times; per frame " << write_us / n
+            << " us writing (worst " << write_max << "), " << read_us / n << " us reading (worst " << read_max
+            << "), " << handoff_us / n << " us from commit to pickup" << std::endl;
+    }
+}
@@ -0,0 +1,79 @@
+#ifndef ESCAPE_SHARED_CLIENT_H
+#define ESCAPE_SHARED_CLIENT_H
+
+#include <chrono>
+#include <ostream>
+#include <string>
+#include "match.h"
+#include "shared_channel.h"
+#include "engine/shared_memory.h"
+
+namespace Escape {
+    /**
+     * A front-end's side of a SharedMemoryHost in another process. latest() takes the newest
+     * frame of the shared ring, releasing the older ones unread, and submit() puts the input
+     * straight into the ring going back. Walls and tiles come from the local copy of the map
+     * folder. The client attaches whenever the host is there, and again after a host that
+     * stopped beating was restarted. Everything runs on the render thread.
+     */
+    class SharedMemoryClient : public MatchView {
+        typedef std::chrono::steady_clock clock_type;
+
+    public:
+        // seconds between attempts to attach
+        static constexpr float RETRY = 0.5f;
+        // seconds without a heartbeat before the host is taken for dead
+        static constexpr float TIMEOUT = 1;
+
+    private:
+        std::string folder;
+        std::string name;
+        SharedMemory memory;
+        SharedChannel *channel = nullptr;
+        clock_type::time_point tried;
+
+        RenderSnapshot snapshot;
+        Profiler profiler;
+        size_t counter_write, counter_read, counter_handoff, counter_skipped;
+        size_t frames = 0, skipped = 0, full = 0, attached = 0;
+        double write_us = 0, read_us = 0, handoff_us = 0;
+        float write_max = 0, read_max = 0;
+
+        bool attach();
+
+    public:
+        explicit SharedMemoryClient(const std::string &folder);
+
+        // Attaches to the host's shared memory now or, while there is none, from latest()
+        bool connect(const std::string &name);
+
+        bool isAttached() const {
+            return channel != nullptr;
+        }
+
+        const std::string &getFolder() const override {
+            return folder;
+        }
+
+        bool submit(const InputCommand &cmd) override;
+
+        // Debugging tasks cannot reach a world in another process
+        bool post(std::function<void(World &)> task) override {
+            return false;
+        }
+
+        void setCamera(const CameraRect &rect) override;
+
+        const RenderSnapshot &latest() override;
+
+        // Microseconds every frame cost to write and to read, as counters
+        Profiler &getProfiler() override {
+            return profiler;
+        }
+
+        // Frames drawn and skipped, and what handing them over cost
+        void report(std::ostream &out) const;
+    };
+}
+
+#endif //ESCAPE_SHARED_CLIENT_H
@@ -0,0 +1,98 @@
+#include "shared_host.h"
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include <thread>
+
+namespace Escape {
+    static int64_t nanoseconds() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    SharedMemoryHost::SharedMemoryHost(Match &match, int player_id) : match(match), player_id(player_id),
+                                                                      timestep(match.getTickInterval()) {
+        timeserver = match.findSystem<TimeServer>();
+        render_system = match.findSystem<RenderSystem>();
+        control_system = match.findSystem<ControlSystem>();
+        match.setPublishing(false);
+    }
+
+    bool SharedMemoryHost::create(const std::string &name) {
+        if (!memory.create(name, sizeof(SharedChannel)))
+            return false;
+        channel = new(memory.data()) SharedChannel();
+        channel->heartbeat.store(nanoseconds(), std::memory_order_relaxed);
+        // a renderer that opens it before this reads zero and waits
+        channel->magic.store(SharedChannel::MAGIC, std::memory_order_release);
+        return true;
+    }
+
+    void SharedMemoryHost::receive() {
+        InputCommand cmd;
+        while (channel->inputs.pop(cmd)) {
+            // the renderer only plays the host's player
+            cmd.player_id = player_id;
+            match.submit(cmd);
+            ++inputs;
+        }
+    }
+
+    void SharedMemoryHost::publish() {
+        auto start = std::chrono::steady_clock::now();
+        SharedFrame *frame = channel->frames.claim();
+        if (frame == nullptr) {
+            ++dropped;
+            return;
+        }
+        frame->tick = timeserver->getTick();
+        frame->delta = timeserver->getDelta();
+        entt::entity player = control_system->findPlayer(player_id);
+        frame->has_player = player != entt::null;
+        if (frame->has_player)
+            frame->player = control_system->get<Position>(player);
+
+        // the camera keeps moving while this frame waits to be drawn
+        CameraRect rect = CameraRect{channel->camera[0], channel->camera[1], channel->camera[2],
+                                     channel->camera[3]}.grown(0.25f);
+        frame->count = (uint32_t) render_system->extract(rect, frame->instances, SHARED_INSTANCES,
+                                                         RenderSystem::AGENTS | RenderSystem::BULLETS);
+        float spent = std::chrono::duration<float, std::micro>(std::chrono::steady_clock::now() - start).count();
+        frame->write_us = spent;
+        frame->committed = nanoseconds();
+        channel->frames.commit();
+        ++frames;
+        write_us += spent;
+        write_max = std::max(write_max, spent);
+    }
+
+    void SharedMemoryHost::poll(float elapsed) {
+        if (channel == nullptr)
+            return;
+        channel->heartbeat.store(nanoseconds(), std::memory_order_relaxed);
+        receive();
+        int steps = timestep.advance(elapsed);
+        for (int i = 0; i < steps; ++i) {
+            match.step();
+            publish();
+        }
+    }
+
+    void SharedMemoryHost::run(const std::atomic<bool> &running) {
+        match.prepare();
+        auto last = std::chrono::steady_clock::now();
+        while (running) {
+            auto now = std::chrono::steady_clock::now();
+            poll(std::chrono::duration<float>(now - last).count());
+            last = now;
+            // input is read every millisecond, ticks run at their own pace
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    void SharedMemoryHost::report(std::ostream &out) const {
+        out << "shared memory: " << frames << " frames, " << dropped << " dropped while the renderer was behind, "
+            << inputs << " inputs, " << (frames ? write_us / frames : 0) << " us mean write, " << write_max
+            << " us worst" << std::endl;
+    }
+}
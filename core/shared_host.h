@@ -0,0 +1,56 @@
+#ifndef ESCAPE_SHARED_HOST_H
+#define ESCAPE_SHARED_HOST_H
+
+#include <atomic>
+#include <ostream>
+#include <string>
+#include "match.h"
+#include "shared_channel.h"
+#include "engine/shared_memory.h"
+#include "engine/fixed_timestep.h"
+
+namespace Escape {
+    /**
+     * Runs a Match for a renderer in another process on the same host, through a SharedChannel.
+     * After every tick the instances around the renderer's camera are extracted straight into
+     * a free frame of the shared ring, and the renderer's inputs are read from it before the
+     * ticks. The simulation never waits for the renderer: while the ring is full, because the
+     * renderer stalled or died, frames are dropped, and a restarted renderer picks up again.
+     * Everything happens on the thread calling run(), which is also the one ticking the match.
+     */
+    class SharedMemoryHost {
+        Match &match;
+        TimeServer *timeserver;
+        RenderSystem *render_system;
+        ControlSystem *control_system;
+        int player_id;
+        SharedMemory memory;
+        SharedChannel *channel = nullptr;
+        FixedTimestep timestep;
+
+        size_t frames = 0, dropped = 0, inputs = 0;
+        double write_us = 0;
+        float write_max = 0;
+
+        void receive();
+
+        void publish();
+
+    public:
+        SharedMemoryHost(Match &match, int player_id = 1);
+
+        // Creates the shared memory under name, replacing what a crashed host left
+        bool create(const std::string &name);
+
+        // Reads inputs and runs the ticks that are due, with a frame after each
+        void poll(float elapsed);
+
+        // Polls until running turns false
+        void run(const std::atomic<bool> &running);
+
+        // Frames written and dropped, and what writing them cost
+        void report(std::ostream &out) const;
+    };
+}
+
+#endif //ESCAPE_SHARED_HOST_H
@@ -2,6 +2,7 @@
 #define TERRAIN_H
 #include "MyECS.h"
 #include "components.h"
+#include <vector>
 namespace Escape
 {
 class TerrainSystem : public ECSSystem {
@@ -14,6 +15,44 @@ public:
         world->assign<TerrainData>(wall, TerrainType::BOX, w, h, 0.0f, 0.0f);
 		return wall;
     }
+
+    // There is at most one tile layer per world, nullptr if the map has none
+    static TileMap *getTileMap(World *world) {
+        TileMap *map = nullptr;
+        world->view<TileMap>().each([&](entt::entity ent, auto &tiles) {
+            map = &tiles;
+        });
+        return map;
+    }
+
+    // Changes one cell of the tile layer, adding or removing its wall body to match
+    static void setTile(World *world, int i, int j, int gid, bool wall) {
+        TileMap *map = getTileMap(world);
+        if (map == nullptr || !map->inside(i, j))
+            return;
+        int cell = map->index(i, j);
+        if (map->tiles[cell] == gid && (map->walls[cell] != 0) == wall)
+            return;
+        map->tiles[cell] = gid;
+        if ((map->walls[cell] != 0) != wall) {
+            map->walls[cell] = wall;
+            vec2 center = map->cellCenter(i, j);
+            if (wall) {
+                createWall(world, center.x, center.y, map->tile_width, map->tile_height);
+            } else {
+                std::vector<entt::entity> found;
+                world->view<TerrainData, Position>().each([&](auto ent, auto &ter, auto &pos) {
+                    int ti, tj;
+                    map->toCell(pos.x, pos.y, ti, tj);
+                    if (ti == i && tj == j && ter.type == TerrainType::BOX)
+                        found.push_back(ent);
+                });
+                for (entt::entity ent : found)
+                    world->destroy(ent);
+            }
+        }
+        ++map->revision;
+    }
 };
     
 } // namespace Escape
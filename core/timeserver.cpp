@@ -2,7 +2,6 @@
 // Created by jack on 20-2-25.
 //
 #include <chrono>
-#include <random>
 #include <thread>
 #include "components.h"
 #include "MyECS.h"
@@ -11,13 +10,14 @@
 #include "timeserver.h"
 
 namespace Escape {
-    TimeServer::TimeServer(float rate) {
+    TimeServer::TimeServer(float rate, bool pacing) : pacing(pacing) {
         setRate(rate);
     }
 
     void TimeServer::initialize() {
         configure();
         setTick(0);
+        last = clock_type::now();
     }
 
     void TimeServer::setRate(float rate) {
@@ -25,9 +25,25 @@ namespace Escape {
         delta = 1.0f / rate;
     }
 
+    void TimeServer::setPacing(bool enabled) {
+        pacing = enabled;
+        last = clock_type::now();
+    }
+
     void TimeServer::update(float delta) {
         using namespace std::chrono_literals;
-        setTick(getTick() + 1);
+        size_t tick = getTick() + 1;
+        setTick(tick);
+        if (tick % PRUNE_PERIOD == 0) {
+            for (auto iter = streams.lower_bound(ENTITY_STREAMS); iter != streams.end();) {
+                if (getWorld()->valid((entt::entity) (iter->first - ENTITY_STREAMS)))
+                    ++iter;
+                else
+                    iter = streams.erase(iter);
+            }
+        }
+        if (!pacing)
+            return;
         clock_type::time_point next =
                 last + std::chrono::duration_cast<clock_type::duration>(std::chrono::duration<double>(this->delta));
 
@@ -35,9 +51,51 @@ namespace Escape {
         last = next;
     }
 
+    void TimeServer::setSeed(uint64_t seed_) {
+        seed = seed_;
+        streams.clear();
+    }
+
+    RandomStream &TimeServer::stream(uint64_t id) {
+        auto iter = streams.find(id);
+        if (iter == streams.end())
+            iter = streams.emplace(id, RandomStream(seed, id)).first;
+        return iter->second;
+    }
+
+    RandomStream &TimeServer::stream(entt::entity ent) {
+        return stream(ENTITY_STREAMS + entt::to_integral(ent));
+    }
+
     float TimeServer::random(float l, float h) {
-        std::uniform_real_distribution<double> u(l, h);
-        return u(engine);
+        return stream(0).uniform(l, h);
+    }
+
+    void TimeServer::save(ByteWriter &out) const {
+        out.write(seed);
+        out.write((uint32_t) streams.size());
+        for (auto &pair : streams) {
+            uint64_t state, increment;
+            pair.second.getState(state, increment);
+            out.write(pair.first);
+            out.write(state);
+            out.write(increment);
+        }
+    }
+
+    bool TimeServer::load(ByteReader &in) {
+        uint64_t seed_ = in.read<uint64_t>();
+        uint32_t count = in.read<uint32_t>();
+        std::map<uint64_t, RandomStream> loaded;
+        for (uint32_t i = 0; i < count && !in.overflowed(); ++i) {
+            uint64_t id = in.read<uint64_t>(), state = in.read<uint64_t>(), increment = in.read<uint64_t>();
+            loaded.emplace_hint(loaded.end(), id, RandomStream::fromState(state, increment));
+        }
+        if (in.overflowed())
+            return false;
+        seed = seed_;
+        streams.swap(loaded);
+        return true;
     }
 
     size_t TimeServer::getTick() {
@@ -1,10 +1,13 @@
 #if !defined(TIMESERVER_H)
 #define TIMESERVER_H
 
-#include <random>
+#include <map>
 #include <chrono>
+#include <cstdint>
 #include "MyECS.h"
 #include "engine/utils.h"
+#include "engine/random.h"
+#include "engine/byte_stream.h"
 
 namespace Escape {
     class FPSCounter : public System {
@@ -21,20 +24,48 @@ namespace Escape {
     class TimeServer : public ECSSystem {
         typedef std::chrono::steady_clock clock_type;
         float freq, delta;
+        // Sleep in update() so ticks follow the wall clock; off when a FixedTimestep drives the ticks
+        bool pacing;
         clock_type::time_point last;
-        std::default_random_engine engine;
+        uint64_t seed = 0;
+        std::map<uint64_t, RandomStream> streams;
 
     public:
-        TimeServer(float rate);
+        // streams at and above this one belong to entities
+        static constexpr uint64_t ENTITY_STREAMS = uint64_t(1) << 32;
+        // ticks between dropping the streams of entities that are gone
+        static constexpr size_t PRUNE_PERIOD = 256;
+
+        TimeServer(float rate, bool pacing = true);
 
         void initialize() override;
 
         void setRate(float rate);
 
+        void setPacing(bool enabled);
+
         void update(float delta) override;
 
+        // Restarts every stream; peers simulating the same match must agree on it
+        void setSeed(uint64_t seed);
+
+        uint64_t getSeed() const {
+            return seed;
+        }
+
+        RandomStream &stream(uint64_t id);
+
+        // Draws of one entity, in the order that entity makes them
+        RandomStream &stream(entt::entity ent);
+
+        // From the shared stream 0, whose numbers depend on everything drawn from it before
         float random(float l, float h);
 
+        // The seed and where every stream is, the part of a match's state outside the registry
+        void save(ByteWriter &out) const;
+
+        bool load(ByteReader &in);
+
         size_t getTick();
 
         void setTick(size_t tick);
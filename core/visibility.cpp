@@ -0,0 +1,170 @@
+#include "visibility.h"
+#include "terrain.h"
+
+namespace Escape {
+    // Multipliers transforming the first octant into the other seven
+    static const int OCTANTS[8][4] = {{1,  0,  0,  1},
+                                      {0,  1,  1,  0},
+                                      {0,  -1, 1,  0},
+                                      {-1, 0,  0,  1},
+                                      {-1, 0,  0,  -1},
+                                      {0,  -1, -1, 0},
+                                      {0,  1,  -1, 0},
+                                      {1,  0,  0,  -1}};
+
+    void GroupVisibility::resize(int width_, int height_) {
+        width = width_;
+        height = height_;
+        words_per_row = (width + 63) / 64;
+        counts.assign((size_t) width * height, 0);
+        bits.assign((size_t) words_per_row * height, 0);
+    }
+
+    VisibilitySystem::VisibilitySystem(int radius) : radius(radius) {
+    }
+
+    void VisibilitySystem::initialize() {
+        ECSSystem::initialize();
+        raycast_system = findSystem<RaycastSystem>();
+    }
+
+    void VisibilitySystem::see(const Viewer &viewer) {
+        auto &group = groups[viewer.group];
+        for (int cell : viewer.cells)
+            group.add(cell);
+    }
+
+    void VisibilitySystem::forget(const Viewer &viewer) {
+        auto &group = groups[viewer.group];
+        for (int cell : viewer.cells)
+            group.remove(cell);
+    }
+
+    void VisibilitySystem::mark(Viewer &viewer, int i, int j, int width) {
+        int cell = j * width + i;
+        if (stamp[cell] != generation) {
+            stamp[cell] = generation;
+            viewer.cells.push_back(cell);
+        }
+    }
+
+    void VisibilitySystem::castLight(const WallBitmap &bitmap, Viewer &viewer, int cx, int cy, int row, float start,
+                                     float end, int xx, int xy, int yx, int yy) {
+        if (start < end)
+            return;
+        int radius2 = radius * radius;
+        float new_start = start;
+        for (int j = row; j <= radius; ++j) {
+            bool blocked = false;
+            for (int dx = -j, dy = -j; dx <= 0; ++dx) {
+                int x = cx + dx * xx + dy * xy, y = cy + dx * yx + dy * yy;
+                float left = (dx - 0.5f) / (dy + 0.5f), right = (dx + 0.5f) / (dy - 0.5f);
+                if (start < right)
+                    continue;
+                if (end > left)
+                    break;
+                bool wall = bitmap.isWall(x, y);
+                if (dx * dx + dy * dy <= radius2 && x >= 0 && y >= 0 && x < bitmap.getWidth() &&
+                    y < bitmap.getHeight())
+                    mark(viewer, x, y, bitmap.getWidth());
+                if (blocked) {
+                    if (wall) {
+                        new_start = right;
+                    } else {
+                        blocked = false;
+                        start = new_start;
+                    }
+                } else if (wall && j < radius) {
+                    blocked = true;
+                    castLight(bitmap, viewer, cx, cy, j + 1, start, left, xx, xy, yx, yy);
+                    new_start = right;
+                }
+            }
+            if (blocked)
+                break;
+        }
+    }
+
+    void VisibilitySystem::shadowcast(const WallBitmap &bitmap, Viewer &viewer) {
+        viewer.cells.clear();
+        int cx = viewer.cell % bitmap.getWidth(), cy = viewer.cell / bitmap.getWidth();
+        if (++generation == 0) {
+            std::fill(stamp.begin(), stamp.end(), 0);
+            generation = 1;
+        }
+        mark(viewer, cx, cy, bitmap.getWidth());
+        for (auto &oct : OCTANTS)
+            castLight(bitmap, viewer, cx, cy, 1, 1.0f, 0.0f, oct[0], oct[1], oct[2], oct[3]);
+    }
+
+    void VisibilitySystem::update(float delta) {
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        if (map == nullptr)
+            return;
+        const WallBitmap &bitmap = raycast_system->getBitmap();
+        if (revision != bitmap.getRevision()) {
+            // walls changed, everything has to be cast again
+            revision = bitmap.getRevision();
+            viewers.clear();
+            groups.clear();
+            stamp.assign((size_t) bitmap.getWidth() * bitmap.getHeight(), 0);
+            generation = 0;
+        }
+
+        auto iter = viewers.begin();
+        while (iter != viewers.end()) {
+            if (!getWorld()->valid(iter->first) || !getWorld()->has<AgentData, Position>(iter->first)) {
+                forget(iter->second);
+                viewers.erase(iter++);
+            } else {
+                ++iter;
+            }
+        }
+
+        getWorld()->view<AgentData, Position>().each([&](auto ent, auto &agt, auto &pos) {
+            int i, j;
+            map->toCell(pos.x, pos.y, i, j);
+            int cell = map->inside(i, j) ? map->index(i, j) : -1;
+            auto found = viewers.find(ent);
+            if (found != viewers.end() && found->second.cell == cell && found->second.group == agt.group)
+                return;
+            if (found == viewers.end()) {
+                found = viewers.emplace(ent, Viewer{}).first;
+            } else {
+                forget(found->second);
+            }
+            Viewer &viewer = found->second;
+            viewer.group = agt.group;
+            viewer.cell = cell;
+            viewer.cells.clear();
+            auto &group = groups[agt.group];
+            if (group.empty())
+                group.resize(bitmap.getWidth(), bitmap.getHeight());
+            if (cell >= 0) {
+                shadowcast(bitmap, viewer);
+                see(viewer);
+            }
+        });
+    }
+
+    const GroupVisibility *VisibilitySystem::getGroup(int group) const {
+        auto iter = groups.find(group);
+        return iter == groups.end() ? nullptr : &iter->second;
+    }
+
+    bool VisibilitySystem::isVisible(int group, const vec2 &pos) {
+        TileMap *map = TerrainSystem::getTileMap(getWorld());
+        const GroupVisibility *vis = getGroup(group);
+        if (map == nullptr || vis == nullptr)
+            return false;
+        int i, j;
+        map->toCell(pos.x, pos.y, i, j);
+        return vis->isVisible(i, j);
+    }
+
+    bool VisibilitySystem::isVisible(int group, entt::entity ent) {
+        if (!getWorld()->valid(ent) || !getWorld()->has<Position>(ent))
+            return false;
+        return isVisible(group, getWorld()->get<Position>(ent));
+    }
+}
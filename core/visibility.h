@@ -0,0 +1,99 @@
+#ifndef ESCAPE_VISIBILITY_H
+#define ESCAPE_VISIBILITY_H
+
+#include <map>
+#include <vector>
+#include <cstdint>
+#include <unordered_map>
+#include "MyECS.h"
+#include "components.h"
+#include "raycast.h"
+#include "config.h"
+
+namespace Escape {
+    /**
+     * Cells seen by at least one member of a group. Every cell counts how many members see
+     * it, and the packed bitset is only touched when a count goes from or to zero.
+     */
+    class GroupVisibility {
+        int width = 0, height = 0, words_per_row = 0;
+        std::vector<uint16_t> counts;
+        std::vector<uint64_t> bits;
+
+    public:
+        void resize(int width, int height);
+
+        bool empty() const {
+            return counts.empty();
+        }
+
+        void add(int cell) {
+            if (counts[cell]++ == 0)
+                bits[(cell / width) * words_per_row + ((cell % width) >> 6)] |= uint64_t(1) << ((cell % width) & 63);
+        }
+
+        void remove(int cell) {
+            if (--counts[cell] == 0)
+                bits[(cell / width) * words_per_row + ((cell % width) >> 6)] &= ~(uint64_t(1) << ((cell % width) & 63));
+        }
+
+        bool isVisible(int i, int j) const {
+            if (i < 0 || j < 0 || i >= width || j >= height)
+                return false;
+            return (row(j)[i >> 6] >> (i & 63)) & 1u;
+        }
+
+        const uint64_t *row(int j) const {
+            return bits.data() + (size_t) j * words_per_row;
+        }
+    };
+
+    // Fog of war per AgentData::group, computed by recursive shadowcasting over the wall bitmap
+    class VisibilitySystem : public ECSSystem {
+        struct Viewer {
+            int group;
+            int cell;
+            std::vector<int> cells;
+        };
+
+        RaycastSystem *raycast_system;
+        std::map<int, GroupVisibility> groups;
+        std::unordered_map<entt::entity, Viewer> viewers;
+        size_t revision = ~size_t(0);
+        int radius;
+
+        std::vector<unsigned int> stamp;
+        unsigned int generation = 0;
+
+        void see(const Viewer &viewer);
+
+        void forget(const Viewer &viewer);
+
+        void castLight(const WallBitmap &bitmap, Viewer &viewer, int cx, int cy, int row, float start, float end,
+                       int xx, int xy, int yx, int yy);
+
+        void mark(Viewer &viewer, int i, int j, int width);
+
+        void shadowcast(const WallBitmap &bitmap, Viewer &viewer);
+
+    public:
+        VisibilitySystem(int radius = VIEW_RADIUS);
+
+        void initialize() override;
+
+        void update(float delta) override;
+
+        // Forgets every viewer, the next update() casts them all again
+        void clear() {
+            revision = ~size_t(0);
+        }
+
+        const GroupVisibility *getGroup(int group) const;
+
+        bool isVisible(int group, const vec2 &pos);
+
+        bool isVisible(int group, entt::entity ent);
+    };
+}
+
+#endif //ESCAPE_VISIBILITY_H
@@ -62,30 +62,34 @@ namespace Escape {
         });
     }
 
+    bool WeaponSystem::ready(entt::entity ent) {
+        return getWorld()->valid(ent) && getWorld()->has<Weapon>(ent) &&
+               timeserver->now() >= getWorld()->get<Weapon>(ent).next;
+    }
+
     void WeaponSystem::fire(entt::entity ent, float angle) {
-        if (getWorld()->valid(ent) && getWorld()->has<Weapon>(ent)) {
-            auto &weapon = getWorld()->get<Weapon>(ent);
-            if (timeserver->now() >= weapon.next) {
-                const WeaponPrototype &prototype = default_weapons.at(weapon.weapon);
-                float angle_diff = std::max(0.0, M_PI_4 * (100 - prototype.accuracy) / 100);
+        if (!ready(ent))
+            return;
+        auto &weapon = getWorld()->get<Weapon>(ent);
+        const WeaponPrototype &prototype = default_weapons.at(weapon.weapon);
+        float angle_diff = std::max(0.0, M_PI_4 * (100 - prototype.accuracy) / 100);
 
-                for (size_t i = 0; i < prototype.bullet_number; i++) {
+        RandomStream &spread = timeserver->stream(ent);
+        for (size_t i = 0; i < prototype.bullet_number; i++) {
 
-                    bullet_system->fire(ent, prototype.bullet_type, angle + timeserver->random(-angle_diff, angle_diff),
-                                        prototype.bullet_speed, prototype.bullet_damage, prototype.gun_length);
-                }
-                weapon.last = timeserver->now();
-                weapon.next = timeserver->now() + prototype.cd;
-            }
+            bullet_system->fire(ent, prototype.bullet_type, angle + spread.uniform(-angle_diff, angle_diff),
+                                prototype.bullet_speed, prototype.bullet_damage, prototype.gun_length);
         }
+        weapon.last = timeserver->now();
+        weapon.next = timeserver->now() + prototype.cd;
     }
 
     void WeaponSystem::changeWeapon(entt::entity ent, WeaponType type) {
-        // FIXME By changing weapon quickly, the player has a change of shooting each frame
         if (getWorld()->has<Weapon>(ent)) {
             auto &w = getWorld()->get<Weapon>(ent);
+            // the cooldown carries over, or switching back and forth would fire every tick
             if (type != w.weapon)
-                getWorld()->assign_or_replace<Weapon>(ent, Weapon{type, 0, 0});
+                getWorld()->assign_or_replace<Weapon>(ent, Weapon{type, w.last, w.next});
         } else {
             getWorld()->assign<Weapon>(ent, Weapon{type, 0});
         }
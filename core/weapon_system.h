@@ -25,7 +25,15 @@ public:
     void update(float delta) override;
     void fire(entt::entity ent, float angle);
 
+    // Whether a shot would leave the weapon now, otherwise it is still cooling down
+    bool ready(entt::entity ent);
+
     void changeWeapon(entt::entity ent, WeaponType type);
+
+    const WeaponPrototype &getPrototype(WeaponType type) const
+    {
+        return default_weapons.at(type);
+    }
 };
 } // namespace Escape
 
@@ -0,0 +1,138 @@
+#include "world_hash.h"
+#include <cstring>
+#include <string>
+#include "components.h"
+
+namespace Escape {
+    static uint64_t splitmix(uint64_t x) {
+        x += 0x9e3779b97f4a7c15ull;
+        x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ull;
+        x = (x ^ (x >> 27)) * 0x94d049bb133111ebull;
+        return x ^ (x >> 31);
+    }
+
+    struct Hasher {
+        uint64_t value;
+
+        void mix(uint64_t v) {
+            value = splitmix(value ^ v);
+        }
+
+        void mix(float f) {
+            uint32_t bits;
+            std::memcpy(&bits, &f, sizeof(bits));
+            mix((uint64_t) bits);
+        }
+
+        void mix(const std::string &s) {
+            mix((uint64_t) s.size());
+            for (char c : s)
+                mix((uint64_t) (unsigned char) c);
+        }
+    };
+
+    static void hashFields(Hasher &h, const vec2 &c) {
+        h.mix(c.x);
+        h.mix(c.y);
+    }
+
+    static void hashFields(Hasher &h, const Name &c) {
+        h.mix(c.name);
+    }
+
+    static void hashFields(Hasher &h, const Rotation &c) {
+        h.mix(c.radian);
+    }
+
+    static void hashFields(Hasher &h, const Health &c) {
+        h.mix(c.health);
+        h.mix(c.max_health);
+    }
+
+    static void hashFields(Hasher &h, const Weapon &c) {
+        h.mix((uint64_t) c.weapon);
+        h.mix(c.last);
+        h.mix(c.next);
+    }
+
+    static void hashFields(Hasher &h, const WeaponPrototype &c) {
+        h.mix((uint64_t) c.type);
+        h.mix((uint64_t) c.bullet_type);
+        h.mix(c.cd);
+        h.mix(c.accuracy);
+        h.mix(c.bullet_number);
+        h.mix(c.bullet_damage);
+        h.mix(c.bullet_speed);
+        h.mix(c.gun_length);
+    }
+
+    static void hashFields(Hasher &h, const Hitbox &c) {
+        h.mix(c.radius);
+    }
+
+    static void hashFields(Hasher &h, const BulletData &c) {
+        h.mix((uint64_t) c.firer_id);
+        h.mix((uint64_t) c.type);
+        h.mix(c.damage);
+        h.mix(c.density);
+        h.mix(c.radius);
+        h.mix((uint64_t) c.hit);
+    }
+
+    static void hashFields(Hasher &h, const Lifespan &c) {
+        h.mix(c.begin);
+        h.mix(c.end);
+    }
+
+    static void hashFields(Hasher &h, const TimeServerInfo &c) {
+        h.mix((uint64_t) c.tick);
+    }
+
+    static void hashFields(Hasher &h, const AgentData &c) {
+        h.mix((uint64_t) c.player);
+        h.mix((uint64_t) c.group);
+        h.mix(c.ai);
+    }
+
+    static void hashFields(Hasher &h, const TerrainData &c) {
+        h.mix((uint64_t) c.type);
+        h.mix(c.argument_1);
+        h.mix(c.argument_2);
+        h.mix(c.argument_3);
+        h.mix(c.argument_4);
+    }
+
+    // the cells only change along with the revision
+    static void hashFields(Hasher &h, const TileMap &c) {
+        h.mix((uint64_t) c.width);
+        h.mix((uint64_t) c.height);
+        h.mix((uint64_t) c.revision);
+    }
+
+    static void hashFields(Hasher &h, const MapInfo &c) {
+        for (auto &pair : c) {
+            h.mix(pair.first);
+            h.mix(pair.second);
+        }
+    }
+
+    template<typename T>
+    static uint64_t hashPool(World &world, uint64_t type) {
+        uint64_t total = 0;
+        world.view<T>().each([&](auto ent, auto &component) {
+            Hasher h{type};
+            h.mix((uint64_t) entt::to_integral(ent));
+            hashFields(h, component);
+            total += h.value;
+        });
+        return total;
+    }
+
+    uint64_t hashWorld(World &world) {
+        uint64_t hash = 0, type = 0;
+#define HASH(T) hash += hashPool<T>(world, ++type)
+        FOREACH_COMPONENT_TYPE(HASH);
+#undef HASH
+        return hash;
+    }
+}
@@ -0,0 +1,16 @@
+#ifndef ESCAPE_WORLD_HASH_H
+#define ESCAPE_WORLD_HASH_H
+
+#include <cstdint>
+#include "MyECS.h"
+
+namespace Escape {
+    /**
+     * Fingerprint of every component in the registry, for peers that must hold the same world.
+     * Components are hashed field by field, never as raw bytes that would take in padding, and
+     * the entries are summed so the order of the pools does not change the result.
+     */
+    uint64_t hashWorld(World &world);
+}
+
+#endif //ESCAPE_WORLD_HASH_H
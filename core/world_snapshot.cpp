@@ -0,0 +1,284 @@
+#include "world_snapshot.h"
+#include <type_traits>
+#include "components.h"
+
+namespace Escape {
+    static constexpr uint32_t MAGIC = 0x57534e31;
+
+    // entt's snapshot asks the archive for entities and for counts
+    struct SnapshotWriter {
+        ByteWriter &out;
+
+        void operator()(entt::entity ent) {
+            out.write((uint32_t) entt::to_integral(ent));
+        }
+
+        void operator()(std::underlying_type_t<entt::entity> count) {
+            out.write((uint32_t) count);
+        }
+    };
+
+    struct SnapshotReader {
+        ByteReader &in;
+
+        void operator()(entt::entity &ent) {
+            ent = (entt::entity) in.read<uint32_t>();
+        }
+
+        void operator()(std::underlying_type_t<entt::entity> &count) {
+            count = (std::underlying_type_t<entt::entity>) in.read<uint32_t>();
+        }
+    };
+
+    static void writeFields(ByteWriter &out, const vec2 &c) {
+        out.write(c.x);
+        out.write(c.y);
+    }
+
+    static void readFields(ByteReader &in, vec2 &c) {
+        c.x = in.read<float>();
+        c.y = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const Name &c) {
+        out.writeString(c.name);
+    }
+
+    static void readFields(ByteReader &in, Name &c) {
+        c.name = in.readString();
+    }
+
+    static void writeFields(ByteWriter &out, const Rotation &c) {
+        out.write(c.radian);
+    }
+
+    static void readFields(ByteReader &in, Rotation &c) {
+        c.radian = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const Health &c) {
+        out.write(c.health);
+        out.write(c.max_health);
+    }
+
+    static void readFields(ByteReader &in, Health &c) {
+        c.health = in.read<float>();
+        c.max_health = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const Weapon &c) {
+        out.write(c.weapon);
+        out.write(c.last);
+        out.write(c.next);
+    }
+
+    static void readFields(ByteReader &in, Weapon &c) {
+        c.weapon = in.read<WeaponType>();
+        c.last = in.read<float>();
+        c.next = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const WeaponPrototype &c) {
+        out.write(c.type);
+        out.write(c.bullet_type);
+        out.write(c.cd);
+        out.write(c.accuracy);
+        out.write(c.bullet_number);
+        out.write(c.bullet_damage);
+        out.write(c.bullet_speed);
+        out.write(c.gun_length);
+    }
+
+    static void readFields(ByteReader &in, WeaponPrototype &c) {
+        c.type = in.read<WeaponType>();
+        c.bullet_type = in.read<BulletType>();
+        c.cd = in.read<float>();
+        c.accuracy = in.read<float>();
+        c.bullet_number = in.read<float>();
+        c.bullet_damage = in.read<float>();
+        c.bullet_speed = in.read<float>();
+        c.gun_length = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const Hitbox &c) {
+        out.write(c.radius);
+    }
+
+    static void readFields(ByteReader &in, Hitbox &c) {
+        c.radius = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const BulletData &c) {
+        out.write(c.firer_id);
+        out.write(c.type);
+        out.write(c.damage);
+        out.write(c.density);
+        out.write(c.radius);
+        out.write(c.hit);
+    }
+
+    static void readFields(ByteReader &in, BulletData &c) {
+        c.firer_id = in.read<unsigned int>();
+        c.type = in.read<BulletType>();
+        c.damage = in.read<float>();
+        c.density = in.read<float>();
+        c.radius = in.read<float>();
+        c.hit = in.read<bool>();
+    }
+
+    static void writeFields(ByteWriter &out, const Lifespan &c) {
+        out.write(c.begin);
+        out.write(c.end);
+    }
+
+    static void readFields(ByteReader &in, Lifespan &c) {
+        c.begin = in.read<float>();
+        c.end = in.read<float>();
+    }
+
+    static void writeFields(ByteWriter &out, const TimeServerInfo &c) {
+        out.write((uint64_t) c.tick);
+    }
+
+    static void readFields(ByteReader &in, TimeServerInfo &c) {
+        c.tick = (size_t) in.read<uint64_t>();
+    }
+
+    static void writeFields(ByteWriter &out, const AgentData &c) {
+        out.write(c.player);
+        out.write(c.group);
+        out.writeString(c.ai);
+    }
+
+    static void readFields(ByteReader &in, AgentData &c) {
+        c.player = in.read<int>();
+        c.group = in.read<int>();
+        c.ai = in.readString();
+    }
+
+    static void writeFields(ByteWriter &out, const TerrainData &c) {
+        out.write(c.type);
+        out.write(c.argument_1);
+        out.write(c.argument_2);
+        out.write(c.argument_3);
+        out.write(c.argument_4);
+    }
+
+    static void readFields(ByteReader &in, TerrainData &c) {
+        c.type = in.read<TerrainType>();
+        c.argument_1 = in.read<float>();
+        c.argument_2 = in.read<float>();
+        c.argument_3 = in.read<float>();
+        c.argument_4 = in.read<float>();
+    }
+
+    static void writeCells(ByteWriter &out, const std::vector<int> &cells) {
+        out.write((uint32_t) cells.size());
+        out.writeBytes(cells.data(), cells.size() * sizeof(int));
+    }
+
+    static void readCells(ByteReader &in, std::vector<int> &cells) {
+        uint32_t count = in.read<uint32_t>();
+        const uint8_t *at = in.readBytes((size_t) count * sizeof(int));
+        cells.resize(at ? count : 0);
+        if (at != nullptr && count > 0)
+            std::memcpy(cells.data(), at, (size_t) count * sizeof(int));
+    }
+
+    static void writeFields(ByteWriter &out, const TileMap &c) {
+        out.write(c.width);
+        out.write(c.height);
+        out.write(c.origin_x);
+        out.write(c.origin_y);
+        out.write(c.tile_width);
+        out.write(c.tile_height);
+        writeCells(out, c.tiles);
+        writeCells(out, c.walls);
+        out.write((uint64_t) c.revision);
+        out.write(c.tileset_columns);
+        out.write(c.tileset_rows);
+    }
+
+    static void readFields(ByteReader &in, TileMap &c) {
+        c.width = in.read<int>();
+        c.height = in.read<int>();
+        c.origin_x = in.read<float>();
+        c.origin_y = in.read<float>();
+        c.tile_width = in.read<float>();
+        c.tile_height = in.read<float>();
+        readCells(in, c.tiles);
+        readCells(in, c.walls);
+        c.revision = (size_t) in.read<uint64_t>();
+        c.tileset_columns = in.read<int>();
+        c.tileset_rows = in.read<int>();
+    }
+
+    static void writeFields(ByteWriter &out, const MapInfo &c) {
+        out.write((uint32_t) c.size());
+        for (auto &pair : c) {
+            out.writeString(pair.first);
+            out.writeString(pair.second);
+        }
+    }
+
+    static void readFields(ByteReader &in, MapInfo &c) {
+        uint32_t count = in.read<uint32_t>();
+        for (uint32_t i = 0; i < count && !in.overflowed(); ++i) {
+            std::string key = in.readString();
+            c[key] = in.readString();
+        }
+    }
+
+    template<typename T>
+    static void savePool(World &world, ByteWriter &out) {
+        size_t count = world.size<T>();
+        const entt::entity *entities = world.data<T>();
+        const T *components = world.raw<T>();
+        out.write((uint32_t) count);
+        for (size_t i = 0; i < count; ++i) {
+            out.write((uint32_t) entt::to_integral(entities[i]));
+            writeFields(out, components[i]);
+        }
+    }
+
+    template<typename T>
+    static bool loadPool(World &world, ByteReader &in) {
+        uint32_t count = in.read<uint32_t>();
+        for (uint32_t i = 0; i < count; ++i) {
+            auto ent = (entt::entity) in.read<uint32_t>();
+            T component{};
+            readFields(in, component);
+            if (in.overflowed() || !world.valid(ent) || world.has<T>(ent))
+                return false;
+            // appended in the order they were stored in
+            world.assign<T>(ent, std::move(component));
+        }
+        return !in.overflowed();
+    }
+
+    void saveWorld(World &world, ByteWriter &out) {
+        out.write(MAGIC);
+        SnapshotWriter archive{out};
+        world.snapshot().entities(archive).destroyed(archive);
+#define SAVE(T) savePool<T>(world, out)
+        FOREACH_COMPONENT_TYPE(SAVE);
+#undef SAVE
+    }
+
+    bool loadWorld(World &world, ByteReader &in) {
+        if (in.read<uint32_t>() != MAGIC)
+            return false;
+        // built aside, a malformed image leaves the world as it was
+        World loaded;
+        SnapshotReader archive{in};
+        loaded.loader().entities(archive).destroyed(archive);
+        bool ok = !in.overflowed();
+#define LOAD(T) ok = ok && loadPool<T>(loaded, in)
+        FOREACH_COMPONENT_TYPE(LOAD);
+#undef LOAD
+        if (!ok)
+            return false;
+        world = std::move(loaded);
+        return true;
+    }
+}
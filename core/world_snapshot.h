@@ -0,0 +1,23 @@
+#ifndef ESCAPE_WORLD_SNAPSHOT_H
+#define ESCAPE_WORLD_SNAPSHOT_H
+
+#include <cstdint>
+#include "MyECS.h"
+#include "engine/byte_stream.h"
+
+namespace Escape {
+    /**
+     * Binary image of the registry, for keyframes of recordings. Entities keep their
+     * identifiers and the registry its recycled ones, through entt's snapshot. Every pool is
+     * written field by field in the order it is stored in and read back in that order, so
+     * the restored registry also iterates its views the same way, which the systems depend
+     * on to repeat a tick exactly. Path is left out, agents ask again.
+     * The image is for the build that wrote it, values are in the byte order of the machine.
+     */
+    void saveWorld(World &world, ByteWriter &out);
+
+    // Replaces the content of world, false when the image is malformed and world was left alone
+    bool loadWorld(World &world, ByteReader &in);
+}
+
+#endif //ESCAPE_WORLD_SNAPSHOT_H
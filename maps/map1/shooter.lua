@@ -15,7 +15,7 @@ function update()
 
     local angle = math.atan2(p.y - pos.y, p.x - pos.x);
 
-    if math.pow(p.x - pos.x, 2) + math.pow(p.y - pos.y, 2) < 15 * 15 then
+    if math.pow(p.x - pos.x, 2) + math.pow(p.y - pos.y, 2) < 15 * 15 and los(id, "player") then
         post({
             type = "shooting",
             angle = angle
@@ -15,15 +15,19 @@ function update()
 
     local angle = math.atan2(p.y - pos.y, p.x - pos.x);
 
-    if math.pow(p.x - pos.x, 2) + math.pow(p.y - pos.y, 2) < 15 * 15 then
+    local close = math.pow(p.x - pos.x, 2) + math.pow(p.y - pos.y, 2) < 15 * 15
+    if close and los(id, "player") then
         post({
             type = "shooting",
             angle = angle
         });
+    end
+    if close then
+        local dx, dy = flow("player");
         post({
             type = "move",
-            x = math.cos(angle) * 6,
-            y = math.sin(angle) * 6,
+            x = dx * 6,
+            y = dy * 6,
         });
     end
 